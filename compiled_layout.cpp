@@ -0,0 +1,112 @@
+#include "compiled_layout.hpp"
+#include <cstring>
+
+namespace keydrive {
+
+	namespace {
+
+		// Per-key overhead of the key index (node plus buckets) and alignment slack
+		constexpr size_t INDEX_BYTES_PER_KEY = 64;
+		constexpr size_t ARENA_SLACK = 256;
+
+		size_t totalLength(const std::vector<std::string>& names) {
+			size_t bytes = 0;
+			for (const auto& name : names) {
+				bytes += name.size();
+			}
+			return bytes;
+		}
+
+		size_t arenaSize(const std::vector<std::string>& keyNames, const std::vector<std::string>& layerNames,
+						 size_t textBytes) {
+			size_t keys = keyNames.size();
+			size_t layers = layerNames.size();
+			return totalLength(keyNames) + totalLength(layerNames) + textBytes
+				+ (keys + layers) * sizeof(std::string_view)
+				+ keys * layers * sizeof(CompiledLayout::Cell)
+				+ keys * (sizeof(int) + sizeof(CompiledLayout::LayerBinding) + INDEX_BYTES_PER_KEY)
+				+ ARENA_SLACK;
+		}
+
+	} // anonymous namespace
+
+	CompiledLayout::CompiledLayout(const std::vector<std::string>& keyNameList,
+								   const std::vector<std::string>& layerNameList,
+								   size_t textBytes)
+		: reservedBytes(arenaSize(keyNameList, layerNameList, textBytes)),
+		  arena(reservedBytes),
+		  keyNames(&arena),
+		  layerNames(&arena),
+		  cells(&arena),
+		  bindingIndex(&arena),
+		  bindings(&arena),
+		  keyIndex(&arena) {
+		// Exact reservations: a vector growing inside a monotonic arena would
+		// leave its old buffers behind
+		keyNames.reserve(keyNameList.size());
+		layerNames.reserve(layerNameList.size());
+		cells.resize(keyNameList.size() * layerNameList.size());
+		bindingIndex.assign(keyNameList.size(), -1);
+		bindings.reserve(keyNameList.size());
+		keyIndex.reserve(keyNameList.size());
+
+		for (const auto& name : keyNameList) {
+			keyNames.push_back(intern(name));
+			// A key listed twice maps to its last position, as before
+			keyIndex[keyNames.back()] = keyNames.size() - 1;
+		}
+		for (const auto& name : layerNameList) {
+			layerNames.push_back(intern(name));
+		}
+	}
+
+	std::string_view CompiledLayout::intern(std::string_view text) {
+		if (text.empty()) {
+			return {};
+		}
+		char* copy = static_cast<char*>(arena.allocate(text.size(), 1));
+		std::memcpy(copy, text.data(), text.size());
+		return {copy, text.size()};
+	}
+
+	void CompiledLayout::setCell(size_t layer, size_t position, std::string_view raw, std::string_view text,
+								 std::optional<char32_t> character) {
+		Cell& cell = cells[layer * keyNames.size() + position];
+		cell.raw = intern(raw);
+		// The cleaned text is usually the raw text itself; share the bytes then
+		cell.text = (text == raw) ? cell.raw : intern(text);
+		cell.character = character.value_or(0);
+		cell.hasCharacter = character.has_value();
+	}
+
+	void CompiledLayout::setLayerBinding(size_t position, std::string_view targetLayer, LayerType type) {
+		// The target is a layer name, so reuse the interned copy when there is one
+		std::string_view target;
+		if (auto layer = findLayer(targetLayer)) {
+			target = layerNames[*layer];
+		} else {
+			target = intern(targetLayer);
+		}
+		bindingIndex[position] = static_cast<int>(bindings.size());
+		bindings.push_back({target, type});
+	}
+
+	std::optional<size_t> CompiledLayout::findKey(std::string_view keyName) const {
+		auto it = keyIndex.find(keyName);
+		if (it == keyIndex.end()) {
+			return std::nullopt;
+		}
+		return it->second;
+	}
+
+	std::optional<size_t> CompiledLayout::findLayer(std::string_view layerName) const {
+		// A handful of layers; a linear scan beats hashing here
+		for (size_t layer = 0; layer < layerNames.size(); ++layer) {
+			if (layerNames[layer] == layerName) {
+				return layer;
+			}
+		}
+		return std::nullopt;
+	}
+
+} // namespace keydrive
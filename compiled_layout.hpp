@@ -0,0 +1,127 @@
+#pragma once
+
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+namespace keydrive {
+
+	enum class LayerType;
+
+	/**
+	 * @brief Immutable lookup tables for one version of a layout
+	 *
+	 * Everything (cells, key and layer names, the string pool, the key index)
+	 * lives in a single arena sized up front, so a layout is one contiguous
+	 * block instead of a tree of small allocations. The arena is released as a
+	 * whole when the last holder drops its reference; layouts are shared as
+	 * std::shared_ptr<const CompiledLayout>, so a reload never frees tables a
+	 * reader is still using.
+	 */
+	class CompiledLayout {
+	public:
+		/**
+		 * @brief One key position in one layer
+		 */
+		struct Cell {
+			std::string_view raw;   // As written in the layout (for logs)
+			std::string_view text;  // Quotes and whitespace removed; empty if unmapped
+			char32_t character = 0; // Decoded character, valid if hasCharacter
+			bool hasCharacter = false;
+		};
+
+		/**
+		 * @brief Layer activated by a key whose base cell is a layer key ("ly...")
+		 */
+		struct LayerBinding {
+			std::string_view targetLayer;
+			LayerType type;
+		};
+
+		/**
+		 * @brief Create empty tables with their arena
+		 *
+		 * @param keyNames Key names in source order (e.g., "key_a")
+		 * @param layerNames Layer names; every layer has a cell for every key
+		 * @param textBytes Total size of the cell strings to be added, used to size the arena
+		 */
+		CompiledLayout(const std::vector<std::string>& keyNames,
+					   const std::vector<std::string>& layerNames,
+					   size_t textBytes);
+
+		CompiledLayout(const CompiledLayout&) = delete;
+		CompiledLayout& operator=(const CompiledLayout&) = delete;
+
+		/**
+		 * @brief Fill a cell while building; strings are copied into the arena
+		 */
+		void setCell(size_t layer, size_t position, std::string_view raw, std::string_view text,
+					 std::optional<char32_t> character);
+
+		/**
+		 * @brief Make a key activate a layer while building
+		 */
+		void setLayerBinding(size_t position, std::string_view targetLayer, LayerType type);
+
+		/**
+		 * @brief Find a key's position in the layout
+		 */
+		std::optional<size_t> findKey(std::string_view keyName) const;
+
+		/**
+		 * @brief Find a layer by name
+		 */
+		std::optional<size_t> findLayer(std::string_view layerName) const;
+
+		const Cell& getCell(size_t layer, size_t position) const {
+			return cells[layer * keyNames.size() + position];
+		}
+
+		/**
+		 * @brief Get the layer a key activates, or nullptr for ordinary keys
+		 */
+		const LayerBinding* getLayerBinding(size_t position) const {
+			return bindingIndex[position] < 0 ? nullptr : &bindings[static_cast<size_t>(bindingIndex[position])];
+		}
+
+		size_t keyCount() const {
+			return keyNames.size();
+		}
+
+		size_t layerCount() const {
+			return layerNames.size();
+		}
+
+		std::string_view getKeyName(size_t position) const {
+			return keyNames[position];
+		}
+
+		std::string_view getLayerName(size_t layer) const {
+			return layerNames[layer];
+		}
+
+		/**
+		 * @brief Get the bytes reserved for the arena
+		 */
+		size_t arenaBytes() const {
+			return reservedBytes;
+		}
+
+	private:
+		std::string_view intern(std::string_view text);
+
+		size_t reservedBytes;
+		std::pmr::monotonic_buffer_resource arena;
+
+		std::pmr::vector<std::string_view> keyNames;
+		std::pmr::vector<std::string_view> layerNames;
+		std::pmr::vector<Cell> cells;
+		std::pmr::vector<int> bindingIndex;
+		std::pmr::vector<LayerBinding> bindings;
+		std::pmr::unordered_map<std::string_view, size_t> keyIndex;
+	};
+
+} // namespace keydrive
@@ -0,0 +1,222 @@
+#include "control_server.hpp"
+#include "unix_socket.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace keydrive {
+
+	namespace {
+
+		constexpr size_t MAX_CLIENTS = 32;
+		constexpr size_t MAX_LINE = 512;
+		// Per-client output bound: a stalled subscriber costs at most this much memory
+		constexpr size_t MAX_BUFFERED = 16 * 1024;
+
+	} // anonymous namespace
+
+	std::string defaultControlSocketPath() {
+		const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+		if (runtimeDir && *runtimeDir) {
+			return std::string(runtimeDir) + "/keydrive.sock";
+		}
+		return "/tmp/keydrive-" + std::to_string(getuid()) + ".sock";
+	}
+
+	ControlServer::ControlServer(Reactor& reactor, const std::string& path, CommandHandler handler)
+		: reactor(reactor), path(path), handler(std::move(handler)) {
+		listenFd = listenUnixSocket(path, 8, "control");
+
+		reactor.add(listenFd, EPOLLIN, [this](uint32_t) {
+			acceptClients();
+		});
+	}
+
+	ControlServer::~ControlServer() {
+		for (const auto& [fd, client] : clients) {
+			reactor.remove(fd);
+			close(fd);
+		}
+		reactor.remove(listenFd);
+		close(listenFd);
+		unlink(path.c_str());
+	}
+
+	void ControlServer::acceptClients() {
+		while (true) {
+			int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (fd < 0) {
+				return;  // EAGAIN: backlog drained
+			}
+			if (clients.size() >= MAX_CLIENTS || !peerAllowed(fd)) {
+				close(fd);
+				continue;
+			}
+
+			clients.emplace(fd, Client{});
+			reactor.add(fd, EPOLLIN, [this, fd](uint32_t events) {
+				handleClient(fd, events);
+			});
+		}
+	}
+
+	void ControlServer::handleClient(int fd, uint32_t events) {
+		auto it = clients.find(fd);
+		if (it == clients.end()) {
+			return;
+		}
+		Client& client = it->second;
+
+		if ((events & EPOLLOUT) && !flush(fd, client)) {
+			disconnect(fd);
+			return;
+		}
+
+		if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+			char buffer[512];
+			while (true) {
+				ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+				if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+					disconnect(fd);
+					return;
+				}
+				if (received < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					break;
+				}
+
+				client.input.append(buffer, static_cast<size_t>(received));
+				size_t newline;
+				while ((newline = client.input.find('\n')) != std::string::npos) {
+					std::string line = client.input.substr(0, newline);
+					client.input.erase(0, newline + 1);
+					handleLine(fd, client, line);
+				}
+				if (client.input.size() > MAX_LINE) {
+					disconnect(fd);
+					return;
+				}
+			}
+		}
+	}
+
+	void ControlServer::handleLine(int fd, Client& client, const std::string& line) {
+		std::string command = line;
+		std::string args;
+		size_t space = line.find(' ');
+		if (space != std::string::npos) {
+			command = line.substr(0, space);
+			args = line.substr(space + 1);
+		}
+		if (!command.empty() && command.back() == '\r') {
+			command.pop_back();
+		}
+		if (command.empty()) {
+			return;
+		}
+
+		if (command == "subscribe") {
+			client.subscribed = true;
+			enqueue(fd, client, "ok");
+			return;
+		}
+
+		std::string reply;
+		try {
+			reply = handler(command, args);
+		} catch (const std::exception& e) {
+			reply = std::string("error ") + e.what();
+		}
+		enqueue(fd, client, reply);
+	}
+
+	void ControlServer::enqueue(int fd, Client& client, const std::string& message) {
+		size_t needed = message.size() + 1;
+		std::string notice;
+		if (client.dropped > 0) {
+			notice = "dropped " + std::to_string(client.dropped) + "\n";
+			needed += notice.size();
+		}
+
+		if (client.output.size() + needed > MAX_BUFFERED) {
+			++client.dropped;
+			++totalDropped;
+			return;
+		}
+
+		client.output += notice;
+		client.output += message;
+		client.output += '\n';
+		client.dropped = 0;
+
+		if (client.writable && !flush(fd, client)) {
+			// Close later from the client's own handler; publish() may be iterating
+			client.writable = false;
+			reactor.modify(fd, EPOLLIN | EPOLLOUT);
+		}
+	}
+
+	bool ControlServer::flush(int fd, Client& client) {
+		while (!client.output.empty()) {
+			ssize_t sent = send(fd, client.output.data(), client.output.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (sent < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					// Socket buffer full: wait for EPOLLOUT instead of spinning
+					if (client.writable) {
+						client.writable = false;
+						reactor.modify(fd, EPOLLIN | EPOLLOUT);
+					}
+					return true;
+				}
+				return false;
+			}
+			client.output.erase(0, static_cast<size_t>(sent));
+		}
+
+		if (!client.writable) {
+			client.writable = true;
+			reactor.modify(fd, EPOLLIN);
+		}
+		return true;
+	}
+
+	void ControlServer::disconnect(int fd) {
+		reactor.remove(fd);
+		close(fd);
+		clients.erase(fd);
+	}
+
+	void ControlServer::publish(const std::string& message) {
+		for (auto& [fd, client] : clients) {
+			if (client.subscribed) {
+				enqueue(fd, client, message);
+			}
+		}
+	}
+
+	size_t ControlServer::subscriberCount() const {
+		size_t count = 0;
+		for (const auto& [fd, client] : clients) {
+			if (client.subscribed) {
+				++count;
+			}
+		}
+		return count;
+	}
+
+	uint64_t ControlServer::droppedMessages() const {
+		return totalDropped;
+	}
+
+} // namespace keydrive
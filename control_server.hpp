@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+#include "reactor.hpp"
+
+namespace keydrive {
+
+	/**
+	 * @brief Get the control socket path ($XDG_RUNTIME_DIR/keydrive.sock)
+	 */
+	std::string defaultControlSocketPath();
+
+	/**
+	 * @brief Line-based control socket served from the reactor
+	 *
+	 * Clients send one command per line and get the reply back as one or more
+	 * lines. "subscribe" turns the connection into a subscription: from then on
+	 * the client receives a line for every published change ("layer nav",
+	 * "layout default", ...).
+	 *
+	 * Every client has a bounded output buffer. When a slow client's buffer is
+	 * full, further messages for it are dropped and counted, and the client is
+	 * told how many it missed ("dropped 3") once it catches up. Nothing on this
+	 * socket ever blocks the reactor.
+	 */
+	class ControlServer {
+	public:
+		/**
+		 * @brief Answers a command; returns the reply without the trailing newline
+		 */
+		using CommandHandler = std::function<std::string(const std::string& command, const std::string& args)>;
+
+		/**
+		 * @brief Bind the socket and register it with the reactor
+		 *
+		 * A stale socket left by a crashed instance is replaced.
+		 *
+		 * @param reactor Reactor serving the socket and the clients
+		 * @param path Socket path
+		 * @param handler Answers every command except "subscribe"
+		 * @throws std::runtime_error if the socket cannot be created or another instance is listening
+		 */
+		ControlServer(Reactor& reactor, const std::string& path, CommandHandler handler);
+
+		/**
+		 * @brief Disconnect all clients, close and unlink the socket
+		 */
+		~ControlServer();
+
+		ControlServer(const ControlServer&) = delete;
+		ControlServer& operator=(const ControlServer&) = delete;
+
+		/**
+		 * @brief Push a message to every subscriber
+		 *
+		 * @param message Single line without the trailing newline
+		 */
+		void publish(const std::string& message);
+
+		/**
+		 * @brief Get the number of connected subscribers
+		 */
+		size_t subscriberCount() const;
+
+		/**
+		 * @brief Get the number of messages dropped for slow subscribers since startup
+		 */
+		uint64_t droppedMessages() const;
+
+	private:
+		struct Client {
+			std::string input;
+			std::string output;         // Bytes not yet accepted by the socket
+			bool subscribed = false;
+			bool writable = true;       // false while waiting for EPOLLOUT
+			uint64_t dropped = 0;       // Dropped since the last "dropped" notice
+		};
+
+		void acceptClients();
+		void handleClient(int fd, uint32_t events);
+		void handleLine(int fd, Client& client, const std::string& line);
+		void enqueue(int fd, Client& client, const std::string& message);
+		bool flush(int fd, Client& client);
+		void disconnect(int fd);
+
+		Reactor& reactor;
+		std::string path;
+		CommandHandler handler;
+		int listenFd = -1;
+		std::unordered_map<int, Client> clients;
+		uint64_t totalDropped = 0;
+	};
+
+} // namespace keydrive
@@ -0,0 +1,191 @@
+#include "guardian.hpp"
+#include "reactor.hpp"
+#include <iostream>
+#include <chrono>
+#include <deque>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <libevdev/libevdev.h>
+#include <libevdev/libevdev-uinput.h>
+
+namespace keydrive {
+
+	namespace {
+
+		// Crash-loop protection: give up after this many restarts within the window
+		constexpr size_t MAX_RESTARTS = 5;
+		constexpr auto RESTART_WINDOW = std::chrono::seconds(30);
+
+		const unsigned int MODIFIER_KEYS[] = {
+			KEY_LEFTCTRL, KEY_RIGHTCTRL,
+			KEY_LEFTSHIFT, KEY_RIGHTSHIFT,
+			KEY_LEFTALT, KEY_RIGHTALT,
+			KEY_LEFTMETA, KEY_RIGHTMETA
+		};
+
+		// Created before the first child so it is ready the moment the daemon dies
+		class FallbackKeyboard {
+		public:
+			FallbackKeyboard() {
+				dev = libevdev_new();
+				if (!dev) {
+					std::cerr << "⚠ Guardian: failed to create fallback device" << std::endl;
+					return;
+				}
+				libevdev_set_name(dev, "Keydrive Guardian");
+				for (unsigned int key : MODIFIER_KEYS) {
+					libevdev_enable_event_code(dev, EV_KEY, key, nullptr);
+				}
+				if (libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &virtKb) < 0) {
+					std::cerr << "⚠ Guardian: failed to create fallback uinput device" << std::endl;
+					virtKb = nullptr;
+				}
+			}
+
+			~FallbackKeyboard() {
+				if (virtKb) {
+					libevdev_uinput_destroy(virtKb);
+				}
+				if (dev) {
+					libevdev_free(dev);
+				}
+			}
+
+			FallbackKeyboard(const FallbackKeyboard&) = delete;
+			FallbackKeyboard& operator=(const FallbackKeyboard&) = delete;
+
+			void releaseModifiers() {
+				if (!virtKb) {
+					return;
+				}
+				// libinput drops releases for keys this device never pressed,
+				// so tap each modifier to make the compositor clear it
+				for (unsigned int key : MODIFIER_KEYS) {
+					libevdev_uinput_write_event(virtKb, EV_KEY, key, 1);
+					libevdev_uinput_write_event(virtKb, EV_SYN, SYN_REPORT, 0);
+					libevdev_uinput_write_event(virtKb, EV_KEY, key, 0);
+					libevdev_uinput_write_event(virtKb, EV_SYN, SYN_REPORT, 0);
+				}
+				std::cout << "🛡 Guardian: released modifiers" << std::endl;
+			}
+
+		private:
+			struct libevdev* dev = nullptr;
+			struct libevdev_uinput* virtKb = nullptr;
+		};
+
+		pid_t spawnDaemon(const std::function<int()>& daemon) {
+			// Don't let the child inherit (and print twice) buffered output
+			std::cout.flush();
+			std::cerr.flush();
+
+			pid_t pid = fork();
+			if (pid == 0) {
+				// Never outlive the guardian
+				prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+				int code = 1;
+				try {
+					code = daemon();
+				} catch (const std::exception& e) {
+					std::cerr << "❌ Daemon failed: " << e.what() << std::endl;
+				}
+				std::cout.flush();
+				std::cerr.flush();
+				_exit(code);
+			}
+			if (pid < 0) {
+				std::cerr << "❌ Guardian: fork failed: " << std::strerror(errno) << std::endl;
+			}
+			return pid;
+		}
+
+	} // anonymous namespace
+
+	int runGuardian(const std::function<int()>& daemon) {
+		FallbackKeyboard fallback;
+		Reactor reactor;
+
+		pid_t child = -1;
+		bool stopping = false;
+		int exitCode = 0;
+		std::deque<std::chrono::steady_clock::time_point> restarts;
+
+		// SIGCHLD arrives on the signalfd the instant the daemon dies
+		reactor.addSignals({SIGINT, SIGTERM, SIGHUP, SIGCHLD}, [&](int signal) {
+			if (signal == SIGHUP) {
+				if (child > 0) {
+					kill(child, SIGHUP);
+				}
+				return;
+			}
+
+			if (signal == SIGINT || signal == SIGTERM) {
+				stopping = true;
+				if (child > 0) {
+					kill(child, SIGTERM);
+				} else {
+					reactor.stop();
+				}
+				return;
+			}
+
+			int status = 0;
+			pid_t pid;
+			while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+				if (pid != child) {
+					continue;
+				}
+				child = -1;
+
+				bool clean = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+				if (clean || stopping) {
+					exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 0;
+					reactor.stop();
+					continue;
+				}
+
+				if (WIFSIGNALED(status)) {
+					std::cerr << "💥 Daemon killed by signal " << WTERMSIG(status)
+					<< " (" << strsignal(WTERMSIG(status)) << ")" << std::endl;
+				} else {
+					std::cerr << "💥 Daemon exited with status " << WEXITSTATUS(status) << std::endl;
+				}
+				fallback.releaseModifiers();
+
+				auto now = std::chrono::steady_clock::now();
+				while (!restarts.empty() && now - restarts.front() > RESTART_WINDOW) {
+					restarts.pop_front();
+				}
+				if (restarts.size() >= MAX_RESTARTS) {
+					std::cerr << "❌ Guardian: daemon keeps crashing, giving up" << std::endl;
+					exitCode = 1;
+					reactor.stop();
+					continue;
+				}
+				restarts.push_back(now);
+
+				child = spawnDaemon(daemon);
+				if (child < 0) {
+					exitCode = 1;
+					reactor.stop();
+				} else {
+					std::cout << "🛡 Guardian: restarted daemon (pid " << child << ")" << std::endl;
+				}
+			}
+		});
+
+		child = spawnDaemon(daemon);
+		if (child < 0) {
+			return 1;
+		}
+		std::cout << "🛡 Guardian watching daemon (pid " << child << ")" << std::endl;
+
+		reactor.run();
+		return exitCode;
+	}
+
+} // namespace keydrive
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <functional>
+
+namespace keydrive {
+
+	/**
+	 * @brief Run the daemon under a crash guardian
+	 *
+	 * The calling process becomes a small supervisor: it creates a fallback
+	 * uinput device, then forks the daemon. Everything prepared before the call
+	 * (such as the parsed layout) is inherited by each child, so a restart skips
+	 * that work. When the child dies abnormally the guardian taps every modifier
+	 * on the fallback device to clear stuck modifiers and forks a new child.
+	 * A clean exit of the child (status 0) ends the guardian as well.
+	 *
+	 * SIGINT/SIGTERM stop the child and the guardian, SIGHUP is forwarded.
+	 *
+	 * @param daemon Runs the daemon in the child and returns its exit code
+	 * @return int Exit code for main()
+	 */
+	int runGuardian(const std::function<int()>& daemon);
+
+} // namespace keydrive
@@ -0,0 +1,201 @@
+#include "handover.hpp"
+#include "unix_socket.hpp"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace keydrive {
+
+	namespace {
+
+		constexpr const char* REQUEST = "HANDOVER 1\n";
+		constexpr size_t MAX_PAYLOAD = 4096;
+
+		// One "key=value" line per field
+		std::string serializeState(const HandoverState& state) {
+			std::ostringstream out;
+			out << "layout=" << state.layout << "\n";
+			out << "layer.current=" << state.layerState.current << "\n";
+			out << "layer.oneTime=" << state.layerState.oneTime << "\n";
+			out << "layer.hold=" << state.layerState.hold << "\n";
+			out << "layer.holdKey=" << state.layerState.holdKey << "\n";
+			for (const auto& [layer, active] : state.layerState.toggles) {
+				out << "toggle=" << (active ? 1 : 0) << layer << "\n";
+			}
+			state.heldKeys.forEach([&out](unsigned int code) {
+				out << "held=" << code << "\n";
+			});
+			for (const auto& [code, sentAs] : state.forwardedAs) {
+				out << "forwarded=" << code << ":" << sentAs << "\n";
+			}
+			return out.str();
+		}
+
+		void parseState(const std::string& payload, HandoverState& state) {
+			std::istringstream in(payload);
+			std::string line;
+			while (std::getline(in, line)) {
+				size_t eq = line.find('=');
+				if (eq == std::string::npos) {
+					continue;
+				}
+				std::string key = line.substr(0, eq);
+				std::string value = line.substr(eq + 1);
+
+				if (key == "layout") state.layout = value;
+				else if (key == "layer.current") state.layerState.current = value;
+				else if (key == "layer.oneTime") state.layerState.oneTime = value;
+				else if (key == "layer.hold") state.layerState.hold = value;
+				else if (key == "layer.holdKey") state.layerState.holdKey = std::atoi(value.c_str());
+				else if (key == "toggle" && !value.empty()) state.layerState.toggles[value.substr(1)] = (value[0] == '1');
+				else if (key == "held") state.heldKeys.set(static_cast<unsigned int>(std::atoi(value.c_str())));
+				else if (key == "forwarded" && value.find(':') != std::string::npos) {
+					unsigned int code = static_cast<unsigned int>(std::atoi(value.c_str()));
+					unsigned int sentAs = static_cast<unsigned int>(std::atoi(value.c_str() + value.find(':') + 1));
+					state.forwardedAs[code] = sentAs;
+				}
+			}
+		}
+
+	} // anonymous namespace
+
+	std::string defaultHandoverSocketPath() {
+		const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+		if (runtimeDir && *runtimeDir) {
+			return std::string(runtimeDir) + "/keydrive-handover.sock";
+		}
+		return "/tmp/keydrive-" + std::to_string(getuid()) + "-handover.sock";
+	}
+
+	HandoverServer::HandoverServer(const std::string& path) : path(path) {
+		listenFd = listenUnixSocket(path, 1, "handover");
+	}
+
+	HandoverServer::~HandoverServer() {
+		if (listenFd >= 0) {
+			close(listenFd);
+		}
+		// After a handover the path belongs to the new instance
+		if (!handedOver) {
+			unlink(path.c_str());
+		}
+	}
+
+	int HandoverServer::getFd() const {
+		return listenFd;
+	}
+
+	bool HandoverServer::serveClient(const Provider& provider, const Resumer& resume) {
+		int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (client < 0) {
+			return false;
+		}
+
+		// The request is tiny; wait for it with a short timeout so a silent client can't stall us
+		timeval timeout{0, 200000};
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		char request[32] = {};
+		ssize_t received = recv(client, request, sizeof(request) - 1, 0);
+		if (received <= 0 || std::strcmp(request, REQUEST) != 0 || !peerAllowed(client)) {
+			std::cerr << "⚠ Rejected handover request" << std::endl;
+			close(client);
+			return false;
+		}
+
+		std::optional<HandoverState> state = provider();
+		if (!state) {
+			close(client);
+			return false;
+		}
+
+		std::string payload = serializeState(*state);
+		iovec iov{payload.data(), payload.size()};
+
+		int fds[2] = {state->inputFd, state->outputFd};
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+		msghdr msg{};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+		std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+		bool sent = sendmsg(client, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(payload.size());
+		int sendError = errno;
+		close(client);
+
+		if (!sent) {
+			std::cerr << "⚠ Handover failed while sending: " << std::strerror(sendError) << ", keeping the devices" << std::endl;
+			resume();
+			return false;
+		}
+
+		handedOver = true;
+		std::cout << "🤝 Devices handed over to new instance" << std::endl;
+		return true;
+	}
+
+	std::optional<HandoverState> requestHandover(const std::string& path) {
+		sockaddr_un addr = makeUnixAddress(path);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) {
+			std::cerr << "⚠ Failed to create handover socket: " << std::strerror(errno) << std::endl;
+			return std::nullopt;
+		}
+
+		if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+			std::cerr << "⚠ No running instance at " << path << ": " << std::strerror(errno) << std::endl;
+			close(fd);
+			return std::nullopt;
+		}
+
+		if (send(fd, REQUEST, std::strlen(REQUEST), MSG_NOSIGNAL) < 0) {
+			close(fd);
+			return std::nullopt;
+		}
+
+		std::string payload(MAX_PAYLOAD, '\0');
+		iovec iov{payload.data(), payload.size()};
+		int fds[2] = {-1, -1};
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+		msghdr msg{};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ssize_t received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+		close(fd);
+
+		cmsghdr* cmsg = (received > 0) ? CMSG_FIRSTHDR(&msg) : nullptr;
+		if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+			std::cerr << "⚠ Handover refused by running instance" << std::endl;
+			return std::nullopt;
+		}
+		std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+		HandoverState state;
+		state.inputFd = fds[0];
+		state.outputFd = fds[1];
+		payload.resize(static_cast<size_t>(received));
+		parseState(payload, state);
+
+		// The old instance leaves the path alone; free it for our own server
+		unlink(path.c_str());
+		return state;
+	}
+
+} // namespace keydrive
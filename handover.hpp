@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <optional>
+#include <functional>
+#include "layout_manager.hpp"
+#include "hotkey_detector.hpp"
+
+namespace keydrive {
+
+	/**
+	 * @brief Everything a new instance needs to continue where the old one stopped
+	 */
+	struct HandoverState {
+		int inputFd = -1;         // Grabbed evdev device (grab travels with the fd)
+		int outputFd = -1;        // uinput device the compositor already knows
+		std::string layout;       // Active layout name
+		LayerState layerState;    // Active layers
+		KeySet heldKeys;          // Physical keys held at the moment of handover
+		std::map<unsigned int, unsigned int> forwardedAs;  // Held keys sent under another code (translated shortcuts)
+	};
+
+	/**
+	 * @brief Get the handover socket path ($XDG_RUNTIME_DIR/keydrive-handover.sock)
+	 */
+	std::string defaultHandoverSocketPath();
+
+	/**
+	 * @brief Listening side of a zero-downtime restart, owned by the running instance
+	 */
+	class HandoverServer {
+	public:
+		/**
+		 * @brief Called once a client asked to take over; must stop input processing
+		 * and return the state to send, or nullopt to refuse
+		 */
+		using Provider = std::function<std::optional<HandoverState>()>;
+
+		/**
+		 * @brief Called when the state could not be sent; must undo what the provider stopped
+		 */
+		using Resumer = std::function<void()>;
+
+		/**
+		 * @brief Bind and listen on the handover socket
+		 *
+		 * A stale socket left by a crashed instance is replaced.
+		 *
+		 * @param path Socket path
+		 * @throws std::runtime_error if the socket cannot be created or another instance is listening
+		 */
+		explicit HandoverServer(const std::string& path);
+
+		/**
+		 * @brief Close the socket; unlinks it unless the devices were handed over
+		 */
+		~HandoverServer();
+
+		HandoverServer(const HandoverServer&) = delete;
+		HandoverServer& operator=(const HandoverServer&) = delete;
+
+		/**
+		 * @brief Get the listening fd for the reactor
+		 */
+		int getFd() const;
+
+		/**
+		 * @brief Accept one pending client and hand over if it is allowed to
+		 *
+		 * The devices stay ours until the state is sent; if sending fails,
+		 * resume is called and this instance keeps running.
+		 *
+		 * @param provider Supplies the state to send
+		 * @param resume Takes the devices back after a failed send
+		 * @return true if the devices were handed over and this instance should exit
+		 */
+		bool serveClient(const Provider& provider, const Resumer& resume);
+
+	private:
+		int listenFd = -1;
+		std::string path;
+		bool handedOver = false;
+	};
+
+	/**
+	 * @brief Take over the devices of the running instance
+	 *
+	 * On success the caller owns both file descriptors. The socket path is
+	 * unlinked so the new instance can listen on it.
+	 *
+	 * @param path Socket path of the running instance
+	 * @return std::optional<HandoverState> Received state, or nullopt on failure
+	 */
+	std::optional<HandoverState> requestHandover(const std::string& path);
+
+} // namespace keydrive
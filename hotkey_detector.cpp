@@ -0,0 +1,59 @@
+#include "hotkey_detector.hpp"
+
+namespace keydrive {
+
+	HotkeyDetector::HotkeyDetector() {
+		bind(Hotkey::Exit, {KEY_LEFTCTRL, KEY_LEFTALT, KEY_ESC});
+		bind(Hotkey::PauseRemapping, {KEY_LEFTCTRL, KEY_LEFTALT, KEY_LEFTSHIFT, KEY_P});
+		bind(Hotkey::Reload, {KEY_LEFTCTRL, KEY_LEFTALT, KEY_LEFTSHIFT, KEY_R});
+		bind(Hotkey::CycleLayout, {KEY_LEFTCTRL, KEY_LEFTALT, KEY_LEFTSHIFT, KEY_L});
+	}
+
+	void HotkeyDetector::bind(Hotkey hotkey, const KeySet& keys) {
+		for (auto& binding : bindings) {
+			if (binding.hotkey == hotkey) {
+				binding.mask = keys;
+				return;
+			}
+		}
+		bindings.push_back({keys, hotkey});
+	}
+
+	Hotkey HotkeyDetector::onKey(unsigned int code, int value) {
+		if (value == 0) {
+			heldKeys.reset(code);
+			return Hotkey::None;
+		}
+		if (value != 1) {
+			return Hotkey::None;
+		}
+
+		heldKeys.set(code);
+		for (const auto& binding : bindings) {
+			if (binding.mask.test(code) && binding.mask == heldKeys) {
+				return binding.hotkey;
+			}
+		}
+		return Hotkey::None;
+	}
+
+	const KeySet& HotkeyDetector::held() const {
+		return heldKeys;
+	}
+
+	void HotkeyDetector::setHeld(const KeySet& keys) {
+		heldKeys = keys;
+	}
+
+	const char* hotkeyName(Hotkey hotkey) {
+		switch (hotkey) {
+			case Hotkey::None: return "none";
+			case Hotkey::Exit: return "exit";
+			case Hotkey::PauseRemapping: return "pause";
+			case Hotkey::Reload: return "reload";
+			case Hotkey::CycleLayout: return "cycle-layout";
+		}
+		return "unknown";
+	}
+
+} // namespace keydrive
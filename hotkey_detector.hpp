@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <initializer_list>
+#include <linux/input-event-codes.h>
+
+namespace keydrive {
+
+	/**
+	 * @brief Daemon-level actions bound to global hotkeys
+	 */
+	enum class Hotkey {
+		None,
+		Exit,
+		PauseRemapping,
+		Reload,
+		CycleLayout
+	};
+
+	/**
+	 * @brief Set of key codes stored as a fixed bitset (one bit per EV_KEY code)
+	 */
+	class KeySet {
+	public:
+		static constexpr size_t WORDS = (KEY_CNT + 63) / 64;
+
+		KeySet() = default;
+		KeySet(std::initializer_list<unsigned int> codes) {
+			for (unsigned int code : codes) {
+				set(code);
+			}
+		}
+
+		void set(unsigned int code) {
+			if (code < KEY_CNT) words[code / 64] |= (uint64_t{1} << (code % 64));
+		}
+
+		void reset(unsigned int code) {
+			if (code < KEY_CNT) words[code / 64] &= ~(uint64_t{1} << (code % 64));
+		}
+
+		bool test(unsigned int code) const {
+			return code < KEY_CNT && (words[code / 64] >> (code % 64)) & 1;
+		}
+
+		void clear() {
+			words.fill(0);
+		}
+
+		bool empty() const {
+			for (uint64_t word : words) {
+				if (word) return false;
+			}
+			return true;
+		}
+
+		bool operator==(const KeySet& other) const {
+			return words == other.words;
+		}
+
+		bool operator!=(const KeySet& other) const {
+			return words != other.words;
+		}
+
+		/**
+		 * @brief Call fn(code) for every key in the set, in ascending order
+		 */
+		template <typename Fn>
+		void forEach(Fn fn) const {
+			for (size_t w = 0; w < WORDS; ++w) {
+				uint64_t word = words[w];
+				while (word) {
+					unsigned int bit = static_cast<unsigned int>(__builtin_ctzll(word));
+					fn(static_cast<unsigned int>(w * 64 + bit));
+					word &= word - 1;
+				}
+			}
+		}
+
+		std::array<uint64_t, WORDS> words{};
+	};
+
+	/**
+	 * @brief Tracks held keys and recognises global hotkeys
+	 *
+	 * Each hotkey is precompiled into a KeySet mask. A hotkey fires when a key
+	 * press makes the held set exactly equal to its mask, which costs a handful
+	 * of word compares per binding.
+	 */
+	class HotkeyDetector {
+	public:
+		/**
+		 * @brief Construct a detector with the default bindings
+		 *
+		 * Ctrl+Alt+Esc exits; Ctrl+Alt+Shift+P/R/L pause remapping, reload and
+		 * cycle the layout.
+		 */
+		HotkeyDetector();
+
+		/**
+		 * @brief Bind a hotkey to a key combination, replacing any previous binding
+		 */
+		void bind(Hotkey hotkey, const KeySet& keys);
+
+		/**
+		 * @brief Update the held set with a key event
+		 *
+		 * @param code Key code (EV_KEY)
+		 * @param value 1 = press, 0 = release, 2 = kernel repeat (ignored)
+		 * @return Hotkey The hotkey completed by this press, or Hotkey::None
+		 */
+		Hotkey onKey(unsigned int code, int value);
+
+		/**
+		 * @brief Get the keys currently held down
+		 */
+		const KeySet& held() const;
+
+		/**
+		 * @brief Replace the held set (e.g. with state received on handover)
+		 */
+		void setHeld(const KeySet& keys);
+
+	private:
+		struct Binding {
+			KeySet mask;
+			Hotkey hotkey;
+		};
+
+		KeySet heldKeys;
+		std::vector<Binding> bindings;
+	};
+
+	/**
+	 * @brief Get a printable name for a hotkey
+	 */
+	const char* hotkeyName(Hotkey hotkey);
+
+} // namespace keydrive
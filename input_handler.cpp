@@ -1,4 +1,5 @@
 #include "input_handler.hpp"
+#include "io_ring.hpp"
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
@@ -7,6 +8,17 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <cmath>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <climits>
+#include <cstdlib>
+#include <array>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <functional>
 #include <linux/input.h>
 #include <thread>           // ADDED: For std::thread
 #include <mutex>            // ADDED: For std::mutex
@@ -46,13 +58,35 @@ namespace keydrive {
             {KEY_RIGHTMETA, Modifier::Super}
         };
 
-        // Emergency exit key combination
-        const std::vector<unsigned int> EMERGENCY_EXIT = {
-            KEY_LEFTCTRL, KEY_LEFTALT, KEY_ESC
-        };
+        // How long the main loop gets to shut down cleanly after the exit
+        // hotkey before the input thread releases the keyboard itself
+        constexpr auto FORCE_EXIT_GRACE = std::chrono::seconds(2);
+
+        // How often to look for the keyboard again after it was unplugged
+        constexpr auto RECONNECT_INTERVAL = std::chrono::milliseconds(500);
+
+        // Input thread's io_uring: read buffers the kernel fills on its own
+        // (one read batch each), and the user_data of its SQEs; 0 marks
+        // completions nobody waits for (buffer recycling, cancellation)
+        constexpr unsigned INPUT_RING_ENTRIES = 32;
+        constexpr unsigned READ_BUFFERS = 16;
+        constexpr uint16_t READ_BUFFER_GROUP = 1;
+        constexpr uint64_t RING_READ = 1;
+        constexpr uint64_t RING_WAKE = 2;
+
+        // uinput devices (our own virtual keyboard among them) live under
+        // /sys/devices/virtual
+        bool isVirtualDevice(const char* eventName) {
+            std::string link = "/sys/class/input/" + std::string(eventName);
+            char resolved[PATH_MAX];
+            if (!realpath(link.c_str(), resolved)) {
+                return false;
+            }
+            return std::strstr(resolved, "/devices/virtual/") != nullptr;
+        }
 
         // Convert key code to name
-        std::string keyCodeToName(unsigned int code) {
+        std::string computeKeyName(unsigned int code) {
             const char* name = libevdev_event_code_get_name(EV_KEY, code);
             if (name) {
                 std::string result = name;
@@ -63,27 +97,125 @@ namespace keydrive {
             return "key_" + std::to_string(code);
         }
 
+        // Names are computed once; events only copy them
+        const std::string& keyCodeToName(unsigned int code) {
+            static const std::vector<std::string> names = [] {
+                std::vector<std::string> table(KEY_CNT);
+                for (unsigned int i = 0; i < KEY_CNT; ++i) {
+                    table[i] = computeKeyName(i);
+                }
+                return table;
+            }();
+            static const std::string unknown = "key_unknown";
+            return code < KEY_CNT ? names[code] : unknown;
+        }
+
     } // anonymous namespace
 
     // Implementation details hidden from public interface
     class InputHandlerImpl {
     public:
-        InputHandlerImpl() {
+        explicit InputHandlerImpl(bool grabNow) {
+            notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (notifyFd < 0 || wakeFd < 0) {
+                throw std::runtime_error("Failed to create input eventfds");
+            }
+
+            frame.reserve(readBuffer.size());
+            pendingEvents.reserve(readBuffer.size() * 2);
             physKb = findPhysicalKeyboard();
+            deviceFd = libevdev_get_fd(physKb);
+            const char* name = libevdev_get_name(physKb);
+            deviceName = name ? name : "Unknown";
+            if (grabNow) {
+                grab();
+            }
+        }
+
+        InputHandlerImpl(int grabbedFd, const KeySet& heldKeys) {
+            notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (notifyFd < 0 || wakeFd < 0) {
+                throw std::runtime_error("Failed to create input eventfds");
+            }
+
+            // The grab belongs to the open file description, so it came along with the fd
+            int rc = libevdev_new_from_fd(grabbedFd, &physKb);
+            if (rc < 0 || !physKb) {
+                close(grabbedFd);
+                throw std::runtime_error("Handed over fd is not an evdev device");
+            }
+            deviceFd = grabbedFd;
+            const char* name = libevdev_get_name(physKb);
+            deviceName = name ? name : "Unknown";
+
+            // Start from the keys the previous instance reported as held, which
+            // are the ones held on the virtual keyboard
+            hotkeys.setHeld(heldKeys);
+            physicalKeys = heldKeys;
+            reportedKeys = heldKeys;
+            auto now = std::chrono::system_clock::now();
+            heldKeys.forEach([this, now](unsigned int code) {
+                keyState[code] = now;
+                auto it = MODIFIER_MAP.find(code);
+                if (it != MODIFIER_MAP.end()) {
+                    modifiers[it->second] = true;
+                }
+            });
+
+            frame.reserve(readBuffer.size());
+            pendingEvents.reserve(readBuffer.size() * 2);
+
+            // That view misses debounce corrections still pending in the previous
+            // instance, and events waiting in the kernel buffer were never matched
+            // against it: bring it in line with the kernel's key state, and drop
+            // the buffered edges the snapshot already contains
+            resynchronize();
+            flushEvents();
+
+            grabbed = true;
             setupInputThread();
-            std::cout << "✅ Input handler initialized with " << deviceName << std::endl;
+            std::cout << "✅ Input handler took over " << deviceName << std::endl;
         }
 
-        ~InputHandlerImpl() {
-            stopThread = true;
-            if (inputThread.joinable()) {
-                inputThread.join();
+        InputHandlerImpl(int sourceFd, const std::string& sourceName, KeyboardInput::KeyStateQuery keyState)
+            : keyStateQuery(std::move(keyState)) {
+            notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (notifyFd < 0 || wakeFd < 0) {
+                throw std::runtime_error("Failed to create input eventfds");
             }
 
+            // Nothing to discover or grab; the source is read like a device
+            deviceFd = sourceFd;
+            fcntl(deviceFd, F_SETFL, fcntl(deviceFd, F_GETFL) | O_NONBLOCK);
+            deviceName = sourceName;
+            grabbed = true;
+
+            frame.reserve(readBuffer.size());
+            pendingEvents.reserve(readBuffer.size() * 2);
+            setupInputThread();
+            std::cout << "✅ Input handler reading from " << deviceName << std::endl;
+        }
+
+        ~InputHandlerImpl() {
+            stopInputThread();
+
             if (physKb) {
+                // After a handover the grab must survive for the new instance
+                if (grabbed && !handedOver) {
+                    libevdev_grab(physKb, LIBEVDEV_UNGRAB);
+                    std::cout << "🧹 Keyboard released: " << deviceName << std::endl;
+                }
                 libevdev_free(physKb);
                 close(deviceFd);
+            } else if (deviceFd >= 0) {
+                close(deviceFd);
             }
+
+            close(notifyFd);
+            close(wakeFd);
         }
 
         std::optional<InputEvent> getEvent(int timeout_ms) {
@@ -107,10 +239,155 @@ namespace keydrive {
             }
             //printf("success\n");
             InputEvent event = std::move(eventQueue.front());
-            eventQueue.pop();
+            eventQueue.pop_front();
             return event;
         }
 
+        std::vector<InputEvent> takeEvents() {
+            drainFd(notifyFd);
+
+            std::deque<InputEvent> pending;
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                std::swap(pending, eventQueue);
+            }
+
+            return std::vector<InputEvent>(std::make_move_iterator(pending.begin()),
+                                           std::make_move_iterator(pending.end()));
+        }
+
+        int getNotifyFd() const {
+            return notifyFd;
+        }
+
+        void grab() {
+            if (grabbed) {
+                return;
+            }
+
+            // Take exclusive control
+            int grabResult = libevdev_grab(physKb, LIBEVDEV_GRAB);
+            if (grabResult < 0) {
+                std::cerr << "⚠ Failed to grab keyboard: " << std::strerror(-grabResult)
+                << " (errno: " << -grabResult << ")" << std::endl;
+                throw std::runtime_error("Failed to grab keyboard device");
+            }
+            grabbed = true;
+            std::cout << "✅ Successfully grabbed keyboard: " << deviceName << std::endl;
+
+            // Anything typed before the grab already reached the compositor
+            while (read(deviceFd, readBuffer.data(), sizeof(readBuffer)) > 0) {
+            }
+
+            setupInputThread();
+            std::cout << "✅ Input handler initialized with " << deviceName << std::endl;
+        }
+
+        KeySet getHeldKeys() const {
+            return hotkeys.held();
+        }
+
+        int detachForHandover() {
+            stopInputThread();
+            handedOver = true;
+            return deviceFd;
+        }
+
+        void resumeAfterHandover() {
+            handedOver = false;
+            stopThread = false;
+            setupInputThread();
+        }
+
+        std::string getDeviceName() const {
+            std::lock_guard<std::mutex> lock(deviceMutex);
+            return deviceName;
+        }
+
+        const libevdev* getDevice() const {
+            return physKb;
+        }
+
+        bool isConnected() const {
+            std::lock_guard<std::mutex> lock(deviceMutex);
+            return deviceFd >= 0;
+        }
+
+        void setDebounce(std::chrono::milliseconds window) {
+            debounceNs = std::chrono::duration_cast<std::chrono::nanoseconds>(window).count();
+        }
+
+        void setRepeatKeys(const std::vector<std::string>& keyNames) {
+            KeySet keys;
+            for (const auto& name : keyNames) {
+                std::string upper = name;
+                std::transform(upper.begin(), upper.end(), upper.begin(),
+                               [](unsigned char c) { return std::toupper(c); });
+                int code = libevdev_event_code_from_name(EV_KEY, upper.c_str());
+                if (code >= 0) {
+                    keys.set(static_cast<unsigned int>(code));
+                }
+            }
+            std::lock_guard<std::mutex> lock(repeatKeysMutex);
+            repeatKeys = keys;
+            repeatKeysSet = true;
+        }
+
+        void setRepeatBacklogLimit(int limit) {
+            repeatBacklogLimit = std::max(1, limit);
+        }
+
+        uint64_t getSuppressedBounces() const {
+            return suppressedBounces.load(std::memory_order_relaxed);
+        }
+
+        const InputMetrics& getMetrics() const {
+            return metrics;
+        }
+
+        void setLeds(unsigned int managed, unsigned int active) {
+            std::lock_guard<std::mutex> lock(deviceMutex);
+            if (deviceFd < 0) {
+                // Unplugged: keep the state, it is written once the keyboard is back
+                ledsKnown |= managed;
+                ledState = (ledState & ~managed) | (active & managed);
+                return;
+            }
+
+            // Only LEDs whose cached state differs are written, all in one write()
+            std::array<input_event, LED_CNT + 1> events{};
+            size_t count = 0;
+            for (unsigned int led = 0; led <= LED_MAX; ++led) {
+                unsigned int bit = 1u << led;
+                if (!(managed & bit)) {
+                    continue;
+                }
+                bool on = (active & bit) != 0;
+                if ((ledsKnown & bit) && ((ledState & bit) != 0) == on) {
+                    continue;
+                }
+                events[count].type = EV_LED;
+                events[count].code = static_cast<unsigned short>(led);
+                events[count].value = on ? 1 : 0;
+                ++count;
+            }
+            if (count == 0) {
+                return;
+            }
+            events[count].type = EV_SYN;
+            events[count].code = SYN_REPORT;
+            ++count;
+
+            // The device is still open (and grabbed) for us, so this needs no extra IPC
+            ssize_t bytes = static_cast<ssize_t>(count * sizeof(input_event));
+            if (write(deviceFd, events.data(), count * sizeof(input_event)) != bytes) {
+                std::cerr << "⚠ Failed to set keyboard LEDs: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            ledsKnown |= managed;
+            ledState = (ledState & ~managed) | (active & managed);
+        }
+
         bool isModifierActive(Modifier modifier) const {
             return modifiers.at(modifier);
         }
@@ -149,41 +426,548 @@ namespace keydrive {
             });
         }
 
+        void stopInputThread() {
+            stopThread = true;
+            signalFd(wakeFd);
+            cv.notify_all();
+            if (inputThread.joinable()) {
+                inputThread.join();
+            }
+        }
+
         void inputLoop() {
             //printf("inputLoop\n");
+            if (std::unique_ptr<IoRing> ring = createRing()) {
+                ringLoop(*ring);
+            } else {
+                pollLoop();
+            }
+        }
+
+        void pollLoop() {
+            pollfd fds[2] = {
+                {deviceFd, POLLIN, 0},
+                {wakeFd, POLLIN, 0}
+            };
+
+            // Sleep until the device has data, a repeat is due, or we are woken for shutdown
             while (!stopThread) {
-                processAvailableEvents();
+                // While the keyboard is unplugged the fd is -1, which poll() skips
+                fds[0].fd = deviceFd;
+                int rc = poll(fds, 2, nextTimeoutMs());
+                if (rc < 0 && errno != EINTR) {
+                    std::cerr << "⚠ Input poll failed: " << std::strerror(errno) << std::endl;
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                    continue;
+                }
+
+                if (fds[1].revents & POLLIN) {
+                    drainFd(wakeFd);
+                }
+                if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+                    processAvailableEvents();
+                }
+                if (reconnectAt && std::chrono::steady_clock::now() >= *reconnectAt) {
+                    reconnect();
+                }
+                settleDebounce();
                 checkKeyRepeat();
-                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                flushEvents();
+                checkForceExit();
+            }
+        }
+
+        // The device is read by a multishot read the kernel keeps armed: each
+        // batch of events lands in a provided buffer and is reaped together
+        // with the wait, so a keystroke costs one io_uring_enter() here
+        // instead of a poll() and a read()
+        void ringLoop(IoRing& ring) {
+            armWake(ring);
+            while (!stopThread) {
+                if (!readArmed && deviceFd >= 0 && deviceFd != endedFd) {
+                    armRead(ring);
+                }
+                int rc = ring.submitAndWait(1, nextTimeoutMs());
+                if (rc < 0 && rc != -ETIME && rc != -EINTR) {
+                    std::cerr << "⚠ Input wait failed: " << std::strerror(-rc) << std::endl;
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                    continue;
+                }
+
+                ring.forEachCompletion([&](const io_uring_cqe& cqe) {
+                    handleCompletion(ring, cqe);
+                });
+                if (reconnectAt && std::chrono::steady_clock::now() >= *reconnectAt) {
+                    reconnect();
+                }
+                settleDebounce();
+                checkKeyRepeat();
+                flushEvents();
+                checkForceExit();
+            }
+
+            // Whatever the read took from the device is gone with the ring (and
+            // with it for a new instance on handover): cancel the read and take
+            // in what it still completes with
+            if (readArmed) {
+                if (io_uring_sqe* sqe = ring.getSqe()) {
+                    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                    sqe->addr = RING_READ;
+                }
+                for (int attempt = 0; readArmed && attempt < 10; ++attempt) {
+                    ring.submitAndWait(1, 100);
+                    ring.forEachCompletion([&](const io_uring_cqe& cqe) {
+                        handleCompletion(ring, cqe);
+                    });
+                }
+                flushEvents();
+                readArmed = false;
+            }
+        }
+
+        // The input thread's ring, or nullptr to poll() the device instead
+        std::unique_ptr<IoRing> createRing() {
+            if (!ioRingAllowed()) {
+                return nullptr;
+            }
+            try {
+                auto ring = std::make_unique<IoRing>(INPUT_RING_ENTRIES);
+                if (!ring->supports(IoRing::OP_READ_MULTISHOT) || !ring->supports(IORING_OP_PROVIDE_BUFFERS)) {
+                    throw std::runtime_error("no multishot reads before Linux 6.7");
+                }
+                ring->provideBuffers(READ_BUFFER_GROUP, READ_BUFFERS, sizeof(readBuffer));
+                return ring;
+            } catch (const std::runtime_error& e) {
+                if (!ringFailed) {
+                    std::cerr << "⚠ io_uring unavailable for input (" << e.what() << "), polling the keyboard" << std::endl;
+                    ringFailed = true;
+                }
+                return nullptr;
+            }
+        }
+
+        void armRead(IoRing& ring) {
+            io_uring_sqe* sqe = ring.getSqe();
+            if (!sqe) {
+                return;  // Tried again on the next pass
+            }
+            sqe->opcode = IoRing::OP_READ_MULTISHOT;
+            sqe->fd = deviceFd;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = READ_BUFFER_GROUP;
+            sqe->user_data = RING_READ;
+            readArmed = true;
+        }
+
+        void armWake(IoRing& ring) {
+            io_uring_sqe* sqe = ring.getSqe();
+            if (!sqe) {
+                return;
+            }
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = wakeFd;
+            sqe->poll32_events = POLLIN;
+            sqe->user_data = RING_WAKE;
+        }
+
+        void handleCompletion(IoRing& ring, const io_uring_cqe& cqe) {
+            if (cqe.user_data == RING_WAKE) {
+                drainFd(wakeFd);
+                if (!stopThread) {
+                    armWake(ring);
+                }
+                return;
+            }
+            if (cqe.user_data != RING_READ) {
+                return;
+            }
+
+            // Without F_MORE the read has ended and is armed again on the next pass
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                readArmed = false;
+            }
+
+            if (cqe.res > 0) {
+                uint16_t id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                const auto* events = static_cast<const input_event*>(ring.buffer(id));
+                size_t count = static_cast<size_t>(cqe.res) / sizeof(input_event);
+                metrics.eventsRead.add(count);
+                for (size_t i = 0; i < count; ++i) {
+                    handleRawEvent(events[i]);
+                }
+                ring.recycleBuffer(id);
+
+                // Everything produced by this read goes to the main loop in one batch
+                flushEvents();
+
+                if (count < readBuffer.size()) {
+                    endStaleFilter();  // Drained
+                }
+                return;
+            }
+
+            switch (-cqe.res) {
+                case 0:
+                    // End of a pipe or socket source: nothing more to read from it
+                    endedFd = deviceFd;
+                    endStaleFilter();
+                    break;
+                case ENODEV:
+                    if (physKb) {
+                        deviceLost();
+                    }
+                    break;
+                case ENOBUFS:
+                    // All buffers were in use; the recycled ones go out with the new read
+                case ECANCELED:
+                    break;
+                default:
+                    std::cerr << "⚠ Input error: " << std::strerror(-cqe.res) << std::endl;
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                    break;
+            }
+        }
+
+        // Poll timeout: the earliest of the next key repeat, debounce settle,
+        // reconnect and force-exit deadlines
+        int nextTimeoutMs() const {
+            int timeout = repeatTimeoutMs();
+            auto untilDeadline = [&timeout](std::chrono::steady_clock::time_point deadline) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now() + std::chrono::microseconds(999)).count();
+                int deadlineTimeout = static_cast<int>(std::max<long long>(0, remaining));
+                timeout = (timeout < 0) ? deadlineTimeout : std::min(timeout, deadlineTimeout);
+            };
+            if (!settleQueue.empty()) {
+                untilDeadline(settleQueue.top().first);
+            }
+            if (reconnectAt) {
+                untilDeadline(*reconnectAt);
+            }
+            if (forceExitAt) {
+                untilDeadline(*forceExitAt);
+            }
+            return timeout;
+        }
+
+        // Milliseconds until the next key repeat is due, or -1 if none is pending
+        int repeatTimeoutMs() const {
+            if (keyRepeat.activeKeyCode == -1) {
+                return -1;
+            }
+
+            double delay = (keyRepeat.count == 0) ? keyRepeat.initialDelay : keyRepeat.repeatDelay;
+            double elapsed = std::chrono::duration<double>(
+                std::chrono::system_clock::now() - keyRepeat.lastTime).count();
+            double remaining = std::max(0.0, delay - elapsed);
+            return static_cast<int>(std::ceil(remaining * 1000.0));
+        }
+
+        static void signalFd(int fd) {
+            uint64_t one = 1;
+            if (write(fd, &one, sizeof(one)) < 0) {
+                // Counter saturated; the reader is already woken
             }
         }
 
+        static void drainFd(int fd) {
+            uint64_t count;
+            while (read(fd, &count, sizeof(count)) == sizeof(count)) {
+            }
+        }
+
+        // Read whole batches of input_event straight from the fd. libevdev is only
+        // used for device discovery; resync after SYN_DROPPED uses EVIOCGKEY.
         void processAvailableEvents() {
             //printf("processAvailableEvents\n");
-            input_event ev;
-            int rc;
+            while (true) {
+                ssize_t bytes = read(deviceFd, readBuffer.data(), sizeof(readBuffer));
+                if (bytes < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == ENODEV && physKb) {
+                        deviceLost();
+                        break;
+                    }
+                    // Handle errors (except EAGAIN which is normal for non-blocking mode)
+                    if (errno != EAGAIN) {
+                        std::cerr << "⚠ Input error: " << std::strerror(errno) << std::endl;
+                        std::this_thread::sleep_for(std::chrono::seconds(1));
+                    } else {
+                        endStaleFilter();
+                    }
+                    break;
+                }
+
+                size_t count = static_cast<size_t>(bytes) / sizeof(input_event);
+                metrics.eventsRead.add(count);
+                for (size_t i = 0; i < count; ++i) {
+                    handleRawEvent(readBuffer[i]);
+                }
 
-            // CORRECT: Use NONBLOCK flag for non-blocking reads
-            rc = libevdev_next_event(physKb, LIBEVDEV_READ_FLAG_NORMAL, &ev);
-            //if (ev.type != 0) std::cout << ev.type <<"\n";
-            while ((rc = libevdev_next_event(physKb, LIBEVDEV_READ_FLAG_NORMAL, &ev)) == 0) {
-                //std::cout << ev.type <<"\n";
-                if (ev.type == EV_KEY) {
-                    processInputEvent(ev);
+                // Everything produced by this read goes to the main loop in one batch
+                flushEvents();
+
+                if (count < readBuffer.size()) {
+                    endStaleFilter();
+                    break;  // Drained
                 }
-                // Optional: Handle other event types
-                else {
-                    //std::cout << "DEBUG: Non-key event - type: " << ev.type
-                    //<< ", code: " << ev.code
-                    //<< ", value: " << ev.value << std::endl;
+            }
+        }
+
+        void handleRawEvent(const input_event& ev) {
+            if (ev.type == EV_SYN) {
+                if (ev.code == SYN_DROPPED) {
+                    // The kernel buffer overflowed; everything up to the next
+                    // SYN_REPORT is incomplete
+                    std::cerr << "⚠ SYN_DROPPED: events lost, resynchronizing key state" << std::endl;
+                    dropping = true;
+                    metrics.synDropped.add();
+                    frame.clear();
+                } else if (ev.code == SYN_REPORT) {
+                    if (dropping) {
+                        dropping = false;
+                        resynchronize();
+                    } else {
+                        // A frame is only valid once complete
+                        for (const auto& keyEvent : frame) {
+                            if (filterStale && isStale(keyEvent)) {
+                                ++staleDropped;
+                                continue;
+                            }
+                            if (debounce(keyEvent)) {
+                                processInputEvent(keyEvent);
+                            }
+                        }
+                    }
+                    frame.clear();
                 }
+                return;
+            }
+
+            if (!dropping && ev.type == EV_KEY) {
+                frame.push_back(ev);
+            }
+        }
+
+        // Events read after a resync were queued before the EVIOCGKEY snapshot,
+        // which already contains them. Like libevdev's sync mode, drop the edges
+        // that don't change the key state instead of replaying them twice.
+        bool isStale(const input_event& ev) const {
+            return ev.code < KEY_CNT && ev.value != 2 && (ev.value != 0) == physicalKeys.test(ev.code);
+        }
+
+        // Drained: whatever was queued before the resync snapshot has been seen
+        void endStaleFilter() {
+            if (!filterStale) {
+                return;
+            }
+            filterStale = false;
+            if (staleDropped > 0) {
+                std::cerr << "  ↻ dropped " << staleDropped << " key events already in the resync snapshot" << std::endl;
             }
-            //std::cout << "Error:" <<rc << "\n";
-            // Handle errors (except EAGAIN which is normal for non-blocking mode)
-            if (rc < 0 && rc != -EAGAIN) {
-                std::cerr << "⚠ Input error: " << std::strerror(-rc) << std::endl;
-                std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+
+        // The keyboard was unplugged. Nothing will release what was held on it,
+        // so release it here; the virtual keyboard stays, and the keyboard is
+        // grabbed again once it shows up.
+        void deviceLost() {
+            std::cerr << "⚠ Keyboard unplugged: " << deviceName << ", waiting for it to come back" << std::endl;
+
+            frame.clear();
+            dropping = false;
+            filterStale = false;
+            settleQueue = {};
+            settlePending = KeySet();
+            KeySet held = hotkeys.held();
+            resyncing = true;
+            held.forEach([&](unsigned int code) {
+                replayKey(code, 0);
+            });
+            resyncing = false;
+            physicalKeys = KeySet();
+            reportedKeys = KeySet();
+            flushEvents();
+
+            {
+                std::lock_guard<std::mutex> lock(deviceMutex);
+                libevdev_free(physKb);
+                close(deviceFd);
+                physKb = nullptr;
+                deviceFd = -1;
+            }
+            reconnectAt = std::chrono::steady_clock::now() + RECONNECT_INTERVAL;
+        }
+
+        void reconnect() {
+            reconnectAt = std::chrono::steady_clock::now() + RECONNECT_INTERVAL;
+
+            libevdev* dev = nullptr;
+            try {
+                dev = findPhysicalKeyboard(true);
+            } catch (const std::runtime_error&) {
+                return;  // Not back yet
+            }
+
+            int grabResult = libevdev_grab(dev, LIBEVDEV_GRAB);
+            if (grabResult < 0) {
+                std::cerr << "⚠ Failed to grab keyboard: " << std::strerror(-grabResult) << std::endl;
+                close(libevdev_get_fd(dev));
+                libevdev_free(dev);
+                return;
+            }
+            while (read(libevdev_get_fd(dev), readBuffer.data(), sizeof(readBuffer)) > 0) {
+            }
+
+            unsigned int leds;
+            unsigned int ledsOn;
+            {
+                std::lock_guard<std::mutex> lock(deviceMutex);
+                physKb = dev;
+                deviceFd = libevdev_get_fd(dev);
+                const char* name = libevdev_get_name(dev);
+                deviceName = name ? name : "Unknown";
+                // The new device's LEDs are in an unknown state
+                leds = ledsKnown;
+                ledsOn = ledState;
+                ledsKnown = 0;
+            }
+            reconnectAt.reset();
+            std::cout << "✅ Keyboard reconnected: " << deviceName << std::endl;
+
+            setLeds(leds, ledsOn);
+            // Keys already held while it was plugged in
+            resynchronize();
+            flushEvents();
+        }
+
+        // Eager debounce: the first edge of a key passes immediately, further edges
+        // within the window are bounces. If the key ends up in a different state
+        // than reported, settleDebounce() emits the correction when the window closes.
+        bool debounce(const input_event& ev) {
+            unsigned int code = ev.code;
+            if (code >= KEY_CNT) {
+                return true;
+            }
+            if (ev.value == 2) {
+                // Kernel autorepeat only for keys we reported as down
+                return reportedKeys.test(code);
+            }
+
+            bool pressed = ev.value != 0;
+            if (pressed) {
+                physicalKeys.set(code);
+            } else {
+                physicalKeys.reset(code);
+            }
+
+            auto window = std::chrono::nanoseconds(debounceNs.load(std::memory_order_relaxed));
+            auto now = std::chrono::steady_clock::now();
+            if (window.count() > 0 && now - lastEdge[code] < window) {
+                suppressedBounces.fetch_add(1, std::memory_order_relaxed);
+                if (!settlePending.test(code)) {
+                    // Deadlines follow each key's last edge (and the window may
+                    // change on reload), so the queue is ordered by deadline
+                    settleQueue.emplace(lastEdge[code] + window, code);
+                    settlePending.set(code);
+                }
+                return false;
+            }
+
+            lastEdge[code] = now;
+            if (pressed) {
+                reportedKeys.set(code);
+            } else {
+                reportedKeys.reset(code);
+            }
+            return true;
+        }
+
+        void settleDebounce() {
+            auto now = std::chrono::steady_clock::now();
+            while (!settleQueue.empty() && settleQueue.top().first <= now) {
+                unsigned int code = settleQueue.top().second;
+                settleQueue.pop();
+                settlePending.reset(code);
+
+                bool pressed = physicalKeys.test(code);
+                if (pressed == reportedKeys.test(code)) {
+                    continue;  // Bounced back to the reported state
+                }
+                lastEdge[code] = now;
+                if (pressed) {
+                    reportedKeys.set(code);
+                } else {
+                    reportedKeys.reset(code);
+                }
+
+                input_event ev{};
+                ev.type = EV_KEY;
+                ev.code = static_cast<unsigned short>(code);
+                ev.value = pressed ? 1 : 0;
+                processInputEvent(ev);
+            }
+        }
+
+        // Compare the kernel's key state with ours and replay the difference, so
+        // held keys, modifiers and layers catch up and the system gets the
+        // corrective presses/releases
+        void resynchronize() {
+            KeySet actual;
+            if (keyStateQuery) {
+                actual = keyStateQuery();
+            } else {
+                uint8_t bits[(KEY_CNT + 7) / 8] = {};
+                if (ioctl(deviceFd, EVIOCGKEY(sizeof(bits)), bits) < 0) {
+                    std::cerr << "⚠ Failed to read key state: " << std::strerror(errno) << std::endl;
+                    return;
+                }
+                for (unsigned int code = 0; code < KEY_CNT; ++code) {
+                    if ((bits[code / 8] >> (code % 8)) & 1) {
+                        actual.set(code);
+                    }
+                }
+            }
+
+            KeySet held = hotkeys.held();
+            resyncing = true;
+            // Releases first, so stale modifiers are gone before new presses arrive
+            held.forEach([&](unsigned int code) {
+                if (!actual.test(code)) {
+                    replayKey(code, 0);
+                }
+            });
+            actual.forEach([&](unsigned int code) {
+                if (!held.test(code)) {
+                    replayKey(code, 1);
+                }
+            });
+            resyncing = false;
+
+            // The replay brought every key in line with the snapshot, including
+            // those still inside a debounce window
+            physicalKeys = actual;
+            reportedKeys = actual;
+            filterStale = true;
+            staleDropped = 0;
+        }
+
+        void replayKey(unsigned int code, int value) {
+            std::cerr << "  ↻ resync " << keyCodeToName(code)
+                << (value ? " pressed" : " released") << std::endl;
+            if (value) {
+                physicalKeys.set(code);
+                reportedKeys.set(code);
+            } else {
+                physicalKeys.reset(code);
+                reportedKeys.reset(code);
             }
+            input_event ev{};
+            ev.type = EV_KEY;
+            ev.code = static_cast<unsigned short>(code);
+            ev.value = value;
+            processInputEvent(ev);
         }
 
         void processInputEvent(const input_event& ev) {
@@ -202,12 +986,27 @@ namespace keydrive {
                 }
             }
 
-            // Check for emergency exit sequence
-            checkEmergencyExit(ev);
+            // Should not happen; after a SYN_DROPPED it means the resync double-counted
+            if (ev.value != 2 && (ev.value != 0) == hotkeys.held().test(ev.code)) {
+                metrics.redundantEdges.add();
+            }
+
+            // Global hotkeys work on the held-key bitset; the completing press is consumed
+            // Replayed presses after SYN_DROPPED never trigger hotkeys
+            Hotkey hotkey = hotkeys.onKey(ev.code, ev.value);
+            if (hotkey != Hotkey::None && !resyncing) {
+                handleHotkey(hotkey, ev.code);
+                return;
+            }
 
             // Track modifier state
             auto it = MODIFIER_MAP.find(ev.code);
             if (it != MODIFIER_MAP.end()) {
+                // A held modifier stays held on the virtual keyboard, whose own
+                // autorepeat repeats it; the keyboard's repeats change nothing
+                if (ev.value == 2) {
+                    return;
+                }
                 modifiers[it->second] = (ev.value > 0);
 
                 // Forward modifier event for internal tracking
@@ -235,8 +1034,9 @@ namespace keydrive {
             std::string keyName = keyCodeToName(ev.code);
 
             if (ev.value == 1) {  // Key down
-                // Start key repeat tracking
-                keyRepeat.activeKeyCode = ev.code;
+                // Our repeat engine only drives remapped keys; forwarded keys
+                // are repeated by the compositor. The newest key always wins.
+                keyRepeat.activeKeyCode = repeatsRemapped(ev.code) ? static_cast<int>(ev.code) : -1;
                 keyRepeat.count = 0;
                 keyRepeat.lastTime = std::chrono::system_clock::now();
 
@@ -264,11 +1064,22 @@ namespace keydrive {
                     std::chrono::system_clock::now()
                 });
             }
+            // Kernel autorepeats (value 2) are never queued: remapped keys are
+            // repeated by our engine, forwarded keys by the virtual keyboard
 
             // Safety check: Report stuck keys
             checkStuckKeys();
         }
 
+        bool repeatsRemapped(unsigned int code) {
+            // Shortcuts (Ctrl/Alt/Super held) are forwarded, so they aren't ours to repeat
+            if (modifiers[Modifier::Ctrl] || modifiers[Modifier::Alt] || modifiers[Modifier::Super]) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(repeatKeysMutex);
+            return !repeatKeysSet || repeatKeys.test(code);
+        }
+
         void checkKeyRepeat() {
             if (keyRepeat.activeKeyCode == -1) {
                 return;
@@ -315,35 +1126,34 @@ namespace keydrive {
                 }
         }
 
-        void checkEmergencyExit(const input_event& ev) {
-            auto currentTime = std::chrono::steady_clock::now();
+        void handleHotkey(Hotkey hotkey, unsigned int code) {
+            std::cout << "⌨ HOTKEY: " << hotkeyName(hotkey) << std::endl;
 
-            // Reset sequence if timeout exceeded
-            auto elapsed = std::chrono::duration<double>(currentTime - exitTimeout).count();
-            if (elapsed > 1.0) {
-                exitSequence.clear();
+            if (hotkey == Hotkey::Exit) {
+                std::cerr << "\n🚨 EMERGENCY EXIT TRIGGERED: Ctrl+Alt+Esc" << std::endl;
+                std::cerr << "Shutting down safely..." << std::endl;
+                forceExitAt = std::chrono::steady_clock::now() + FORCE_EXIT_GRACE;
             }
 
-            // Only process key down events
-            if (ev.value != 1) {
-                return;
-            }
-
-            // Add to sequence if it's part of emergency exit
-            if (std::find(EMERGENCY_EXIT.begin(), EMERGENCY_EXIT.end(), ev.code) != EMERGENCY_EXIT.end()) {
-                // Don't add duplicates
-                if (exitSequence.empty() || exitSequence.back() != ev.code) {
-                    exitSequence.push_back(ev.code);
-                }
-
-                exitTimeout = currentTime;
+            InputEvent event{
+                EventType::Hotkey,
+                keyCodeToName(code),
+                static_cast<int>(code),
+                true,
+                std::chrono::system_clock::now()
+            };
+            event.hotkey = hotkey;
+            enqueueEvent(event);
+        }
 
-                // Check if full sequence was pressed
-                if (exitSequence == EMERGENCY_EXIT) {
-                    std::cerr << "\n🚨 EMERGENCY EXIT TRIGGERED: Ctrl+Alt+Esc" << std::endl;
-                    std::cerr << "Shutting down safely..." << std::endl;
-                    _exit(0);  // Force immediate exit
+        // Last resort if the main loop did not act on the exit hotkey in time
+        void checkForceExit() {
+            if (forceExitAt && std::chrono::steady_clock::now() >= *forceExitAt) {
+                std::cerr << "🚨 Main loop unresponsive, releasing keyboard and exiting" << std::endl;
+                if (physKb) {
+                    libevdev_grab(physKb, LIBEVDEV_UNGRAB);
                 }
+                _exit(1);
             }
         }
 
@@ -364,10 +1174,61 @@ namespace keydrive {
             }
         }
 
+        // Events are collected per read batch and handed over by flushEvents()
         void enqueueEvent(const InputEvent& event) {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            eventQueue.push(event);
-            cv.notify_one();
+            pendingEvents.push_back(event);
+        }
+
+        // Repeats only come from our engine; kernel repeats are never queued
+        static bool isEngineRepeat(const InputEvent& event) {
+            return event.type == EventType::Repeat;
+        }
+
+        void flushEvents() {
+            if (pendingEvents.empty()) {
+                return;
+            }
+            bool queued = false;
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                for (auto& event : pendingEvents) {
+                    queued = queueEvent(std::move(event)) || queued;
+                }
+            }
+            pendingEvents.clear();
+            if (queued) {
+                cv.notify_one();
+                signalFd(notifyFd);
+            }
+        }
+
+        // Backpressure: events still queued have not been taken by the main loop
+        // yet, so a repeat arriving behind a queued repeat of the same key folds
+        // into it (up to the backlog limit, then it is dropped). A release cancels
+        // the key's repeats that are still queued. Returns false if nothing new
+        // was queued.
+        bool queueEvent(InputEvent&& event) {
+            if (isEngineRepeat(event) && !eventQueue.empty()) {
+                InputEvent& last = eventQueue.back();
+                if (isEngineRepeat(last) && last.keyCode == event.keyCode) {
+                    if (last.repeatCount < repeatBacklogLimit.load(std::memory_order_relaxed)) {
+                        ++last.repeatCount;
+                    }
+                    return false;
+                }
+            }
+
+            if (event.type == EventType::Release) {
+                int code = event.keyCode;
+                eventQueue.erase(std::remove_if(eventQueue.begin(), eventQueue.end(),
+                    [code](const InputEvent& queued) {
+                        return isEngineRepeat(queued) && queued.keyCode == code;
+                    }), eventQueue.end());
+            }
+
+            eventQueue.push_back(std::move(event));
+            metrics.queueDepth.observe(eventQueue.size());
+            return true;
         }
 
         struct KeyboardCandidate {
@@ -378,7 +1239,9 @@ namespace keydrive {
             libevdev* dev;
         };
 
-        libevdev* findPhysicalKeyboard() {
+        // skipVirtual leaves out uinput devices: after an unplug our own virtual
+        // keyboard, which copies the keyboard's capabilities, would qualify
+        libevdev* findPhysicalKeyboard(bool skipVirtual = false) {
             std::vector<KeyboardCandidate> candidates;
 
             DIR* dir = opendir("/dev/input");
@@ -391,6 +1254,9 @@ namespace keydrive {
                 if (strncmp(ent->d_name, "event", 5) != 0) {
                     continue;
                 }
+                if (skipVirtual && isVirtualDevice(ent->d_name)) {
+                    continue;
+                }
 
                 std::string path = "/dev/input/" + std::string(ent->d_name);
                 int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
@@ -488,34 +1354,71 @@ namespace keydrive {
                 << " | Name: " << candidate.name << std::endl;
             }
 
-            // Select the best candidate
-            auto& best = candidates.front();
-            deviceName = best.name;
-            deviceFd = best.fd;
-            libevdev* dev = best.dev;
-
-            // Take exclusive control
-            int grabResult = libevdev_grab(dev, LIBEVDEV_GRAB);
-            if (grabResult < 0) {
-                std::cerr << "⚠ Failed to grab keyboard: " << std::strerror(-grabResult)
-                << " (errno: " << -grabResult << ")" << std::endl;
-                libevdev_free(dev);
-                close(deviceFd);
-                throw std::runtime_error("Failed to grab keyboard device");
+            // Select the best candidate; it is grabbed separately
+            for (size_t i = 1; i < candidates.size(); ++i) {
+                libevdev_free(candidates[i].dev);
+                close(candidates[i].fd);
             }
-            std::cout << "✅ Successfully grabbed keyboard: " << deviceName << std::endl;
-
-            return dev;
+            return candidates.front().dev;
         }
 
-        // Member variables
+        // Member variables. The input thread swaps the device after an unplug;
+        // deviceMutex covers the swap for readers on other threads.
         libevdev* physKb = nullptr;
         int deviceFd = -1;
         std::string deviceName;
+        mutable std::mutex deviceMutex;
+        std::optional<std::chrono::steady_clock::time_point> reconnectAt;  // Set while unplugged
 
         std::thread inputThread;
         std::atomic<bool> stopThread{false};
 
+        // eventfds: notifyFd tells the reactor events are queued,
+        // wakeFd interrupts the input thread's wait for shutdown
+        int notifyFd = -1;
+        int wakeFd = -1;
+
+        // Set once the device is grabbed (and read), and once it was passed to a new instance
+        bool grabbed = false;
+        bool handedOver = false;
+
+        // LED bits (1 << LED_*) last written to the device, valid where ledsKnown is set
+        unsigned int ledState = 0;
+        unsigned int ledsKnown = 0;
+
+        // Raw read path: preallocated read buffer and the current SYN frame
+        std::array<input_event, 64> readBuffer{};
+        // io_uring read path: whether the multishot read is armed, the source
+        // that reached its end, and whether the fallback was already reported
+        bool readArmed = false;
+        int endedFd = -1;
+        bool ringFailed = false;
+        std::vector<input_event> frame;
+        std::vector<InputEvent> pendingEvents;
+
+        // SYN_DROPPED handling: skip to the next SYN_REPORT, then replay the key delta
+        bool dropping = false;
+        bool resyncing = false;
+        KeyboardInput::KeyStateQuery keyStateQuery;  // Instead of EVIOCGKEY for non-device sources
+        // Until the device is drained after a resync, drop edges the snapshot already has
+        bool filterStale = false;
+        uint64_t staleDropped = 0;
+
+        // Debounce: window (0 = off), last accepted edge per key, physical vs.
+        // reported key state and the keys waiting for their window to close,
+        // earliest deadline on top
+        std::atomic<int64_t> debounceNs{0};
+        std::array<std::chrono::steady_clock::time_point, KEY_CNT> lastEdge{};
+        KeySet physicalKeys;
+        KeySet reportedKeys;
+        KeySet settlePending;
+        using SettleEntry = std::pair<std::chrono::steady_clock::time_point, unsigned int>;
+        std::priority_queue<SettleEntry, std::vector<SettleEntry>, std::greater<SettleEntry>> settleQueue;
+        std::atomic<uint64_t> suppressedBounces{0};
+
+        // Written by the input thread only; kept off the cache lines the main thread writes
+        alignas(64) InputMetrics metrics;
+
         // Key state tracking
         std::unordered_map<Modifier, bool> modifiers = {
             {Modifier::Shift, false},
@@ -527,22 +1430,36 @@ namespace keydrive {
         // Key repeat state
         KeyRepeatState keyRepeat;
 
+        // Most repeats one queued Repeat event may stand for while the main loop lags
+        std::atomic<int> repeatBacklogLimit{3};
+
+        // Keys our repeat engine handles (all until the layout says otherwise)
+        KeySet repeatKeys;
+        bool repeatKeysSet = false;
+        std::mutex repeatKeysMutex;
+
         // Safety mechanism: Track key state to detect stuck keys
         std::unordered_map<unsigned int, std::chrono::system_clock::time_point> keyState;
 
-        // Safety mechanism: Emergency exit key combination
-        std::vector<unsigned int> exitSequence;
-        std::chrono::steady_clock::time_point exitTimeout;
+        // Safety mechanism: Global hotkeys (emergency exit, pause, reload, cycle layout)
+        HotkeyDetector hotkeys;
+        std::optional<std::chrono::steady_clock::time_point> forceExitAt;
 
         // Event queue
-        std::queue<InputEvent> eventQueue;
+        std::deque<InputEvent> eventQueue;
         std::mutex queueMutex;
         std::condition_variable cv;
     };
 
     // Public class implementation
-    KeyboardInput::KeyboardInput()
-    : pImpl(std::make_unique<InputHandlerImpl>()) {}
+    KeyboardInput::KeyboardInput(bool grabNow)
+    : pImpl(std::make_unique<InputHandlerImpl>(grabNow)) {}
+
+    KeyboardInput::KeyboardInput(int grabbedFd, const KeySet& heldKeys)
+    : pImpl(std::make_unique<InputHandlerImpl>(grabbedFd, heldKeys)) {}
+
+    KeyboardInput::KeyboardInput(int sourceFd, const std::string& sourceName, KeyStateQuery keyState)
+    : pImpl(std::make_unique<InputHandlerImpl>(sourceFd, sourceName, std::move(keyState))) {}
 
     KeyboardInput::~KeyboardInput() = default;
 
@@ -550,6 +1467,18 @@ namespace keydrive {
         return pImpl->getEvent(timeout_ms);
     }
 
+    std::vector<InputEvent> KeyboardInput::takeEvents() {
+        return pImpl->takeEvents();
+    }
+
+    void KeyboardInput::grab() {
+        pImpl->grab();
+    }
+
+    int KeyboardInput::getNotifyFd() const {
+        return pImpl->getNotifyFd();
+    }
+
     bool KeyboardInput::isModifierActive(Modifier modifier) const {
         return pImpl->isModifierActive(modifier);
     }
@@ -562,4 +1491,52 @@ namespace keydrive {
         return pImpl->getActiveModifiers();
     }
 
+    KeySet KeyboardInput::getHeldKeys() const {
+        return pImpl->getHeldKeys();
+    }
+
+    int KeyboardInput::detachForHandover() {
+        return pImpl->detachForHandover();
+    }
+
+    void KeyboardInput::resumeAfterHandover() {
+        pImpl->resumeAfterHandover();
+    }
+
+    void KeyboardInput::setLeds(unsigned int managed, unsigned int active) {
+        pImpl->setLeds(managed, active);
+    }
+
+    std::string KeyboardInput::getDeviceName() const {
+        return pImpl->getDeviceName();
+    }
+
+    const libevdev* KeyboardInput::getDevice() const {
+        return pImpl->getDevice();
+    }
+
+    bool KeyboardInput::isConnected() const {
+        return pImpl->isConnected();
+    }
+
+    void KeyboardInput::setDebounce(std::chrono::milliseconds window) {
+        pImpl->setDebounce(window);
+    }
+
+    void KeyboardInput::setRepeatKeys(const std::vector<std::string>& keyNames) {
+        pImpl->setRepeatKeys(keyNames);
+    }
+
+    void KeyboardInput::setRepeatBacklogLimit(int limit) {
+        pImpl->setRepeatBacklogLimit(limit);
+    }
+
+    uint64_t KeyboardInput::getSuppressedBounces() const {
+        return pImpl->getSuppressedBounces();
+    }
+
+    const InputMetrics& KeyboardInput::getMetrics() const {
+        return pImpl->getMetrics();
+    }
+
 } // namespace keydrive
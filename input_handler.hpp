@@ -9,7 +9,10 @@
 #include <chrono>
 #include <unordered_map>
 #include <optional>  // ADDED: For std::optional
+#include <functional>
 #include <libevdev-1.0/libevdev/libevdev.h>
+#include "hotkey_detector.hpp"
+#include "metrics.hpp"
 
 namespace keydrive {
 
@@ -24,7 +27,8 @@ namespace keydrive {
         Release,
         Repeat,
         Modifier,
-        RawKey
+        RawKey,
+        Hotkey
     };
 
     /**
@@ -49,6 +53,22 @@ namespace keydrive {
 
         // For raw key events
         int value = 0;            // Raw value (1=press, 0=release)
+
+        // For hotkey events
+        keydrive::Hotkey hotkey = keydrive::Hotkey::None;
+
+        // For repeat events: repeats coalesced into this event while the main loop lagged
+        int repeatCount = 1;
+    };
+
+    /**
+     * @brief Counters maintained by the input thread, readable from any thread
+     */
+    struct InputMetrics {
+        Counter eventsRead;        // evdev events read from the device
+        Counter synDropped;        // Kernel buffer overflows (SYN_DROPPED)
+        Counter redundantEdges;    // Presses of held keys and releases of keys not held
+        HighWaterMark queueDepth;  // Most events waiting for the main loop at once
     };
 
     /**
@@ -56,12 +76,46 @@ namespace keydrive {
      */
     class KeyboardInput {
     public:
+        /**
+         * @brief Current key state of a source that is not an evdev device (stands in for EVIOCGKEY)
+         */
+        using KeyStateQuery = std::function<KeySet()>;
+
         /**
          * @brief Construct a new Keyboard Input object
          *
-         * @throws std::runtime_error if no physical keyboard is detected
+         * Finds the physical keyboard. Without grabNow the keyboard stays
+         * usable by everyone else until grab() is called.
+         *
+         * @param grabNow Grab the keyboard and start reading right away
+         * @throws std::runtime_error if no physical keyboard is detected or it cannot be grabbed
          */
-        KeyboardInput();
+        explicit KeyboardInput(bool grabNow = true);
+
+        /**
+         * @brief Adopt a keyboard that another instance already grabbed
+         *
+         * The held keys are checked against the kernel's key state right away,
+         * as after SYN_DROPPED; keys that differ are queued as presses/releases.
+         *
+         * @param grabbedFd evdev file descriptor received on handover (ownership is taken)
+         * @param heldKeys Keys held at the moment of handover
+         * @throws std::runtime_error if the fd is not a usable evdev device
+         */
+        KeyboardInput(int grabbedFd, const KeySet& heldKeys);
+
+        /**
+         * @brief Read input_event records from a pipe or socket instead of a keyboard
+         *
+         * Used by the load generator: events take the same path as a device's.
+         * LED writes go back through the same fd.
+         *
+         * @param sourceFd File descriptor to read (ownership is taken)
+         * @param sourceName Name reported as the device name
+         * @param keyState Key state for resynchronizing after SYN_DROPPED; without it
+         *                 the source can't recover from one
+         */
+        KeyboardInput(int sourceFd, const std::string& sourceName, KeyStateQuery keyState = nullptr);
 
         /**
          * @brief Destroy the Keyboard Input object
@@ -70,6 +124,16 @@ namespace keydrive {
          */
         ~KeyboardInput();
 
+        /**
+         * @brief Grab the keyboard and start reading it
+         *
+         * Events from before the grab are discarded; they already reached the
+         * compositor. Does nothing if the keyboard is already grabbed.
+         *
+         * @throws std::runtime_error if the keyboard cannot be grabbed
+         */
+        void grab();
+
         /**
          * @brief Get the next input event (non-blocking with timeout)
          *
@@ -78,6 +142,22 @@ namespace keydrive {
          */
         std::optional<InputEvent> getEvent(int timeout_ms = 100);
 
+        /**
+         * @brief Take all queued events at once (non-blocking)
+         *
+         * Also clears the notification fd, so call it from the fd's handler.
+         *
+         * @return std::vector<InputEvent> Queued events in arrival order
+         */
+        std::vector<InputEvent> takeEvents();
+
+        /**
+         * @brief Get a file descriptor that becomes readable when events are queued
+         *
+         * @return int eventfd suitable for epoll/poll
+         */
+        int getNotifyFd() const;
+
         /**
          * @brief Check if a modifier is currently active
          *
@@ -100,6 +180,105 @@ namespace keydrive {
          */
         std::vector<std::string> getActiveModifiers() const;
 
+        /**
+         * @brief Get the physical keys currently held down
+         */
+        KeySet getHeldKeys() const;
+
+        /**
+         * @brief Stop reading and give up the grabbed device for a handover
+         *
+         * The input thread is stopped; events it already read stay available
+         * through takeEvents(). The device is left grabbed when this object is
+         * destroyed so the grab passes to the new instance.
+         *
+         * @return int The grabbed evdev file descriptor
+         */
+        int detachForHandover();
+
+        /**
+         * @brief Take the device back after a handover failed to reach the new instance
+         *
+         * Restarts the input thread stopped by detachForHandover().
+         */
+        void resumeAfterHandover();
+
+        /**
+         * @brief Set LEDs on the grabbed keyboard
+         *
+         * Writes EV_LED events straight to the device fd. LED state is cached,
+         * so LEDs already in the requested state are not written again.
+         *
+         * @param managed Bitmask (1 << LED_*) of the LEDs to control; others are left alone
+         * @param active Bitmask of the managed LEDs to switch on
+         */
+        void setLeds(unsigned int managed, unsigned int active);
+
+        /**
+         * @brief Get the name of the grabbed keyboard
+         */
+        std::string getDeviceName() const;
+
+        /**
+         * @brief Get the keyboard's libevdev device, to copy its capabilities
+         *
+         * Only valid until the keyboard is unplugged.
+         *
+         * @return const libevdev* nullptr when reading a pipe or socket
+         */
+        const libevdev* getDevice() const;
+
+        /**
+         * @brief Check whether the keyboard is plugged in
+         *
+         * After an unplug, keys held on it are released and the input thread
+         * looks for the keyboard every 500ms, grabbing it again once it is back.
+         */
+        bool isConnected() const;
+
+        /**
+         * @brief Set the debounce window for chattering switches
+         *
+         * The first edge of a key is forwarded at once; further edges of the same
+         * key within the window are suppressed. A key that ends up in a different
+         * state is corrected when its window closes.
+         *
+         * @param window Debounce window, 0 disables debouncing
+         */
+        void setDebounce(std::chrono::milliseconds window);
+
+        /**
+         * @brief Limit the built-in key repeat to the keys the layout remaps
+         *
+         * Other keys are forwarded and stay held on the virtual keyboard, which
+         * repeats them itself; the keyboard's value-2 repeats are dropped.
+         * Until this is called every key is repeated by the built-in engine.
+         *
+         * @param keyNames Remapped key names (e.g., "key_a")
+         */
+        void setRepeatKeys(const std::vector<std::string>& keyNames);
+
+        /**
+         * @brief Limit how many repeats may pile up while the main loop lags
+         *
+         * Repeats of a key that arrive while its previous Repeat event is still
+         * queued are folded into that event's repeatCount, up to this limit;
+         * further ones are dropped. A release cancels the key's queued repeats.
+         *
+         * @param limit Maximum repeatCount of a queued Repeat event (at least 1)
+         */
+        void setRepeatBacklogLimit(int limit);
+
+        /**
+         * @brief Get the number of key edges suppressed as bounces since startup
+         */
+        uint64_t getSuppressedBounces() const;
+
+        /**
+         * @brief Get the input thread's counters
+         */
+        const InputMetrics& getMetrics() const;
+
     private:
         std::unique_ptr<InputHandlerImpl> pImpl;  // Pimpl pattern for cleaner interface
     };
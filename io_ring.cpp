@@ -0,0 +1,256 @@
+#include "io_ring.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace keydrive {
+
+	namespace {
+
+		int ioUringSetup(unsigned entries, io_uring_params* params) {
+			return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+		}
+
+		int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+			return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+		}
+
+		int ioUringRegister(int fd, unsigned opcode, const void* arg, unsigned nrArgs) {
+			return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+		}
+
+		void* mapRing(int fd, size_t size, off_t offset) {
+			void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+			return ptr == MAP_FAILED ? nullptr : ptr;
+		}
+
+		template <typename T>
+		T* at(void* base, uint32_t offset) {
+			return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+		}
+
+		std::runtime_error setupError(const char* what, int error) {
+			return std::runtime_error(std::string(what) + ": " + std::strerror(error));
+		}
+
+	} // anonymous namespace
+
+	IoRing::IoRing(unsigned entries) {
+		// Only the creating thread submits, and completions are only reaped
+		// while it waits: task work can then wait for the wait instead of
+		// interrupting the thread (Linux 6.1). Older kernels get a plain ring.
+		io_uring_params params{};
+		params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+		ringFd = ioUringSetup(entries, &params);
+		if (ringFd < 0 && errno == EINVAL) {
+			params = io_uring_params{};
+			ringFd = ioUringSetup(entries, &params);
+		}
+		if (ringFd < 0) {
+			throw setupError("io_uring_setup failed", errno);
+		}
+
+		featureFlags = params.features;
+		if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+			close(ringFd);
+			throw std::runtime_error("io_uring is too old (no wait timeouts)");
+		}
+
+		// One mapping holds both rings
+		sqRingSize = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+		                      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+		sqRing = mapRing(ringFd, sqRingSize, IORING_OFF_SQ_RING);
+		sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = sqRing ? static_cast<io_uring_sqe*>(mapRing(ringFd, sqesSize, IORING_OFF_SQES)) : nullptr;
+		if (!sqRing || !sqes) {
+			int error = errno;
+			release();
+			throw setupError("Failed to map io_uring queues", error);
+		}
+
+		sqHead = at<unsigned>(sqRing, params.sq_off.head);
+		sqTail = at<unsigned>(sqRing, params.sq_off.tail);
+		sqMask = *at<unsigned>(sqRing, params.sq_off.ring_mask);
+		sqEntries = *at<unsigned>(sqRing, params.sq_off.ring_entries);
+		sqArray = at<unsigned>(sqRing, params.sq_off.array);
+		sqeTail = *sqTail;
+		// SQEs are always used in ring order, so the index array is the identity
+		for (unsigned i = 0; i < sqEntries; ++i) {
+			sqArray[i] = i;
+		}
+
+		cqHead = at<unsigned>(sqRing, params.cq_off.head);
+		cqTail = at<unsigned>(sqRing, params.cq_off.tail);
+		cqMask = *at<unsigned>(sqRing, params.cq_off.ring_mask);
+		cqes = at<io_uring_cqe>(sqRing, params.cq_off.cqes);
+
+		// Without a probe (before 5.6) no opcode counts as supported
+		std::vector<char> probeSpace(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+		auto* probe = reinterpret_cast<io_uring_probe*>(probeSpace.data());
+		if (ioUringRegister(ringFd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+			for (unsigned i = 0; i < probe->ops_len; ++i) {
+				if (probe->ops[i].flags & IO_URING_OP_SUPPORTED) {
+					supportedOps[probe->ops[i].op / 64] |= uint64_t{1} << (probe->ops[i].op % 64);
+				}
+			}
+		}
+	}
+
+	IoRing::~IoRing() {
+		release();
+	}
+
+	void IoRing::release() {
+		// Closing the ring cancels whatever is still armed
+		if (ringFd >= 0) {
+			close(ringFd);
+			ringFd = -1;
+		}
+		if (sqes) {
+			munmap(sqes, sqesSize);
+			sqes = nullptr;
+		}
+		if (sqRing) {
+			munmap(sqRing, sqRingSize);
+			sqRing = nullptr;
+		}
+	}
+
+	bool IoRing::supports(uint8_t opcode) const {
+		return supportedOps[opcode / 64] & (uint64_t{1} << (opcode % 64));
+	}
+
+	uint32_t IoRing::features() const {
+		return featureFlags;
+	}
+
+	io_uring_sqe* IoRing::getSqe() {
+		if (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+			submitAndWait(0);
+			if (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+				return nullptr;
+			}
+		}
+		io_uring_sqe* sqe = &sqes[sqeTail & sqMask];
+		++sqeTail;
+		std::memset(sqe, 0, sizeof(*sqe));
+		return sqe;
+	}
+
+	unsigned IoRing::queued() const {
+		return sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	}
+
+	void IoRing::flushSqes() {
+		// The kernel reads the SQEs once it sees the new tail
+		__atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+	}
+
+	int IoRing::submitAndWait(unsigned waitNr, int timeoutMs) {
+		flushSqes();
+		unsigned toSubmit = queued();
+		unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+		int rc;
+		if (waitNr > 0 && timeoutMs >= 0) {
+			__kernel_timespec ts{timeoutMs / 1000, static_cast<long long>(timeoutMs % 1000) * 1000000};
+			io_uring_getevents_arg arg{};
+			arg.sigmask_sz = _NSIG / 8;
+			arg.ts = reinterpret_cast<uint64_t>(&ts);
+			rc = ioUringEnter(ringFd, toSubmit, waitNr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+		} else {
+			rc = ioUringEnter(ringFd, toSubmit, waitNr, flags, nullptr, _NSIG / 8);
+		}
+		return rc < 0 ? -errno : rc;
+	}
+
+	unsigned IoRing::forEachCompletion(const std::function<void(const io_uring_cqe&)>& f) {
+		unsigned head = *cqHead;
+		unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		unsigned seen = 0;
+		while (head != tail) {
+			// Copied out so the slot can be released before f queues more work
+			io_uring_cqe cqe = cqes[head & cqMask];
+			++head;
+			++seen;
+			__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+			f(cqe);
+			tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		}
+		return seen;
+	}
+
+	void IoRing::provideBuffers(uint16_t group, unsigned count, unsigned size) {
+		buffers.assign(static_cast<size_t>(count) * size, 0);
+		bufSize = size;
+		bufGroup = group;
+
+		io_uring_sqe* sqe = getSqe();
+		if (!sqe) {
+			throw std::runtime_error("io_uring submission queue exhausted");
+		}
+		sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+		sqe->fd = static_cast<int>(count);
+		sqe->addr = reinterpret_cast<uint64_t>(buffers.data());
+		sqe->len = size;
+		sqe->buf_group = group;
+		sqe->off = 0;
+		sqe->user_data = 0;
+		int rc = submitAndWait(1);
+		if (rc < 0) {
+			throw setupError("Failed to provide read buffers", -rc);
+		}
+
+		int result = 0;
+		forEachCompletion([&](const io_uring_cqe& cqe) {
+			if (cqe.user_data == 0 && cqe.res < 0) {
+				result = cqe.res;
+			}
+		});
+		if (result < 0) {
+			throw setupError("Failed to provide read buffers", -result);
+		}
+	}
+
+	const void* IoRing::buffer(uint16_t id) const {
+		return buffers.data() + static_cast<size_t>(id) * bufSize;
+	}
+
+	bool IoRing::recycleBuffer(uint16_t id) {
+		// Goes out with the next submission
+		io_uring_sqe* sqe = getSqe();
+		if (!sqe) {
+			return false;
+		}
+		sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+		sqe->fd = 1;
+		sqe->addr = reinterpret_cast<uint64_t>(buffers.data() + static_cast<size_t>(id) * bufSize);
+		sqe->len = bufSize;
+		sqe->buf_group = bufGroup;
+		sqe->off = id;
+		sqe->user_data = 0;
+		if (featureFlags & IORING_FEAT_CQE_SKIP) {
+			// Its completion would only end the next wait early
+			sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+		}
+		return true;
+	}
+
+	int IoRing::getFd() const {
+		return ringFd;
+	}
+
+	bool ioRingAllowed() {
+		const char* requested = std::getenv("KEYDRIVE_REACTOR");
+		return !requested || std::strcmp(requested, "epoll") != 0;
+	}
+
+} // namespace keydrive
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <linux/io_uring.h>
+
+namespace keydrive {
+
+	/**
+	 * @brief An io_uring instance driven through the raw system calls
+	 *
+	 * Just what the reactor and the input thread need: queueing SQEs,
+	 * submitting them together with the wait for completions, and one group of
+	 * provided buffers for multishot reads. Each ring belongs to one thread.
+	 */
+	class IoRing {
+	public:
+		// IORING_OP_READ_MULTISHOT (Linux 6.7); older uapi headers lack it
+		static constexpr uint8_t OP_READ_MULTISHOT = 49;
+
+		/**
+		 * @brief Set up a ring
+		 *
+		 * @param entries Submission queue size (the completion queue is twice that)
+		 * @throws std::runtime_error if the kernel has no io_uring, refuses it
+		 *         (io_uring_disabled, seccomp) or lacks timeouts on the wait
+		 */
+		explicit IoRing(unsigned entries);
+		~IoRing();
+
+		IoRing(const IoRing&) = delete;
+		IoRing& operator=(const IoRing&) = delete;
+
+		/**
+		 * @brief Check whether the kernel implements an opcode
+		 */
+		bool supports(uint8_t opcode) const;
+
+		/**
+		 * @brief Get the IORING_FEAT_* flags the kernel reported
+		 */
+		uint32_t features() const;
+
+		/**
+		 * @brief Get a cleared SQE to fill in
+		 *
+		 * Submits the queued SQEs first when the submission queue is full.
+		 *
+		 * @return nullptr if there is still no room
+		 */
+		io_uring_sqe* getSqe();
+
+		/**
+		 * @brief Number of SQEs queued since the last submission
+		 */
+		unsigned queued() const;
+
+		/**
+		 * @brief Submit the queued SQEs and wait for completions, in one syscall
+		 *
+		 * @param waitNr Completions to wait for (0 only submits)
+		 * @param timeoutMs Longest wait in milliseconds (-1 waits forever)
+		 * @return Number of SQEs submitted, -ETIME on timeout, or another -errno
+		 */
+		int submitAndWait(unsigned waitNr, int timeoutMs = -1);
+
+		/**
+		 * @brief Pass each completion that is ready to f and consume it
+		 *
+		 * @return Number of completions seen
+		 */
+		unsigned forEachCompletion(const std::function<void(const io_uring_cqe&)>& f);
+
+		/**
+		 * @brief Provide buffers for reads with IOSQE_BUFFER_SELECT
+		 *
+		 * Each read completion uses up one buffer; hand it back with
+		 * recycleBuffer() once its contents are consumed. Waits for the kernel
+		 * to take them, so call it before arming anything.
+		 *
+		 * @param group Buffer group ID to use in SQEs
+		 * @param count Number of buffers
+		 * @param size Size of each buffer in bytes
+		 * @throws std::runtime_error if the kernel refuses the buffers
+		 */
+		void provideBuffers(uint16_t group, unsigned count, unsigned size);
+
+		/**
+		 * @brief Get the contents of a provided buffer picked by the kernel
+		 *
+		 * @param id Buffer ID from the completion (flags >> IORING_CQE_BUFFER_SHIFT)
+		 */
+		const void* buffer(uint16_t id) const;
+
+		/**
+		 * @brief Provide a buffer to the kernel again, with the next submission
+		 *
+		 * The completion of the SQE this queues has user_data 0; since Linux
+		 * 5.17 only a failure completes.
+		 *
+		 * @return false if the submission queue is full
+		 */
+		bool recycleBuffer(uint16_t id);
+
+		int getFd() const;
+
+	private:
+		int ringFd = -1;
+		uint32_t featureFlags = 0;
+
+		// Submission queue
+		void* sqRing = nullptr;
+		size_t sqRingSize = 0;
+		unsigned* sqHead = nullptr;
+		unsigned* sqTail = nullptr;
+		unsigned sqMask = 0;
+		unsigned sqEntries = 0;
+		unsigned* sqArray = nullptr;
+		io_uring_sqe* sqes = nullptr;
+		size_t sqesSize = 0;
+		// SQEs handed out by getSqe() but not yet published to the kernel
+		unsigned sqeTail = 0;
+
+		// Completion queue (in the SQ ring's mapping, IORING_FEAT_SINGLE_MMAP)
+		unsigned* cqHead = nullptr;
+		unsigned* cqTail = nullptr;
+		unsigned cqMask = 0;
+		io_uring_cqe* cqes = nullptr;
+
+		// Opcodes the kernel implements, from IORING_REGISTER_PROBE
+		uint64_t supportedOps[4] = {};
+
+		// Buffers provided for selecting reads
+		std::vector<char> buffers;
+		unsigned bufSize = 0;
+		uint16_t bufGroup = 0;
+
+		// Publish the SQEs handed out so far
+		void flushSqes();
+		// Close the ring and unmap everything (destructor and failed setup)
+		void release();
+	};
+
+	/**
+	 * @brief Check whether io_uring may be used at all
+	 *
+	 * KEYDRIVE_REACTOR=epoll keeps the reactor and the input thread on
+	 * epoll/poll(), to compare against or to get around a kernel problem.
+	 */
+	bool ioRingAllowed();
+
+} // namespace keydrive
@@ -5,6 +5,12 @@
 #include <algorithm>
 #include <cctype>
 #include <system_error>
+#include <linux/input.h>
+#include <yaml-cpp/yaml.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
 
 namespace keydrive {
 
@@ -13,6 +19,13 @@ namespace keydrive {
 		// Default state values
 		constexpr const char* DEFAULT_LAYOUT = "default";
 		constexpr const char* DEFAULT_LAYER = "base";
+		constexpr const char* DEFAULT_PROFILE = "default";
+
+		// Hold threshold of dual-role keys until one is learned
+		constexpr int DEFAULT_TAPPING_TERM_MS = 200;
+
+		// Threads compiling layouts at startup
+		constexpr unsigned int MAX_LOADER_THREADS = 4;
 
 		// Helper to convert string to lowercase
 		std::string toLower(const std::string& str) {
@@ -23,7 +36,7 @@ namespace keydrive {
 		}
 
 		// Helper to check if a string starts with a prefix
-		bool startsWith(const std::string& str, const std::string& prefix) {
+		bool startsWith(std::string_view str, std::string_view prefix) {
 			return str.size() >= prefix.size() &&
 			str.compare(0, prefix.size(), prefix) == 0;
 		}
@@ -63,16 +76,36 @@ namespace keydrive {
 				return LayerType::Toggle;
 			} else if (lowerType == "onetime") {
 				return LayerType::Onetime;
+			} else if (lowerType == "taphold" || lowerType == "tap-hold" || lowerType == "tap_hold") {
+				return LayerType::TapHold;
 			}
 			return LayerType::Hold;  // Default to hold
 		}
 
+		// Parse an LED name from layer_keys; nullopt if unknown
+		std::optional<unsigned int> parseLed(const std::string& ledStr) {
+			std::string lowerLed = toLower(ledStr);
+			if (lowerLed == "caps" || lowerLed == "capslock") {
+				return LED_CAPSL;
+			} else if (lowerLed == "num" || lowerLed == "numlock") {
+				return LED_NUML;
+			} else if (lowerLed == "scroll" || lowerLed == "scrolllock") {
+				return LED_SCROLLL;
+			} else if (lowerLed == "compose") {
+				return LED_COMPOSE;
+			} else if (lowerLed == "kana") {
+				return LED_KANA;
+			}
+			return std::nullopt;
+		}
+
 		// Convert layer type to string for debugging
 		std::string layerTypeToString(LayerType type) {
 			switch (type) {
 				case LayerType::Hold: return "hold";
 				case LayerType::Toggle: return "toggle";
 				case LayerType::Onetime: return "onetime";
+				case LayerType::TapHold: return "taphold";
 			}
 			return "unknown";
 		}
@@ -136,6 +169,67 @@ namespace keydrive {
 			return std::nullopt;
 		}
 
+		// Decode a whole UTF-8 string, skipping invalid sequences
+		std::u32string utf8ToUtf32(const std::string& str) {
+			std::u32string result;
+			size_t i = 0;
+			while (i < str.size()) {
+				unsigned char firstByte = static_cast<unsigned char>(str[i]);
+				size_t length = 1;
+				if ((firstByte & 0xE0) == 0xC0) length = 2;
+				else if ((firstByte & 0xF0) == 0xE0) length = 3;
+				else if ((firstByte & 0xF8) == 0xF0) length = 4;
+
+				if (auto c = stringToChar32(str.substr(i, length))) {
+					result.push_back(*c);
+				}
+				i += length;
+			}
+			return result;
+		}
+
+		// Run work(0) .. work(count - 1) on a few threads; work must not throw
+		void runParallel(size_t count, const std::function<void(size_t)>& work) {
+			unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+			size_t threads = std::min<size_t>(count, std::min(hardware, MAX_LOADER_THREADS));
+			std::atomic<size_t> next{0};
+			auto worker = [&]() {
+				for (size_t index; (index = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+					work(index);
+				}
+			};
+
+			std::vector<std::thread> pool;
+			for (size_t i = 1; i < threads; ++i) {
+				pool.emplace_back(worker);
+			}
+			worker();
+			for (auto& thread : pool) {
+				thread.join();
+			}
+		}
+
+		// devices.yaml: per-device settings keyed by device name, "default" for the rest
+		int readDeviceSetting(const std::string& configDir, const std::string& deviceName,
+			const std::string& setting, int fallback) {
+			std::ifstream devicesStream(configDir + "/devices.yaml");
+			if (!devicesStream) {
+				return fallback;
+			}
+
+			try {
+				YAML::Node devices = YAML::Load(devicesStream);
+				for (const std::string& key : {deviceName, std::string("default")}) {
+					if (devices[key] && devices[key][setting]) {
+						return std::max(0, devices[key][setting].as<int>());
+					}
+				}
+			} catch (const YAML::Exception& e) {
+				std::cerr << "⚠ Invalid devices.yaml: " << e.what() << std::endl;
+			}
+			return fallback;
+		}
+
 	} // anonymous namespace
 
 	LayoutManager::LayoutManager(const std::string& configDir)
@@ -148,13 +242,131 @@ namespace keydrive {
 		std::filesystem::create_directories(configDir, ec);
 		std::filesystem::create_directories(layoutsDir, ec);
 
-		// Load state and layout
+		// Load state and every layout; switching later only swaps a pointer
 		loadState();
-		loadLayout();
+		std::unordered_map<std::string, std::string> errors = preloadLayouts();
+
+		auto it = layouts.find(state["layout"]);
+		if (it == layouts.end()) {
+			auto error = errors.find(state["layout"]);
+			throw std::runtime_error(error != errors.end()
+				? error->second
+				: "Layout file not found: " + layoutsDir + "/" + state["layout"] + ".kbd");
+		}
+		activateLayout(it->second);
+		verifyLayerKeys();
 
 		std::cout << "✅ Layout manager initialized with " << state["layout"] << " layout" << std::endl;
 	}
 
+	void LayoutManager::reload() {
+		// Build a complete new instance first so a broken file leaves us untouched
+		LayoutManager reloaded(configDir);
+		*this = std::move(reloaded);
+	}
+
+	std::vector<std::string> LayoutManager::listLayouts() const {
+		std::vector<std::string> names;
+		for (const auto& [name, loaded] : layouts) {
+			names.push_back(name);
+		}
+		return names;
+	}
+
+	void LayoutManager::selectLayout(const std::string& name) {
+		auto it = layouts.find(name);
+		if (it == layouts.end()) {
+			// Added since startup; a broken file throws before anything changes
+			it = layouts.emplace(name, loadLayoutFile(layoutsDir, name)).first;
+		}
+		activateLayout(it->second);
+		saveState();
+	}
+
+	std::unordered_map<std::string, std::string> LayoutManager::preloadLayouts() {
+		std::vector<std::string> names;
+		std::error_code ec;
+		for (const auto& entry : std::filesystem::directory_iterator(layoutsDir, ec)) {
+			if (entry.is_regular_file() && entry.path().extension() == ".kbd") {
+				names.push_back(entry.path().stem().string());
+			}
+		}
+		std::sort(names.begin(), names.end());
+
+		// Layouts are independent, so they are parsed and compiled in parallel
+		std::vector<std::shared_ptr<const LoadedLayout>> loaded(names.size());
+		std::vector<std::string> failures(names.size());
+		auto started = std::chrono::steady_clock::now();
+		runParallel(names.size(), [&](size_t index) {
+			try {
+				loaded[index] = loadLayoutFile(layoutsDir, names[index]);
+			} catch (const std::exception& e) {
+				failures[index] = e.what();
+			}
+		});
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+
+		std::unordered_map<std::string, std::string> errors;
+		layouts.clear();
+		for (size_t i = 0; i < names.size(); ++i) {
+			if (!loaded[i]) {
+				std::cerr << "⚠ Skipping layout " << names[i] << ": " << failures[i] << std::endl;
+				errors[names[i]] = failures[i];
+				continue;
+			}
+			const LoadedLayout& layout = *loaded[i];
+			std::cout << "✅ Loaded layout " << names[i] << " with " << layout.tables->keyCount()
+			<< " keys, " << layout.layerKeys.size() << " layer keys and "
+			<< layout.abbreviations.size() << " abbreviations ("
+			<< (layout.tables->arenaBytes() + 1023) / 1024 << " KiB compiled)" << std::endl;
+			layouts.emplace(names[i], loaded[i]);
+		}
+		std::cout << "📚 " << layouts.size() << " layouts ready in " << elapsed.count() << " ms" << std::endl;
+		return errors;
+	}
+
+	void LayoutManager::activateLayout(std::shared_ptr<const LoadedLayout> layout) {
+		active = std::move(layout);
+		state["layout"] = active->name;
+
+		// Start on the saved layer with the layout's toggles restored
+		layerState = {
+			state["layer"],
+			{},
+			"",
+			"",
+			-1
+		};
+		for (const std::string& layerName : active->toggleLayers) {
+			auto saved = state.find("toggle_" + layerName);
+			layerState.toggles[layerName] = saved != state.end() && saved->second == "true";
+		}
+	}
+
+	std::string LayoutManager::cycleLayout() {
+		std::vector<std::string> names = listLayouts();
+		if (names.empty()) {
+			throw std::runtime_error("No layouts loaded from " + layoutsDir);
+		}
+
+		auto it = std::find(names.begin(), names.end(), state["layout"]);
+		std::string next = (it == names.end() || std::next(it) == names.end()) ? names.front() : *std::next(it);
+		selectLayout(next);
+		return next;
+	}
+
+	std::string LayoutManager::getLayoutName() const {
+		return state.at("layout");
+	}
+
+	int LayoutManager::getDebounceMs(const std::string& deviceName) const {
+		return readDeviceSetting(configDir, deviceName, "debounce_ms", 0);
+	}
+
+	int LayoutManager::getRepeatBacklogLimit(const std::string& deviceName) const {
+		return readDeviceSetting(configDir, deviceName, "repeat_backlog", 3);
+	}
+
 	void LayoutManager::loadState() {
 		// Default state
 		state["layout"] = DEFAULT_LAYOUT;
@@ -197,8 +409,11 @@ namespace keydrive {
 		}
 	}
 
-	void LayoutManager::loadLayout() {
-		std::string layoutPath = layoutsDir + "/" + state["layout"] + ".kbd";
+	std::shared_ptr<const LayoutManager::LoadedLayout> LayoutManager::loadLayoutFile(
+		const std::string& layoutsDir,
+		const std::string& name
+	) {
+		std::string layoutPath = layoutsDir + "/" + name + ".kbd";
 
 		// Check if layout file exists
 		if (!std::filesystem::exists(layoutPath)) {
@@ -211,66 +426,55 @@ namespace keydrive {
 			throw std::runtime_error("Failed to open layout file: " + layoutPath);
 		}
 
-		// Parse YAML
+		// Parse YAML; the tree is only needed until the layout is compiled
+		YAML::Node layout;
 		try {
 			layout = YAML::Load(layoutStream);
 		} catch (const YAML::Exception& e) {
 			throw std::runtime_error("Failed to parse layout file: " + std::string(e.what()));
 		}
 
-		// Create key position mapping
-		keyPositions.clear();
-		if (layout["source"] && layout["source"].IsSequence()) {
-			for (size_t i = 0; i < layout["source"].size(); ++i) {
-				std::string key = yamlNodeToString(layout["source"][i]);
-				keyPositions[key] = i;
-			}
-		} else {
+		if (!layout["source"] || !layout["source"].IsSequence()) {
 			throw std::runtime_error("Invalid layout format: missing or invalid 'source' array");
 		}
 
-		// Validate all layers
-		size_t sourceLength = keyPositions.size();
+		// Validate all layers; short layers are padded with empty cells and long
+		// ones truncated when compiled
 		if (layout["layers"] && layout["layers"].IsMap()) {
-			// USE NON-CONST ITERATOR SINCE WE NEED TO MODIFY LAYERS
-			for (YAML::iterator it = layout["layers"].begin(); it != layout["layers"].end(); ++it) {
-				const std::string& layerName = it->first.as<std::string>();
-				YAML::Node& layer = it->second;  // NON-CONST REFERENCE
-
-				if (!layer.IsSequence()) {
-					throw std::runtime_error("Layer '" + layerName + "' is not a sequence");
-				}
-
-				if (layer.size() != sourceLength) {
-					if (layer.size() < sourceLength) {
-						// Extend with empty strings
-						while (layer.size() < sourceLength) {
-							layer.push_back("");
-						}
-					} else {
-						// Truncate - create a new node since we can't resize directly
-						YAML::Node newLayer(YAML::NodeType::Sequence);
-						for (size_t i = 0; i < sourceLength; ++i) {
-							newLayer.push_back(layer[i]);
-						}
-						layout["layers"][layerName] = newLayer;
-					}
+			for (YAML::const_iterator it = layout["layers"].begin(); it != layout["layers"].end(); ++it) {
+				if (!it->second.IsSequence()) {
+					throw std::runtime_error("Layer '" + it->first.as<std::string>() + "' is not a sequence");
 				}
 			}
 		} else {
 			throw std::runtime_error("Invalid layout format: missing or invalid 'layers' map");
 		}
 
+		auto loaded = std::make_shared<LoadedLayout>();
+		loaded->name = name;
+
 		// Parse layer keys configuration
-		layerKeys.clear();
 		if (layout["layer_keys"] && layout["layer_keys"].IsMap()) {
 			for (YAML::const_iterator it = layout["layer_keys"].begin(); it != layout["layer_keys"].end(); ++it) {
 				const std::string& layerName = it->first.as<std::string>();
+				YAML::Node config = it->second;
+
+				// Optional keyboard LED lit while this layer is active (base included)
+				if (config.IsMap() && config["led"]) {
+					std::string ledName = config["led"].as<std::string>();
+					std::optional<unsigned int> led = parseLed(ledName);
+					if (led) {
+						loaded->layerLeds[layerName] = 1u << *led;
+						loaded->managedLeds |= 1u << *led;
+					} else {
+						std::cerr << "⚠ Unknown LED '" << ledName << "' for layer " << layerName << std::endl;
+					}
+				}
+
 				if (layerName == "base") {
 					continue;
 				}
 
-				YAML::Node config = it->second;
 				if (!config.IsMap()) {
 					std::cerr << "⚠ Invalid layer key config for " << layerName << std::endl;
 					continue;
@@ -285,46 +489,136 @@ namespace keydrive {
 				if (config["type"]) {
 					layerType = parseLayerType(config["type"].as<std::string>());
 				}
+				if (layerType == LayerType::Toggle) {
+					loaded->toggleLayers.push_back(layerName);
+				}
+
+				// Dual-role keys: what a tap types and the initial hold threshold
+				char32_t tapCharacter = 0;
+				int tappingTermMs = DEFAULT_TAPPING_TERM_MS;
+				if (layerType == LayerType::TapHold) {
+					std::optional<char32_t> tap = stringToChar32(yamlNodeToString(config["tap"]));
+					if (!tap) {
+						std::cerr << "⚠ Tap-hold layer " << layerName << " has no 'tap' character, using hold" << std::endl;
+						layerType = LayerType::Hold;
+					} else {
+						tapCharacter = *tap;
+					}
+					if (config["tapping_term_ms"]) {
+						tappingTermMs = config["tapping_term_ms"].as<int>();
+					}
+				}
 
 				// Register each key
 				for (const std::string& key : keyList) {
-					layerKeys[key] = {layerName, layerType};
+					loaded->layerKeys[key] = {layerName, layerType, tapCharacter, tappingTermMs};
 				}
 			}
 		}
 
-		// Initialize layer state
-		layerState = {
-			state["layer"],
-			{},
-			"",
-			"",
-			-1
-		};
+		// Shortcut mode: "logical" (follow the layout's base layer) or "physical"
+		if (layout["shortcuts"]) {
+			loaded->translateShortcuts = toLower(layout["shortcuts"].as<std::string>()) != "physical";
+		}
 
-		// Initialize toggle states
-		if (layout["layer_keys"] && layout["layer_keys"].IsMap()) {
-			for (YAML::const_iterator it = layout["layer_keys"].begin(); it != layout["layer_keys"].end(); ++it) {
-				const std::string& layerName = it->first.as<std::string>();
+		// Application profiles: window class substrings and per-profile settings
+		if (layout["profiles"] && layout["profiles"].IsMap()) {
+			for (YAML::const_iterator it = layout["profiles"].begin(); it != layout["profiles"].end(); ++it) {
+				Profile profile;
+				profile.name = it->first.as<std::string>();
 				YAML::Node config = it->second;
+				if (!config.IsMap()) {
+					std::cerr << "⚠ Invalid profile config for " << profile.name << std::endl;
+					continue;
+				}
+				for (const std::string& pattern : yamlNodeToStringVector(config["match"])) {
+					profile.match.push_back(toLower(pattern));
+				}
+				profile.translateShortcuts = loaded->translateShortcuts;
+				if (config["shortcuts"]) {
+					profile.translateShortcuts = toLower(config["shortcuts"].as<std::string>()) != "physical";
+				}
+				loaded->profiles.push_back(profile);
+			}
+		}
 
-				if (config["type"] && parseLayerType(config["type"].as<std::string>()) == LayerType::Toggle) {
-					// Load saved toggle state
-					bool savedState = false;
-					std::string stateKey = "toggle_" + layerName;
-					if (state.find(stateKey) != state.end()) {
-						savedState = (state[stateKey] == "true");
-					}
-					layerState.toggles[layerName] = savedState;
+		// Parse abbreviations for text expansion
+		if (layout["abbreviations"] && layout["abbreviations"].IsMap()) {
+			std::vector<std::string> abbreviationNames;
+			for (YAML::const_iterator it = layout["abbreviations"].begin(); it != layout["abbreviations"].end(); ++it) {
+				std::u32string trigger = utf8ToUtf32(it->first.as<std::string>());
+				std::u32string replacement = utf8ToUtf32(yamlNodeToString(it->second));
+				if (trigger.empty()) {
+					std::cerr << "⚠ Ignoring empty abbreviation" << std::endl;
+					continue;
+				}
+				loaded->abbreviations.push_back({trigger, replacement});
+				abbreviationNames.push_back(it->first.as<std::string>());
+			}
+
+			// A trigger containing a shorter one could never fire; say so instead
+			std::vector<Abbreviation> accepted;
+			for (size_t i = 0; i < loaded->abbreviations.size(); ++i) {
+				const Abbreviation& abbreviation = loaded->abbreviations[i];
+				if (const Abbreviation* shadowing = TextExpander::findShadowing(loaded->abbreviations, abbreviation.trigger)) {
+					size_t other = static_cast<size_t>(shadowing - loaded->abbreviations.data());
+					std::cerr << "⚠ Ignoring abbreviation '" << abbreviationNames[i] << "': '"
+					<< abbreviationNames[other] << "' expands before it can be typed" << std::endl;
+					continue;
 				}
+				accepted.push_back(abbreviation);
 			}
+			loaded->abbreviations = std::move(accepted);
 		}
 
-		// Verify layer keys
-		verifyLayerKeys();
+		compileLayout(layout, *loaded);
+		return loaded;
+	}
+
+	void LayoutManager::compileLayout(const YAML::Node& layout, LoadedLayout& loaded) {
+		std::vector<std::string> keyNames;
+		for (const auto& key : layout["source"]) {
+			keyNames.push_back(yamlNodeToString(key));
+		}
 
-		std::cout << "✅ Loaded layout with " << keyPositions.size()
-		<< " keys and " << layerKeys.size() << " layer keys" << std::endl;
+		// Decode every cell once, sizing the arena from the result
+		struct ParsedCell {
+			std::string raw;
+			std::string text;
+		};
+		std::vector<std::string> layerNames;
+		std::vector<std::vector<ParsedCell>> parsedLayers;
+		size_t textBytes = 0;
+		for (YAML::const_iterator it = layout["layers"].begin(); it != layout["layers"].end(); ++it) {
+			layerNames.push_back(it->first.as<std::string>());
+			std::vector<ParsedCell>& parsed = parsedLayers.emplace_back();
+			for (size_t pos = 0; pos < keyNames.size() && pos < it->second.size(); ++pos) {
+				std::string raw = yamlNodeToString(it->second[pos]);
+				std::string text = cleanChar(raw);
+				textBytes += raw.size() + (text == raw ? 0 : text.size());
+				parsed.push_back({std::move(raw), std::move(text)});
+			}
+		}
+
+		auto tables = std::make_shared<CompiledLayout>(keyNames, layerNames, textBytes);
+		for (size_t layer = 0; layer < parsedLayers.size(); ++layer) {
+			for (size_t pos = 0; pos < parsedLayers[layer].size(); ++pos) {
+				const ParsedCell& cell = parsedLayers[layer][pos];
+				tables->setCell(layer, pos, cell.raw, cell.text, stringToChar32(cell.raw));
+			}
+		}
+
+		// Layer keys are recognized by their base cell
+		if (auto base = tables->findLayer(DEFAULT_LAYER)) {
+			for (size_t pos = 0; pos < tables->keyCount(); ++pos) {
+				auto [isLayerKey, layerConfig] = getLayerForKey(loaded.layerKeys, std::string(tables->getCell(*base, pos).raw));
+				if (isLayerKey) {
+					tables->setLayerBinding(pos, layerConfig.targetLayer, layerConfig.type);
+				}
+			}
+		}
+
+		loaded.tables = std::move(tables);
 	}
 
 	std::optional<char32_t> LayoutManager::processKeyEvent(
@@ -338,30 +632,19 @@ namespace keydrive {
 		}
 
 		// Find key position
-		auto posIt = keyPositions.find(keyName);
-		if (posIt == keyPositions.end()) {
+		std::optional<size_t> pos = active->tables->findKey(keyName);
+		if (!pos) {
 			// Key not in layout - return special value to indicate forwarding
 			return std::nullopt;  // Use nullopt instead of sentinel value
 		}
-		size_t pos = posIt->second;
-
-		// Get character for base layer (we need this to check for layer keys)
-		if (!layout["layers"] || !layout["layers"]["base"] ||
-			pos >= layout["layers"]["base"].size()) {
-			std::cerr << "⚠ Position " << pos << " out of bounds for base layer" << std::endl;
-			return std::nullopt;
-			}
-
-		std::string baseChar = yamlNodeToString(layout["layers"]["base"][pos]);
 
 		// Check if this is a layer key
-		auto [isLayerKey, layerConfig] = getLayerForKey(keyName, baseChar);
-		if (isLayerKey) {
-			const std::string& layerName = layerConfig.targetLayer;
-			LayerType layerType = layerConfig.type;
+		if (const CompiledLayout::LayerBinding* binding = active->tables->getLayerBinding(*pos)) {
+			const std::string layerName(binding->targetLayer);
+			LayerType layerType = binding->type;
 
-			// Handle different layer types
-			if (layerType == LayerType::Hold) {
+			// Handle different layer types; a dual-role key only gets here once held
+			if (layerType == LayerType::Hold || layerType == LayerType::TapHold) {
 				layerState.hold = layerName;
 				layerState.holdKey = keyCode;
 				std::cout << "→ LAYER: HOLD '" << layerName << "' activated" << std::endl;
@@ -400,18 +683,14 @@ namespace keydrive {
 		std::string currentLayer = getCurrentLayer();
 
 		// Get character for this position in current layer
-		if (!layout["layers"] || !layout["layers"][currentLayer]) {
+		std::optional<size_t> layer = active->tables->findLayer(currentLayer);
+		if (!layer) {
 			std::cerr << "⚠ Layer not found: " << currentLayer << std::endl;
 			return std::nullopt;
 		}
 
-		YAML::Node layerNode = layout["layers"][currentLayer];
-		if (pos >= layerNode.size()) {
-			std::cerr << "⚠ Position " << pos << " out of bounds for layer '" << currentLayer << "'" << std::endl;
-			return std::nullopt;
-		}
-
-		std::string charStr = yamlNodeToString(layerNode[pos]);
+		const CompiledLayout::Cell& cell = active->tables->getCell(*layer, *pos);
+		std::string_view charStr = cell.raw;
 
 		// One-time layers are consumed after one use
 		if (!layerState.oneTime.empty()) {
@@ -419,8 +698,11 @@ namespace keydrive {
 			layerState.oneTime.clear();
 		}
 		std::cout << "INCOMING: " << charStr << "\n";
-		// Convert to Unicode character
-		auto character = stringToChar32(charStr);
+		// Decoded when the layout was compiled
+		std::optional<char32_t> character;
+		if (cell.hasCharacter) {
+			character = cell.character;
+		}
 
 		// Debug output
 		if (character) {
@@ -440,6 +722,96 @@ namespace keydrive {
 		return character;
 	}
 
+	std::string LayoutManager::getKeyCell(const std::string& keyName) const {
+		std::optional<size_t> pos = active->tables->findKey(keyName);
+		std::optional<size_t> layer = active->tables->findLayer(getCurrentLayer());
+		if (!pos || !layer) {
+			return "";
+		}
+		return std::string(active->tables->getCell(*layer, *pos).text);
+	}
+
+	bool LayoutManager::isLayerKey(const std::string& keyName) const {
+		std::optional<size_t> pos = active->tables->findKey(keyName);
+		return pos && active->tables->getLayerBinding(*pos) != nullptr;
+	}
+
+	std::optional<TapHoldConfig> LayoutManager::getTapHold(const std::string& keyName) const {
+		std::optional<size_t> pos = active->tables->findKey(keyName);
+		if (!pos) {
+			return std::nullopt;
+		}
+		const CompiledLayout::LayerBinding* binding = active->tables->getLayerBinding(*pos);
+		if (!binding || binding->type != LayerType::TapHold) {
+			return std::nullopt;
+		}
+
+		// The tap lives with the layer key's configuration ("ly..." in the base layer)
+		std::optional<size_t> base = active->tables->findLayer(DEFAULT_LAYER);
+		auto it = active->layerKeys.find(std::string(active->tables->getCell(*base, *pos).text));
+		if (it == active->layerKeys.end()) {
+			return std::nullopt;
+		}
+		return TapHoldConfig{it->second.tapCharacter, it->second.tappingTermMs};
+	}
+
+	std::vector<std::pair<std::string, char32_t>> LayoutManager::getBaseCharacters() const {
+		std::vector<std::pair<std::string, char32_t>> characters;
+		std::optional<size_t> base = active->tables->findLayer(DEFAULT_LAYER);
+		if (!base) {
+			return characters;
+		}
+
+		for (size_t pos = 0; pos < active->tables->keyCount(); ++pos) {
+			if (active->tables->getLayerBinding(pos)) {
+				continue;
+			}
+			// Only single ASCII characters can name a key on the reference layout
+			const CompiledLayout::Cell& cell = active->tables->getCell(*base, pos);
+			if (cell.hasCharacter && cell.character < 0x80 && (cell.raw.size() == 1 || cell.raw[0] == '\\')) {
+				characters.emplace_back(std::string(active->tables->getKeyName(pos)), cell.character);
+			}
+		}
+		return characters;
+	}
+
+	std::string LayoutManager::matchProfile(const std::string& windowClass) const {
+		std::string lowerClass = toLower(windowClass);
+		for (const auto& profile : active->profiles) {
+			for (const auto& pattern : profile.match) {
+				if (!pattern.empty() && lowerClass.find(pattern) != std::string::npos) {
+					return profile.name;
+				}
+			}
+		}
+		return DEFAULT_PROFILE;
+	}
+
+	bool LayoutManager::translatesShortcuts(const std::string& profileName) const {
+		for (const auto& profile : active->profiles) {
+			if (profile.name == profileName) {
+				return profile.translateShortcuts;
+			}
+		}
+		return active->translateShortcuts;
+	}
+
+	std::vector<std::string> LayoutManager::getRemappedKeys() const {
+		std::vector<std::string> remapped;
+		for (size_t pos = 0; pos < active->tables->keyCount(); ++pos) {
+			if (active->tables->getLayerBinding(pos)) {
+				continue;
+			}
+			for (size_t layer = 0; layer < active->tables->layerCount(); ++layer) {
+				if (!active->tables->getCell(layer, pos).text.empty()) {
+					remapped.emplace_back(active->tables->getKeyName(pos));
+					break;
+				}
+			}
+		}
+		return remapped;
+	}
+
 	void LayoutManager::handleKeyRelease(int keyCode) {
 		// Handle hold layer deactivation
 		if (layerState.holdKey == keyCode) {
@@ -476,14 +848,39 @@ namespace keydrive {
 		return (ctrlActive || altActive || superActive);
 	}
 
+	unsigned int LayoutManager::getManagedLeds() const {
+		return active->managedLeds;
+	}
+
+	unsigned int LayoutManager::getActiveLeds() const {
+		auto it = active->layerLeds.find(getCurrentLayer());
+		return it != active->layerLeds.end() ? it->second : 0;
+	}
+
 	LayerState LayoutManager::getLayerState() const {
 		return layerState;
 	}
 
+	void LayoutManager::restoreLayerState(const LayerState& restored) {
+		layerState = restored;
+		for (const auto& [layer, active] : layerState.toggles) {
+			state["toggle_" + layer] = active ? "true" : "false";
+		}
+		std::cout << "→ LAYER: restored '" << getCurrentLayer() << "'" << std::endl;
+	}
+
+	const std::vector<Abbreviation>& LayoutManager::getAbbreviations() const {
+		return active->abbreviations;
+	}
+
+	std::shared_ptr<const CompiledLayout> LayoutManager::getCompiledLayout() const {
+		return active->tables;
+	}
+
 	std::pair<bool, LayerKeyConfig> LayoutManager::getLayerForKey(
-		const std::string& keyName,
+		const std::unordered_map<std::string, LayerKeyConfig>& layerKeys,
 		const std::string& baseChar
-	) const {
+	) {
 		// Clean up the character value
 		std::string clean_char = cleanChar(baseChar);
 
@@ -511,19 +908,19 @@ namespace keydrive {
 		std::cout << "\n🔍 LAYER KEY VERIFICATION:" << std::endl;
 
 		// Check base layer for layer keys
-		if (!layout["layers"] || !layout["layers"]["base"]) {
+		std::optional<size_t> base = active->tables->findLayer(DEFAULT_LAYER);
+		if (!base) {
 			std::cerr << "⚠ Base layer not found in layout" << std::endl;
 			return;
 		}
 
-		YAML::Node baseLayer = layout["layers"]["base"];
-		for (size_t i = 0; i < baseLayer.size(); ++i) {
-			std::string charStr = yamlNodeToString(baseLayer[i]);
-			std::string clean_char = cleanChar(charStr);
+		for (size_t i = 0; i < active->tables->keyCount(); ++i) {
+			std::string_view charStr = active->tables->getCell(*base, i).raw;
+			std::string_view clean_char = active->tables->getCell(*base, i).text;
 
 			if (!clean_char.empty() && startsWith(clean_char, "ly")) {
-				auto it = layerKeys.find(clean_char);
-				if (it != layerKeys.end()) {
+				auto it = active->layerKeys.find(std::string(clean_char));
+				if (it != active->layerKeys.end()) {
 					const auto& config = it->second;
 					std::cout << "  ✅ Position " << i << ": '" << charStr << "' → '" << clean_char
 					<< "' → " << layerTypeToString(config.type)
@@ -537,13 +934,11 @@ namespace keydrive {
 
 		// Check layer_keys configuration
 		std::cout << "\n  Configured layer keys:" << std::endl;
-		for (const auto& [keyId, config] : layerKeys) {
+		for (const auto& [keyId, config] : active->layerKeys) {
 			// Find where this layer key appears in the layout
 			std::vector<size_t> positions;
-			for (size_t i = 0; i < baseLayer.size(); ++i) {
-				std::string charStr = yamlNodeToString(baseLayer[i]);
-				std::string clean_char = cleanChar(charStr);
-				if (clean_char == keyId) {
+			for (size_t i = 0; i < active->tables->keyCount(); ++i) {
+				if (active->tables->getCell(*base, i).text == keyId) {
 					positions.push_back(i);
 				}
 			}
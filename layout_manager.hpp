@@ -3,8 +3,15 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <map>
 #include <optional>
-#include <yaml-cpp/yaml.h>
+#include <memory>
+#include "text_expander.hpp"
+#include "compiled_layout.hpp"
+
+namespace YAML {
+	class Node;
+}
 
 namespace keydrive {
 
@@ -14,7 +21,8 @@ namespace keydrive {
 	enum class LayerType {
 		Hold,
 		Toggle,
-		Onetime
+		Onetime,
+		TapHold   // Dual-role: a tap types a character, a hold is a hold layer
 	};
 
 	/**
@@ -23,6 +31,16 @@ namespace keydrive {
 	struct LayerKeyConfig {
 		std::string targetLayer;
 		LayerType type;
+		char32_t tapCharacter = 0;   // TapHold: character typed on a tap
+		int tappingTermMs = 0;       // TapHold: initial hold threshold
+	};
+
+	/**
+	 * @brief What a dual-role key does when tapped
+	 */
+	struct TapHoldConfig {
+		char32_t tapCharacter;
+		int tappingTermMs;   // Starting point; the daemon learns per-key terms from there
 	};
 
 	/**
@@ -36,6 +54,15 @@ namespace keydrive {
 		int holdKey{-1};
 	};
 
+	/**
+	 * @brief Per-application settings, selected by the focused window's class
+	 */
+	struct Profile {
+		std::string name;
+		std::vector<std::string> match;   // Lowercase window class substrings
+		bool translateShortcuts = true;   // Shortcuts follow the layout, not the physical key
+	};
+
 	/**
 	 * @brief Manages keyboard layouts, layers, and character mapping
 	 */
@@ -48,6 +75,75 @@ namespace keydrive {
 		 */
 		explicit LayoutManager(const std::string& configDir = std::string(getenv("HOME")) + "/keydrive-cpp");
 
+		/**
+		 * @brief Reload state and layout from disk
+		 *
+		 * The current layout stays active if the new one fails to load.
+		 *
+		 * @throws std::runtime_error if the layout cannot be loaded
+		 */
+		void reload();
+
+		/**
+		 * @brief List the layouts preloaded from the layouts directory
+		 *
+		 * Every .kbd file is compiled at startup (and on reload); files that fail
+		 * to load are left out.
+		 *
+		 * @return std::vector<std::string> Layout names (file names without .kbd), sorted
+		 */
+		std::vector<std::string> listLayouts() const;
+
+		/**
+		 * @brief Switch to another layout and persist the choice
+		 *
+		 * Preloaded layouts are switched to by swapping a pointer; a layout
+		 * added to the directory since startup is loaded first.
+		 *
+		 * @param name Layout name (file name without .kbd)
+		 * @throws std::runtime_error if the layout cannot be loaded; the current layout stays active
+		 */
+		void selectLayout(const std::string& name);
+
+		/**
+		 * @brief Switch to the next layout in listLayouts() order
+		 *
+		 * @return std::string Name of the newly active layout
+		 * @throws std::runtime_error if no layout can be loaded
+		 */
+		std::string cycleLayout();
+
+		/**
+		 * @brief Get the name of the active layout
+		 */
+		std::string getLayoutName() const;
+
+		/**
+		 * @brief Get the debounce window configured for a keyboard
+		 *
+		 * Read from devices.yaml in the config directory:
+		 * @code
+		 * "AT Translated Set 2 keyboard":
+		 *   debounce_ms: 8
+		 * default:
+		 *   debounce_ms: 0
+		 * @endcode
+		 *
+		 * @param deviceName Name of the grabbed keyboard
+		 * @return int Window in milliseconds, 0 if debouncing is off
+		 */
+		int getDebounceMs(const std::string& deviceName) const;
+
+		/**
+		 * @brief Get how many key repeats may pile up while output lags
+		 *
+		 * Read from "repeat_backlog" in devices.yaml, like the debounce window.
+		 *
+		 * @param deviceName Name of the grabbed keyboard
+		 * @return int Maximum repeats coalesced into one command (default 3)
+		 */
+		int getRepeatBacklogLimit(const std::string& deviceName) const;
+
 		/**
 		 * @brief Process a key event and determine what character to output
 		 *
@@ -62,6 +158,69 @@ namespace keydrive {
 			const std::string& eventType
 		);
 
+		/**
+		 * @brief Get the raw cell of a key in the current layer without side effects
+		 *
+		 * Used for cells that are actions rather than characters (e.g. "ms_up").
+		 *
+		 * @param keyName The key name (e.g., "key_a")
+		 * @return std::string Cleaned cell content, empty if the key is unmapped
+		 */
+		std::string getKeyCell(const std::string& keyName) const;
+
+		/**
+		 * @brief Check whether a key activates a layer (its base cell is a layer key)
+		 *
+		 * @param keyName The key name (e.g., "key_a")
+		 */
+		bool isLayerKey(const std::string& keyName) const;
+
+		/**
+		 * @brief Get the tap action of a dual-role key (layer type "taphold")
+		 *
+		 * The key's hold is handled by processKeyEvent() like a hold layer key,
+		 * once the daemon has decided it is held.
+		 *
+		 * @param keyName The key name (e.g., "key_capslock")
+		 * @return std::optional<TapHoldConfig> Tap character and term, or nullopt for other keys
+		 */
+		std::optional<TapHoldConfig> getTapHold(const std::string& keyName) const;
+
+		/**
+		 * @brief Get the single ASCII characters on the base layer
+		 *
+		 * Input for the shortcut translation table; layer keys are left out.
+		 *
+		 * @return std::vector<std::pair<std::string, char32_t>> Key name and base character
+		 */
+		std::vector<std::pair<std::string, char32_t>> getBaseCharacters() const;
+
+		/**
+		 * @brief Find the profile for a window class
+		 *
+		 * @param windowClass Class of the focused window
+		 * @return std::string First profile with a matching pattern, or "default"
+		 */
+		std::string matchProfile(const std::string& windowClass) const;
+
+		/**
+		 * @brief Check whether shortcuts follow the layout in a profile
+		 *
+		 * @param profileName Profile name from matchProfile()
+		 * @return true for "logical" shortcuts, false for "physical"
+		 */
+		bool translatesShortcuts(const std::string& profileName) const;
+
+		/**
+		 * @brief Get the keys the layout remaps in at least one layer
+		 *
+		 * Layer keys and keys whose cells are empty everywhere are not included;
+		 * those are forwarded as-is.
+		 *
+		 * @return std::vector<std::string> Key names (e.g., "key_a")
+		 */
+		std::vector<std::string> getRemappedKeys() const;
+
 		/**
 		 * @brief Handle key release events for layer management
 		 *
@@ -87,6 +246,20 @@ namespace keydrive {
 		 */
 		bool shouldForwardKey(bool shiftActive, bool ctrlActive, bool altActive, bool superActive) const;
 
+		/**
+		 * @brief Get the LEDs assigned to any layer (layer_keys "led:")
+		 *
+		 * @return unsigned int Bitmask of 1 << LED_* codes
+		 */
+		unsigned int getManagedLeds() const;
+
+		/**
+		 * @brief Get the LEDs of the effective layer
+		 *
+		 * @return unsigned int Bitmask of 1 << LED_* codes, a subset of getManagedLeds()
+		 */
+		unsigned int getActiveLeds() const;
+
 		/**
 		 * @brief Get the current layer state for debugging
 		 *
@@ -94,11 +267,35 @@ namespace keydrive {
 		 */
 		LayerState getLayerState() const;
 
+		/**
+		 * @brief Continue with layer state from another instance (handover)
+		 *
+		 * @param state Layer state to adopt
+		 */
+		void restoreLayerState(const LayerState& state);
+
 		/**
 		 * @brief Verify layer key configuration matches layout
 		 */
 		void verifyLayerKeys() const;
 
+		/**
+		 * @brief Get the abbreviations defined by the current layout
+		 *
+		 * @return const std::vector<Abbreviation>& Trigger/replacement pairs
+		 */
+		const std::vector<Abbreviation>& getAbbreviations() const;
+
+		/**
+		 * @brief Get the compiled tables of the active layout
+		 *
+		 * The tables stay valid for as long as the caller holds the pointer,
+		 * across reloads and layout switches.
+		 *
+		 * @return std::shared_ptr<const CompiledLayout> Immutable layout tables
+		 */
+		std::shared_ptr<const CompiledLayout> getCompiledLayout() const;
+
 	private:
 		// Configuration paths
 		std::string configDir;
@@ -106,11 +303,25 @@ namespace keydrive {
 		std::string stateFile;
 
 		// State management
+		/**
+		 * @brief Everything read from one layout file; immutable once loaded
+		 */
+		struct LoadedLayout {
+			std::string name;
+			std::shared_ptr<const CompiledLayout> tables;
+			std::unordered_map<std::string, LayerKeyConfig> layerKeys;
+			std::unordered_map<std::string, unsigned int> layerLeds;
+			unsigned int managedLeds = 0;
+			std::vector<std::string> toggleLayers;
+			bool translateShortcuts = true;
+			std::vector<Profile> profiles;
+			std::vector<Abbreviation> abbreviations;
+		};
+
 		std::unordered_map<std::string, std::string> state;
-		YAML::Node layout;
-		std::unordered_map<std::string, size_t> keyPositions;
+		std::map<std::string, std::shared_ptr<const LoadedLayout>> layouts;
+		std::shared_ptr<const LoadedLayout> active;
 		LayerState layerState;
-		std::unordered_map<std::string, LayerKeyConfig> layerKeys;
 
 		/**
 		 * @brief Load persistent state (active layout/layer)
@@ -123,21 +334,47 @@ namespace keydrive {
 		void saveState() const;
 
 		/**
-		 * @brief Load the current keyboard layout from YAML
+		 * @brief Load and compile every layout in the layouts directory
+		 *
+		 * @return std::unordered_map<std::string, std::string> Error per layout that failed
+		 */
+		std::unordered_map<std::string, std::string> preloadLayouts();
+
+		/**
+		 * @brief Make a loaded layout the active one, starting on the saved layer
+		 */
+		void activateLayout(std::shared_ptr<const LoadedLayout> layout);
+
+		/**
+		 * @brief Load a keyboard layout from YAML and compile it
+		 *
+		 * Touches no member state, so layouts can be loaded in parallel.
+		 *
+		 * @param layoutsDir Directory holding the .kbd files
+		 * @param name Layout name (file name without .kbd)
+		 * @throws std::runtime_error if the file is missing or invalid
 		 */
-		void loadLayout();
+		static std::shared_ptr<const LoadedLayout> loadLayoutFile(const std::string& layoutsDir, const std::string& name);
 
 		/**
 		 * @brief Determine if a key is a layer key and what layer it activates
 		 *
-		 * @param keyName The key name (e.g., "key_a")
+		 * @param layerKeys Layer keys configured by the layout
 		 * @param baseChar The character from the base layer
 		 * @return std::pair<bool, LayerKeyConfig> Whether it's a layer key and its config
 		 */
-		std::pair<bool, LayerKeyConfig> getLayerForKey(
-			const std::string& keyName,
+		static std::pair<bool, LayerKeyConfig> getLayerForKey(
+			const std::unordered_map<std::string, LayerKeyConfig>& layerKeys,
 			const std::string& baseChar
-		) const;
+		);
+
+		/**
+		 * @brief Build the lookup tables from the parsed layout file
+		 *
+		 * @param layout Layout file contents (source and layers already validated)
+		 * @param loaded Layout whose layer keys are parsed; receives the tables
+		 */
+		static void compileLayout(const YAML::Node& layout, LoadedLayout& loaded);
 
 		/**
 		 * @brief Clean up a character string (remove quotes, whitespace)
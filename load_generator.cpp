@@ -0,0 +1,584 @@
+#include "load_generator.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <linux/input.h>
+#include <libevdev/libevdev.h>
+
+namespace keydrive {
+
+	namespace {
+
+		// A step fails if fewer presses than this share of the requested ones got out
+		constexpr double MIN_ACHIEVED_SHARE = 0.9;
+
+		// A generator running this far behind skips ahead instead of bursting
+		constexpr auto MAX_LAG = std::chrono::milliseconds(100);
+
+		// A simulated overflow loses up to this many frames
+		constexpr int MAX_LOST_FRAMES = 8;
+
+		// How long the daemon gets to catch up after the last release
+		constexpr auto DRAIN_TIMEOUT = std::chrono::seconds(5);
+		constexpr auto DRAIN_POLL = std::chrono::milliseconds(50);
+
+		size_t countKeys(const KeySet& keys) {
+			size_t count = 0;
+			keys.forEach([&count](unsigned int) {
+				++count;
+			});
+			return count;
+		}
+
+		double parseNumber(const std::string& key, const std::string& value) {
+			try {
+				size_t used = 0;
+				double number = std::stod(value, &used);
+				if (used == value.size() && number >= 0) {
+					return number;
+				}
+			} catch (const std::exception&) {
+			}
+			throw std::runtime_error("Invalid value for " + key + ": " + value);
+		}
+
+		TextBackend parseBackend(const std::string& name) {
+			for (size_t backend = 0; backend < static_cast<size_t>(TextBackend::Count); ++backend) {
+				if (name == textBackendName(static_cast<TextBackend>(backend))) {
+					return static_cast<TextBackend>(backend);
+				}
+			}
+			throw std::runtime_error("Unknown backend: " + name);
+		}
+
+		// Stand in for a call that keeps the thread busy; sleeping would add
+		// the timer slack, which is larger than most of these costs
+		void spend(std::chrono::microseconds cost) {
+			auto until = std::chrono::steady_clock::now() + cost;
+			while (std::chrono::steady_clock::now() < until) {
+			}
+		}
+
+		size_t countCodePoints(const std::string& utf8) {
+			return static_cast<size_t>(std::count_if(utf8.begin(), utf8.end(),
+				[](char c) { return (static_cast<unsigned char>(c) & 0xC0) != 0x80; }));
+		}
+
+		std::string formatLatency(uint64_t micros) {
+			if (micros == UINT64_MAX) {
+				return "> " + std::to_string(LatencyHistogram::BOUNDS_US.back() / 1000) + " ms";
+			}
+			char buffer[32];
+			std::snprintf(buffer, sizeof(buffer), "%.2f ms", static_cast<double>(micros) / 1000.0);
+			return buffer;
+		}
+
+	} // anonymous namespace
+
+	bool OutputRecorder::write(const input_event* written, size_t count) {
+		++frames;
+		events += count;
+		for (size_t i = 0; i < count; ++i) {
+			if (written[i].type != EV_KEY || written[i].value == 2) {
+				continue;
+			}
+			if (written[i].value) {
+				if (keysDown.test(written[i].code)) {
+					++duplicatePresses;
+				}
+				keysDown.set(written[i].code);
+			} else {
+				keysDown.reset(written[i].code);
+			}
+		}
+		spend(costs.uinputWrite);
+		return true;
+	}
+
+	std::pair<int, std::string> OutputRecorder::run(const std::vector<std::string>& argv, int timeoutMs) {
+		++helperCalls;
+		if (backend == TextBackend::Uinput) {
+			// Key taps instead of a helper; the text is the last argument
+			if (!argv.empty()) {
+				spend(costs.uinputWrite * static_cast<long>(countCodePoints(argv.back())));
+			}
+			return {0, ""};
+		}
+		auto started = runProcess({"true"}, timeoutMs);
+		std::this_thread::sleep_for(costs.helperRun);
+		return started;
+	}
+
+	bool OutputRecorder::typeX11(const std::u32string& text) {
+		if (backend != TextBackend::XTest) {
+			return false;
+		}
+		x11Characters += text.size();
+		spend(costs.x11Character * static_cast<long>(text.size()));
+		return true;
+	}
+
+	bool OutputRecorder::hasXdotool() const {
+		return backend == TextBackend::Xdotool;
+	}
+
+	uint64_t OutputRecorder::getKeymapChanges() const {
+		// The modelled X server's keymap never changes
+		return 0;
+	}
+
+	std::string OutputRecorder::windowClass() const {
+		// XTest and xdotool type into X clients; see classifyWindow()
+		return backend == TextBackend::XTest || backend == TextBackend::Xdotool ? "code" : "loadgen";
+	}
+
+	LoadProfile parseLoadProfile(const std::vector<std::string>& options) {
+		LoadProfile profile;
+		for (const std::string& option : options) {
+			size_t equals = option.find('=');
+			if (equals == std::string::npos) {
+				throw std::runtime_error("Expected key=value: " + option);
+			}
+			std::string key = option.substr(0, equals);
+			std::string value = option.substr(equals + 1);
+
+			if (key == "rate") {
+				profile.startRate = parseNumber(key, value);
+			} else if (key == "max-rate") {
+				profile.maxRate = parseNumber(key, value);
+			} else if (key == "ramp") {
+				profile.rampFactor = parseNumber(key, value);
+			} else if (key == "step-ms") {
+				profile.stepDuration = std::chrono::milliseconds(static_cast<long>(parseNumber(key, value)));
+			} else if (key == "rollover") {
+				profile.rollover = static_cast<int>(parseNumber(key, value));
+			} else if (key == "layer-keys") {
+				profile.layerKeyRatio = parseNumber(key, value);
+			} else if (key == "unicode") {
+				profile.unicodeRatio = parseNumber(key, value);
+			} else if (key == "max-queue") {
+				profile.maxQueueDepth = static_cast<uint64_t>(parseNumber(key, value));
+			} else if (key == "p99-ms") {
+				profile.maxP99Us = static_cast<uint64_t>(parseNumber(key, value) * 1000.0);
+			} else if (key == "uinput-us") {
+				profile.costs.uinputWrite = std::chrono::microseconds(static_cast<long>(parseNumber(key, value)));
+			} else if (key == "xtest-us") {
+				profile.costs.x11Character = std::chrono::microseconds(static_cast<long>(parseNumber(key, value)));
+			} else if (key == "helper-us") {
+				profile.costs.helperRun = std::chrono::microseconds(static_cast<long>(parseNumber(key, value)));
+			} else if (key == "overflow") {
+				profile.overflowEvery = static_cast<uint64_t>(parseNumber(key, value));
+			} else if (key == "backends") {
+				profile.backends.clear();
+				std::istringstream names(value);
+				std::string name;
+				while (std::getline(names, name, ',')) {
+					profile.backends.push_back(parseBackend(name));
+				}
+			} else {
+				throw std::runtime_error("Unknown load generator option: " + key);
+			}
+		}
+
+		if (profile.startRate <= 0 || profile.maxRate < profile.startRate || profile.rampFactor <= 1.0) {
+			throw std::runtime_error("Need 0 < rate <= max-rate and ramp > 1");
+		}
+		if (profile.rollover < 1 || profile.stepDuration.count() <= 0) {
+			throw std::runtime_error("Need rollover >= 1 and step-ms > 0");
+		}
+		if (profile.layerKeyRatio + profile.unicodeRatio > 1.0) {
+			throw std::runtime_error("layer-keys and unicode add up to more than 1");
+		}
+		if (profile.backends.empty()) {
+			throw std::runtime_error("No backends to test");
+		}
+		return profile;
+	}
+
+	LoadGenerator::LoadGenerator(const LoadProfile& profile, TextBackend backend, const LayoutManager& layouts)
+		: profile(profile) {
+		result.backend = backend;
+		result.output.backend = backend;
+		result.output.costs = profile.costs;
+
+		// Sort the layout's keys by what they produce on the base layer
+		std::shared_ptr<const CompiledLayout> tables = layouts.getCompiledLayout();
+		std::optional<size_t> base = tables->findLayer("base");
+		for (size_t pos = 0; base && pos < tables->keyCount(); ++pos) {
+			std::string name(tables->getKeyName(pos));
+			std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::toupper(c); });
+			int code = libevdev_event_code_from_name(EV_KEY, name.c_str());
+			if (code < 0) {
+				continue;
+			}
+			Key key{static_cast<unsigned short>(code), false};
+
+			if (const CompiledLayout::LayerBinding* binding = tables->getLayerBinding(pos)) {
+				// Toggles and one-shots would persist state or outlive the run
+				if (binding->type == LayerType::Hold || binding->type == LayerType::TapHold) {
+					key.layerKey = true;
+					layerKeys.push_back(key);
+				}
+				continue;
+			}
+			const CompiledLayout::Cell& cell = tables->getCell(*base, pos);
+			if (cell.hasCharacter) {
+				(cell.character < 0x80 ? asciiKeys : unicodeKeys).push_back(key);
+			}
+		}
+		if (asciiKeys.empty() && unicodeKeys.empty()) {
+			throw std::runtime_error("Layout has no character keys to generate load with");
+		}
+
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+			throw std::runtime_error("Failed to create load generator socket: " + std::string(std::strerror(errno)));
+		}
+		generatorFd = fds[0];
+		inputFd = fds[1];
+	}
+
+	LoadGenerator::~LoadGenerator() {
+		stopping = true;
+		if (generator.joinable()) {
+			generator.join();
+		}
+		if (inputFd >= 0) {
+			close(inputFd);
+		}
+		close(generatorFd);
+	}
+
+	int LoadGenerator::takeInputFd() {
+		int fd = inputFd;
+		inputFd = -1;
+		return fd;
+	}
+
+	KeySet LoadGenerator::keyState() const {
+		KeySet keys;
+		for (size_t word = 0; word < keyBits.size(); ++word) {
+			uint64_t bits = keyBits[word].load(std::memory_order_acquire);
+			while (bits) {
+				unsigned int bit = static_cast<unsigned int>(__builtin_ctzll(bits));
+				keys.set(static_cast<unsigned int>(word * 64 + bit));
+				bits &= bits - 1;
+			}
+		}
+		return keys;
+	}
+
+	void LoadGenerator::start(Reactor& reactor, const KeyboardInput& keyboard, const LatencyHistogram& latency) {
+		this->reactor = &reactor;
+		this->keyboard = &keyboard;
+		this->latency = &latency;
+
+		stepTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (stepTimerFd < 0) {
+			throw std::runtime_error("Failed to create load step timer: " + std::string(std::strerror(errno)));
+		}
+		reactor.add(stepTimerFd, EPOLLIN, [this](uint32_t) {
+			uint64_t expirations;
+			while (read(stepTimerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+			}
+			if (draining) {
+				checkDrained();
+			} else {
+				endStep();
+			}
+		});
+
+		itimerspec spec{};
+		auto stepNs = std::chrono::duration_cast<std::chrono::nanoseconds>(profile.stepDuration).count();
+		spec.it_value.tv_sec = stepNs / 1000000000;
+		spec.it_value.tv_nsec = stepNs % 1000000000;
+		spec.it_interval = spec.it_value;
+		timerfd_settime(stepTimerFd, 0, &spec, nullptr);
+		stepStart = std::chrono::steady_clock::now();
+
+		stepBuckets.assign(LatencyHistogram::BOUNDS_US.size() + 1, 0);
+		for (size_t bucket = 0; bucket < stepBuckets.size(); ++bucket) {
+			stepBuckets[bucket] = latency.bucketCount(bucket);
+		}
+		rate = profile.startRate;
+		std::cout << std::dec << "📈 Load test on " << textBackendName(result.backend) << " from " << profile.startRate
+		<< " to " << profile.maxRate << " keys/s";
+		if (profile.overflowEvery > 0) {
+			std::cout << ", buffer overflow every " << profile.overflowEvery << " presses";
+		}
+		std::cout << std::endl;
+		generator = std::thread([this] {
+			run();
+		});
+	}
+
+	void LoadGenerator::run() {
+		std::vector<Key> held;
+		uint64_t nextOverflow = profile.overflowEvery;
+		auto next = std::chrono::steady_clock::now();
+		while (!stopping && !releasing) {
+			next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(1.0 / rate.load()));
+			auto now = std::chrono::steady_clock::now();
+			if (now - next > MAX_LAG) {
+				next = now;
+			}
+			std::this_thread::sleep_until(next);
+			pressNext(held);
+			if (profile.overflowEvery > 0 && presses.load() >= nextOverflow) {
+				simulateOverflow();
+				nextOverflow += profile.overflowEvery;
+			}
+
+			// LED updates come back through the socket; nothing to do with them
+			char discard[256];
+			while (recv(generatorFd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+			}
+		}
+		// Nothing lost from here on, so every key ends up released
+		framesToLose = 0;
+		for (const Key& key : held) {
+			writeKey(key.code, 0);
+		}
+	}
+
+	void LoadGenerator::simulateOverflow() {
+		// The kernel queues SYN_DROPPED in place of what it threw away; what
+		// follows up to the next SYN_REPORT is incomplete
+		input_event dropped{};
+		dropped.type = EV_SYN;
+		dropped.code = SYN_DROPPED;
+		writeFrame(&dropped, 1);
+		std::uniform_int_distribution<int> lost(1, MAX_LOST_FRAMES);
+		framesToLose = lost(random);
+		++overflows;
+	}
+
+	void LoadGenerator::pressNext(std::vector<Key>& held) {
+		// Choose the pool by the configured mix, then a key in it that isn't down
+		std::uniform_real_distribution<double> share(0.0, 1.0);
+		double roll = share(random);
+		const std::vector<Key>* pool = &asciiKeys;
+		if (roll < profile.layerKeyRatio && !layerKeys.empty()) {
+			pool = &layerKeys;
+		} else if (roll < profile.layerKeyRatio + profile.unicodeRatio && !unicodeKeys.empty()) {
+			pool = &unicodeKeys;
+		}
+		if (pool->empty()) {
+			pool = asciiKeys.empty() ? &unicodeKeys : &asciiKeys;
+		}
+
+		std::uniform_int_distribution<size_t> pick(0, pool->size() - 1);
+		auto isHeld = [&held](const Key& candidate) {
+			return std::any_of(held.begin(), held.end(), [&](const Key& down) {
+				return down.code == candidate.code;
+			});
+		};
+		Key key = (*pool)[pick(random)];
+		for (int attempt = 0; isHeld(key); ++attempt) {
+			if (attempt == 8) {
+				return;
+			}
+			key = (*pool)[pick(random)];
+		}
+
+		writeKey(key.code, 1);
+		held.push_back(key);
+		++presses;
+		if (held.size() > static_cast<size_t>(profile.rollover)) {
+			writeKey(held.front().code, 0);
+			held.erase(held.begin());
+		}
+	}
+
+	void LoadGenerator::writeKey(unsigned short code, int value) {
+		// The state changes before the frame is sent, as in the kernel, where
+		// EVIOCGKEY already has events still waiting to be read
+		uint64_t bit = uint64_t{1} << (code % 64);
+		if (value) {
+			keyBits[code / 64].fetch_or(bit, std::memory_order_release);
+		} else {
+			keyBits[code / 64].fetch_and(~bit, std::memory_order_release);
+		}
+		if (framesToLose > 0) {
+			--framesToLose;
+			return;
+		}
+
+		// Timestamps stay zero; the input thread stamps events when it reads them
+		input_event frame[2]{};
+		frame[0].type = EV_KEY;
+		frame[0].code = code;
+		frame[0].value = value;
+		frame[1].type = EV_SYN;
+		frame[1].code = SYN_REPORT;
+		writeFrame(frame, 2);
+	}
+
+	void LoadGenerator::writeFrame(const input_event* events, size_t count) {
+		// Blocks when the input thread falls behind, which shows as a lower achieved rate
+		const char* data = reinterpret_cast<const char*>(events);
+		size_t remaining = count * sizeof(input_event);
+		while (remaining > 0 && !stopping) {
+			ssize_t written = send(generatorFd, data, remaining, MSG_NOSIGNAL);
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				std::cerr << "⚠ Load generator write failed: " << std::strerror(errno) << std::endl;
+				stopping = true;
+				return;
+			}
+			data += written;
+			remaining -= static_cast<size_t>(written);
+		}
+	}
+
+	void LoadGenerator::endStep() {
+		LoadStep step;
+		step.rate = rate.load();
+
+		// The timer fires late when the main loop is saturated; divide by the real step length
+		auto now = std::chrono::steady_clock::now();
+		uint64_t total = presses.load();
+		double seconds = std::chrono::duration<double>(now - stepStart).count();
+		step.achievedRate = static_cast<double>(total - stepPresses) / seconds;
+		stepPresses = total;
+		stepStart = now;
+
+		// Latency of this step only: the histogram's counters minus the previous snapshot
+		std::vector<uint64_t> counts(stepBuckets.size());
+		uint64_t events = 0;
+		for (size_t bucket = 0; bucket < stepBuckets.size(); ++bucket) {
+			uint64_t count = latency->bucketCount(bucket);
+			counts[bucket] = count - stepBuckets[bucket];
+			stepBuckets[bucket] = count;
+			events += counts[bucket];
+		}
+		uint64_t target = (events * 99 + 99) / 100;
+		uint64_t seen = 0;
+		for (size_t bucket = 0; bucket < counts.size() && events > 0; ++bucket) {
+			seen += counts[bucket];
+			if (seen >= target) {
+				step.p99Us = bucket < LatencyHistogram::BOUNDS_US.size() ? LatencyHistogram::BOUNDS_US[bucket] : UINT64_MAX;
+				break;
+			}
+		}
+
+		step.queueDepth = keyboard->getMetrics().queueDepth.get();
+		step.withinSlo = step.p99Us <= profile.maxP99Us
+			&& step.queueDepth <= profile.maxQueueDepth
+			&& step.achievedRate >= step.rate * MIN_ACHIEVED_SHARE;
+		result.steps.push_back(step);
+
+		std::cout << std::dec << "📈 " << textBackendName(result.backend) << ": " << static_cast<int>(step.rate) << " keys/s → "
+		<< static_cast<int>(step.achievedRate) << "/s, p99 ≤ " << formatLatency(step.p99Us)
+		<< ", queue " << step.queueDepth << (step.withinSlo ? " ✅" : " ❌") << std::endl;
+
+		if (!step.withinSlo) {
+			finish(true);
+			return;
+		}
+		result.saturationRate = step.rate;
+		if (step.rate >= profile.maxRate) {
+			finish(false);
+			return;
+		}
+		rate = std::min(profile.maxRate, step.rate * profile.rampFactor);
+	}
+
+	void LoadGenerator::stop() {
+		stopping = true;
+		if (generator.joinable()) {
+			generator.join();
+		}
+		if (stepTimerFd >= 0) {
+			reactor->remove(stepTimerFd);
+			close(stepTimerFd);
+			stepTimerFd = -1;
+		}
+	}
+
+	void LoadGenerator::finish(bool saturated) {
+		result.saturated = saturated;
+		result.finished = true;
+
+		// Release everything, then poll until the daemon has caught up
+		releasing = true;
+		if (generator.joinable()) {
+			generator.join();
+		}
+		result.overflows = overflows.load();
+		draining = true;
+		drainDeadline = std::chrono::steady_clock::now() + DRAIN_TIMEOUT;
+		itimerspec spec{};
+		auto pollNs = std::chrono::duration_cast<std::chrono::nanoseconds>(DRAIN_POLL).count();
+		spec.it_value.tv_nsec = pollNs;
+		spec.it_interval = spec.it_value;
+		timerfd_settime(stepTimerFd, 0, &spec, nullptr);
+	}
+
+	void LoadGenerator::checkDrained() {
+		// The input thread is idle once its held keys match ours (all released)
+		KeySet daemonHeld = keyboard->getHeldKeys();
+		bool settled = daemonHeld.empty() && result.output.keysDown.empty();
+		if (!settled && std::chrono::steady_clock::now() < drainDeadline) {
+			return;
+		}
+		KeySet stuck = daemonHeld;
+		result.output.keysDown.forEach([&stuck](unsigned int code) {
+			stuck.set(code);
+		});
+		result.stuckKeys = countKeys(stuck);
+		result.redundantEdges = keyboard->getMetrics().redundantEdges.get();
+		stop();
+		reactor->stop();
+	}
+
+	bool printLoadReport(const LoadProfile& profile, const std::vector<LoadResult>& results) {
+		std::cout << std::dec << "\n📊 Saturation (rollover " << profile.rollover
+		<< ", " << static_cast<int>(profile.layerKeyRatio * 100) << "% layer keys, "
+		<< static_cast<int>(profile.unicodeRatio * 100) << "% Unicode; limits: p99 ≤ "
+		<< formatLatency(profile.maxP99Us) << ", queue ≤ " << profile.maxQueueDepth << ")" << std::endl;
+
+		bool allConsistent = true;
+		for (const LoadResult& result : results) {
+			std::cout << "  " << textBackendName(result.backend) << ": ";
+			if (!result.finished) {
+				std::cout << "interrupted" << std::endl;
+				continue;
+			}
+			if (!result.saturated) {
+				std::cout << "kept up to " << static_cast<int>(result.saturationRate) << " keys/s (maximum tested)";
+			} else if (result.saturationRate > 0) {
+				const LoadStep& broken = result.steps.back();
+				std::cout << "keeps up to " << static_cast<int>(result.saturationRate) << " keys/s; at "
+				<< static_cast<int>(broken.rate) << " keys/s: " << static_cast<int>(broken.achievedRate)
+				<< "/s, p99 ≤ " << formatLatency(broken.p99Us) << ", queue " << broken.queueDepth;
+			} else {
+				std::cout << "falls behind already at " << static_cast<int>(profile.startRate) << " keys/s";
+			}
+			std::cout << " (" << result.output.frames << " uinput writes, "
+			<< result.output.helperCalls << " helper calls, "
+			<< result.output.x11Characters << " XTest characters)" << std::endl;
+
+			bool consistent = result.consistent();
+			allConsistent = allConsistent && consistent;
+			std::cout << "    " << (consistent ? "✅ " : "❌ ") << result.overflows << " overflows, "
+			<< result.stuckKeys << " stuck keys, " << result.redundantEdges << " redundant input edges, "
+			<< result.output.duplicatePresses << " duplicate output presses" << std::endl;
+		}
+		return allConsistent;
+	}
+
+} // namespace keydrive
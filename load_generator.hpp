@@ -0,0 +1,244 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "reactor.hpp"
+#include "metrics.hpp"
+#include "output_handler.hpp"
+#include "layout_manager.hpp"
+#include "input_handler.hpp"
+
+namespace keydrive {
+
+	/**
+	 * @brief Modelled time the desktop side of each output takes
+	 *
+	 * The defaults are rough figures for a desktop machine; measure your own
+	 * (e.g., strace -T on the daemon) and pass them as options.
+	 */
+	struct OutputCosts {
+		std::chrono::microseconds uinputWrite{10};     // One write() to the virtual keyboard
+		std::chrono::microseconds x11Character{15};    // Press and release through XTest
+		std::chrono::microseconds helperRun{2000};     // A helper's own work after it started
+	};
+
+	/**
+	 * @brief Output sink for load tests: counts what would reach the desktop
+	 * and charges what it would cost
+	 *
+	 * uinput writes and XTest characters busy-wait for their modelled cost, as
+	 * the calls they stand in for keep the main thread busy. Helper calls
+	 * start /bin/true, a real process start, then wait for the helper's run
+	 * time. With the Uinput backend text is charged as one key tap per
+	 * character instead, as if every character had a key.
+	 */
+	struct OutputRecorder : OutputSink {
+		TextBackend backend = TextBackend::Wtype;  // Backend text would go through
+		OutputCosts costs;
+		uint64_t frames = 0;        // uinput writes
+		uint64_t events = 0;        // Events in those writes
+		uint64_t helperCalls = 0;   // Helper processes that would have run
+		uint64_t x11Characters = 0; // Characters typed through XTest
+		KeySet keysDown;            // Keys pressed on the virtual keyboard and not released
+		uint64_t duplicatePresses = 0;  // Presses of keys already down there
+
+		bool write(const input_event* events, size_t count) override;
+		std::pair<int, std::string> run(const std::vector<std::string>& argv, int timeoutMs) override;
+		bool typeX11(const std::u32string& text) override;
+		bool hasXdotool() const override;
+		uint64_t getKeymapChanges() const override;
+
+		/**
+		 * @brief Class of the window typed into; OutputHandler routes it to the backend
+		 */
+		std::string windowClass() const;
+	};
+
+	/**
+	 * @brief Shape of the generated typing and the limits it is held to
+	 */
+	struct LoadProfile {
+		double startRate = 10.0;       // Key presses per second at the first step
+		double maxRate = 1000.0;       // Stop ramping here
+		double rampFactor = 1.25;      // Rate multiplier from one step to the next
+		std::chrono::milliseconds stepDuration{2000};
+		int rollover = 2;              // Keys held down at once
+		double layerKeyRatio = 0.05;   // Share of presses on hold layer keys
+		double unicodeRatio = 0.3;     // Share of presses on keys typing non-ASCII text
+		uint64_t maxQueueDepth = 64;   // SLO: events waiting for the main loop
+		uint64_t maxP99Us = 25000;     // SLO: p99 event latency
+		uint64_t overflowEvery = 0;    // Presses between simulated kernel buffer overflows (0: none)
+		OutputCosts costs;
+		std::vector<TextBackend> backends{TextBackend::Uinput, TextBackend::Wtype, TextBackend::Xdotool};
+	};
+
+	/**
+	 * @brief Parse load generator options ("rate=50", "backends=wtype,xdotool", ...)
+	 *
+	 * @throws std::runtime_error for unknown options or invalid values
+	 */
+	LoadProfile parseLoadProfile(const std::vector<std::string>& options);
+
+	/**
+	 * @brief Measurements of one rate step
+	 */
+	struct LoadStep {
+		double rate = 0;            // Requested key presses per second
+		double achievedRate = 0;    // Presses actually written
+		uint64_t p99Us = 0;         // Upper bucket bound of the p99 latency (UINT64_MAX: above all buckets)
+		uint64_t queueDepth = 0;    // Queue high-water mark so far
+		bool withinSlo = false;
+	};
+
+	/**
+	 * @brief Outcome of ramping one output backend
+	 */
+	struct LoadResult {
+		TextBackend backend = TextBackend::Uinput;
+		std::vector<LoadStep> steps;
+		double saturationRate = 0;  // Highest rate that met the SLOs
+		bool saturated = false;     // An SLO broke before the maximum rate
+		bool finished = false;      // False if the run was interrupted
+		uint64_t overflows = 0;     // Simulated SYN_DROPPED overflows
+		uint64_t stuckKeys = 0;     // Keys still down after everything was released
+		uint64_t redundantEdges = 0;  // Presses of held keys and releases of released ones the daemon saw
+		OutputRecorder output;      // What reached the recording sink
+
+		/**
+		 * @brief Check that the run ended with no key stuck or pressed twice
+		 */
+		bool consistent() const {
+			return stuckKeys == 0 && redundantEdges == 0 && output.duplicatePresses == 0;
+		}
+	};
+
+	/**
+	 * @brief Feeds generated key events through the daemon and finds where it falls behind
+	 *
+	 * Events are written as input_event records into a socket pair; the daemon
+	 * reads the other end through KeyboardInput like a keyboard, so they take
+	 * the real input thread, layout and output path into a recording sink.
+	 * The rate steps up until the queue depth, the p99 latency or the achieved
+	 * rate breaks its limit.
+	 *
+	 * With overflowEvery set, the generator also plays a kernel buffer
+	 * overflow now and then: it sends SYN_DROPPED and loses the next few
+	 * frames, and answers the daemon's key state query like EVIOCGKEY would.
+	 * At the end all keys are released; any key the daemon or the virtual
+	 * keyboard still holds is stuck, and any edge that doesn't change a
+	 * key's state was duplicated.
+	 */
+	class LoadGenerator {
+	public:
+		/**
+		 * @brief Pick the keys to type from the active layout
+		 *
+		 * @throws std::runtime_error if the socket pair cannot be created or the layout has no usable keys
+		 */
+		LoadGenerator(const LoadProfile& profile, TextBackend backend, const LayoutManager& layouts);
+		~LoadGenerator();
+
+		LoadGenerator(const LoadGenerator&) = delete;
+		LoadGenerator& operator=(const LoadGenerator&) = delete;
+
+		/**
+		 * @brief Hand out the daemon's end of the event stream (for KeyboardInput)
+		 */
+		int takeInputFd();
+
+		/**
+		 * @brief Keys down as far as the generator is concerned (lost frames included)
+		 *
+		 * Answers the daemon's resync like EVIOCGKEY: events still in the
+		 * socket are already part of it.
+		 */
+		KeySet keyState() const;
+
+		/**
+		 * @brief Sink the daemon's OutputHandler records into
+		 */
+		OutputRecorder& getRecorder() {
+			return result.output;
+		}
+
+		/**
+		 * @brief Start typing and ramping; stops the reactor when done
+		 *
+		 * @param reactor The daemon's reactor (runs the step timer)
+		 * @param keyboard The daemon's input (queue depth, held keys, redundant edges)
+		 * @param latency Event latency histogram filled by the main loop
+		 * @throws std::runtime_error if the step timer cannot be created
+		 */
+		void start(Reactor& reactor, const KeyboardInput& keyboard, const LatencyHistogram& latency);
+
+		/**
+		 * @brief Stop typing and unregister from the reactor; call before the reactor goes away
+		 */
+		void stop();
+
+		const LoadResult& getResult() const {
+			return result;
+		}
+
+	private:
+		struct Key {
+			unsigned short code;
+			bool layerKey;
+		};
+
+		void run();
+		void pressNext(std::vector<Key>& held);
+		void writeKey(unsigned short code, int value);
+		void writeFrame(const input_event* events, size_t count);
+		void simulateOverflow();
+		void endStep();
+		void finish(bool saturated);
+		void checkDrained();
+
+		LoadProfile profile;
+		LoadResult result;
+		std::vector<Key> asciiKeys;
+		std::vector<Key> unicodeKeys;
+		std::vector<Key> layerKeys;
+		std::mt19937 random{42};
+
+		int generatorFd = -1;
+		int inputFd = -1;
+		int stepTimerFd = -1;
+		Reactor* reactor = nullptr;
+		const KeyboardInput* keyboard = nullptr;
+		const LatencyHistogram* latency = nullptr;
+
+		std::thread generator;
+		std::atomic<bool> stopping{false};
+		std::atomic<bool> releasing{false};  // Let go of all keys and stop typing
+		std::array<std::atomic<uint64_t>, KeySet::WORDS> keyBits{};
+		int framesToLose = 0;  // Generator thread: frames the simulated overflow still swallows
+		std::atomic<uint64_t> overflows{0};
+
+		// Set once the run is over and the daemon is catching up
+		bool draining = false;
+		std::chrono::steady_clock::time_point drainDeadline;
+		std::atomic<double> rate{0};
+		std::atomic<uint64_t> presses{0};
+
+		// Step bookkeeping on the main thread
+		uint64_t stepPresses = 0;
+		std::chrono::steady_clock::time_point stepStart;
+		std::vector<uint64_t> stepBuckets;
+	};
+
+	/**
+	 * @brief Print the saturation point of every backend
+	 *
+	 * @return true if every finished run ended with consistent key state
+	 */
+	bool printLoadReport(const LoadProfile& profile, const std::vector<LoadResult>& results);
+
+} // namespace keydrive
@@ -1,183 +1,831 @@
 #include "input_handler.hpp"
 #include "output_handler.hpp"
 #include "layout_manager.hpp"
+#include "reactor.hpp"
+#include "handover.hpp"
+#include "guardian.hpp"
+#include "status_page.hpp"
+#include "control_server.hpp"
+#include "mouse_keys.hpp"
+#include "shortcut_table.hpp"
+#include "window_context.hpp"
+#include "tap_hold.hpp"
+#include "load_generator.hpp"
 #include <iostream>
+#include <algorithm>
 #include <thread>
 #include <csignal>
 #include <atomic>
 #include <chrono>
 #include <vector>
 #include <optional>
+#include <functional>
+#include <memory>
+#include <array>
+#include <future>
+#include <cstdio>
+#include <string>
+#include <sys/epoll.h>
 
 namespace keydrive {
 
-    // Global flag for clean shutdown
-    std::atomic<bool> running{true};
+    namespace {
 
-    // Signal handler for Ctrl+C
-    void signalHandler(int signal) {
-        if (signal == SIGINT) {
+        double msBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+            return std::chrono::duration<double, std::milli>(to - from).count();
+        }
+
+        std::string formatMs(double ms) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.1f ms", ms);
+            return buffer;
+        }
+
+    } // anonymous namespace
+
+    // The daemon proper; runs directly or in a child of the crash guardian.
+    // Without a preloaded layout manager the layouts are compiled here, in
+    // parallel with device discovery and uinput creation. With a load generator
+    // it reads generated events and records its output instead of using devices.
+    int runDaemon(std::optional<LayoutManager>& preloadedLayouts, bool takeover, LoadGenerator* loadgen = nullptr) {
+        auto startedAt = std::chrono::steady_clock::now();
+
+        // Route SIGINT/SIGTERM/SIGHUP through a signalfd. This must happen before
+        // KeyboardInput starts its thread so the thread inherits the blocked mask.
+        keydrive::Reactor reactor;
+        std::function<void()> reloadLayout;
+        std::function<std::string(const std::string&)> switchLayout;
+        std::function<void(const std::string&, int, bool)> resolveTapHold;
+        reactor.addSignals({SIGINT, SIGTERM, SIGHUP}, [&](int signal) {
+            if (signal == SIGHUP) {
+                if (reloadLayout) {
+                    reloadLayout();
+                }
+                return;
+            }
             std::cout << "\n👋 Shutting down..." << std::endl;
-            running = false;
+            reactor.stop();
+        });
+
+        // Layouts compile on a worker while this thread finds the keyboard and
+        // creates the virtual keyboard; it starts only now so it inherits the
+        // blocked signal mask
+        double layoutsMs = 0;
+        std::future<void> layoutsReady;
+        if (!preloadedLayouts) {
+            layoutsReady = std::async(std::launch::async, [&]() {
+                auto begin = std::chrono::steady_clock::now();
+                preloadedLayouts.emplace();
+                layoutsMs = msBetween(begin, std::chrono::steady_clock::now());
+            });
+            if (takeover) {
+                // The old instance stops reading as soon as we ask, so be ready first
+                layoutsReady.get();
+            }
         }
-    }
 
-} // namespace keydrive
+        std::optional<keydrive::HandoverState> handover;
+        if (takeover) {
+            handover = keydrive::requestHandover(keydrive::defaultHandoverSocketPath());
+            if (!handover) {
+                std::cerr << "❌ Takeover failed, is keydrive running?" << std::endl;
+                return 1;
+            }
+        }
+
+        // Find the keyboard meanwhile, but leave it to the user until we are ready
+        auto discoveryStart = std::chrono::steady_clock::now();
+        keydrive::KeyboardInput keyboard = loadgen
+            ? keydrive::KeyboardInput(loadgen->takeInputFd(), std::string("keydrive load generator"),
+                [loadgen]() { return loadgen->keyState(); })
+            : handover
+            ? keydrive::KeyboardInput(handover->inputFd, handover->heldKeys)
+            : keydrive::KeyboardInput(false);
+        double discoveryMs = msBetween(discoveryStart, std::chrono::steady_clock::now());
+
+        // The virtual keyboard copies the keyboard's capabilities, so it follows
+        // discovery; layouts may still be loading. A handed-over device is kept
+        // as it is, so restarts don't make the compositor set up a new one.
+        auto uinputStart = std::chrono::steady_clock::now();
+        std::unique_ptr<keydrive::OutputHandler> outputHandler = loadgen
+            ? std::make_unique<keydrive::OutputHandler>(loadgen->getRecorder())
+            : handover
+            ? std::make_unique<keydrive::OutputHandler>(handover->outputFd)
+            : std::make_unique<keydrive::OutputHandler>(keyboard.getDevice());
+        double uinputMs = msBetween(uinputStart, std::chrono::steady_clock::now());
+        keydrive::OutputHandler& output = *outputHandler;
+        // On io_uring, key events go out with the loop's next wait
+        output.writeThrough(&reactor);
+        if (layoutsReady.valid()) {
+            layoutsReady.get();
+        }
+        keydrive::LayoutManager& layoutManager = *preloadedLayouts;
+        auto phasesDone = std::chrono::steady_clock::now();
+
+        if (handover) {
+            if (handover->layout != layoutManager.getLayoutName()) {
+                try {
+                    layoutManager.selectLayout(handover->layout);
+                } catch (const std::exception& e) {
+                    std::cerr << "⚠ Could not restore layout " << handover->layout << ": " << e.what() << std::endl;
+                }
+            }
+            layoutManager.restoreLayerState(handover->layerState);
+        }
+        output.setAbbreviations(layoutManager.getAbbreviations());
+        keyboard.setRepeatKeys(layoutManager.getRemappedKeys());
+
+        // Pointer motion, scrolling and buttons from ms_*/wh_*/btn_* layer cells
+        keydrive::MouseKeys mouseKeys(reactor, output);
+
+        // Dual-role keys (layer type "taphold") wait here until they are a tap or a hold
+        keydrive::TapHold tapHold(reactor, [&](const std::string& keyName, int keyCode, bool hold) {
+            resolveTapHold(keyName, keyCode, hold);
+        });
+
+        // Per-device settings (devices.yaml): debounce for chattering switches
+        // and how far repeats may run ahead of slow output
+        auto applyDeviceSettings = [&]() {
+            keyboard.setRepeatBacklogLimit(layoutManager.getRepeatBacklogLimit(keyboard.getDeviceName()));
+            int debounceMs = layoutManager.getDebounceMs(keyboard.getDeviceName());
+            keyboard.setDebounce(std::chrono::milliseconds(debounceMs));
+            if (debounceMs > 0) {
+                std::cout << "⏱ Debouncing " << keyboard.getDeviceName() << " with " << debounceMs << "ms window" << std::endl;
+            }
+        };
+        applyDeviceSettings();
+
+        // Listen for a newer instance that wants to take over our devices.
+        // Load tests leave the sockets and the status page to a running instance.
+        std::unique_ptr<keydrive::HandoverServer> handoverServer;
+        bool handedOver = false;
+        if (!loadgen) {
+            try {
+                handoverServer = std::make_unique<keydrive::HandoverServer>(keydrive::defaultHandoverSocketPath());
+            } catch (const std::exception& e) {
+                std::cerr << "⚠ Zero-downtime restart unavailable: " << e.what() << std::endl;
+            }
+        }
+
+        // Status page for status bars; readers poll it without talking to us
+        std::unique_ptr<keydrive::StatusPage> statusPage;
+        if (!loadgen) {
+            try {
+                statusPage = std::make_unique<keydrive::StatusPage>();
+            } catch (const std::exception& e) {
+                std::cerr << "⚠ Status page unavailable: " << e.what() << std::endl;
+            }
+        }
+        keydrive::StatusCounters counters;
+        bool remappingPaused = false;
+        std::string activeProfile = "default";
+
+        // Main-thread metrics; the input and output handlers keep their own
+        keydrive::Counter remappedKeys;
+        keydrive::LatencyHistogram eventLatency;
+        auto renderMetrics = [&]() {
+            const keydrive::InputMetrics& input = keyboard.getMetrics();
+            const keydrive::OutputMetrics& out = output.getMetrics();
+            keydrive::MetricsWriter writer;
+            writer.counter("keydrive_events_read_total", "evdev events read from the keyboard", input.eventsRead.get());
+            writer.counter("keydrive_syn_dropped_total", "Kernel input buffer overflows (SYN_DROPPED)", input.synDropped.get());
+            writer.counter("keydrive_key_edges_redundant_total", "Presses of held keys and releases of keys not held", input.redundantEdges.get());
+            writer.gauge("keydrive_queue_depth_max", "Most input events waiting for the main loop at once", input.queueDepth.get());
+            writer.counter("keydrive_bounces_suppressed_total", "Key edges suppressed by debouncing", keyboard.getSuppressedBounces());
+            writer.counter("keydrive_keys_forwarded_total", "Key events forwarded unchanged", out.forwarded.get());
+            writer.counter("keydrive_keys_remapped_total", "Key presses and repeats handled by the layout", remappedKeys.get());
+            writer.family("keydrive_characters_emitted_total", "counter", "Characters sent, by backend");
+            for (size_t backend = 0; backend < out.charactersEmitted.size(); ++backend) {
+                writer.sample("keydrive_characters_emitted_total",
+                    std::string("backend=\"") + keydrive::textBackendName(static_cast<keydrive::TextBackend>(backend)) + "\"",
+                    out.charactersEmitted[backend].get());
+            }
+            writer.counter("keydrive_helper_spawn_failures_total", "Helper processes that could not be started",
+                keydrive::OutputHandler::getHelperSpawnFailures());
+            tapHold.writeMetrics(writer);
+            writer.histogram("keydrive_event_latency_seconds", "Time from reading a key event to finishing its handling", eventLatency);
+            return writer.str() + "# EOF";
+        };
+
+        // Control socket; subscribers get a line for each change pushed below
+        std::unique_ptr<keydrive::ControlServer> controlServer;
+        auto startControlServer = [&]() {
+            try {
+                controlServer = std::make_unique<keydrive::ControlServer>(reactor, keydrive::defaultControlSocketPath(),
+                    [&](const std::string& command, const std::string& args) -> std::string {
+                        if (command == "status") {
+                            return "layout " + layoutManager.getLayoutName()
+                                + " profile " + activeProfile
+                                + " layer " + layoutManager.getCurrentLayer()
+                                + " paused " + (remappingPaused ? "1" : "0");
+                        }
+                        if (command == "metrics") {
+                            return renderMetrics();
+                        }
+                        if (command == "layouts") {
+                            std::string reply = "layouts";
+                            for (const std::string& name : layoutManager.listLayouts()) {
+                                reply += " " + name;
+                            }
+                            return reply;
+                        }
+                        if (command == "layout") {
+                            // "layout <name>" selects, "layout next" cycles
+                            if (args.empty()) {
+                                return "error usage: layout <name>|next";
+                            }
+                            return "ok layout " + switchLayout(args);
+                        }
+                        return "error unknown command " + command;
+                    });
+            } catch (const std::exception& e) {
+                std::cerr << "⚠ Control socket unavailable: " << e.what() << std::endl;
+            }
+        };
+        if (!loadgen) {
+            startControlServer();
+        }
+
+        std::string lastLayer;
+        std::string lastLayout;
+        std::string lastProfile;
+        bool lastPaused = false;
+        unsigned int lastManagedLeds = 0;
+        auto publishStatus = [&]() {
+            keydrive::LayerState layerState = layoutManager.getLayerState();
+            // LayerState::current is the saved base layer; publish the effective one
+            layerState.current = layoutManager.getCurrentLayer();
+            std::string layout = layoutManager.getLayoutName();
+            const std::string& profile = activeProfile;
+
+            // Layer LEDs; a new layout may stop using some, so those are switched off too
+            unsigned int managedLeds = layoutManager.getManagedLeds();
+            if (layerState.current != lastLayer || layout != lastLayout || managedLeds != lastManagedLeds) {
+                keyboard.setLeds(managedLeds | lastManagedLeds, layoutManager.getActiveLeds());
+                lastManagedLeds = managedLeds;
+            }
+
+            if (statusPage) {
+                counters.suppressedBounces = keyboard.getSuppressedBounces();
+                statusPage->publish(layout, profile, layerState, counters, remappingPaused);
+            }
+            if (controlServer) {
+                if (layout != lastLayout) {
+                    controlServer->publish("layout " + layout);
+                }
+                if (profile != lastProfile) {
+                    controlServer->publish("profile " + profile);
+                }
+                if (layerState.current != lastLayer) {
+                    controlServer->publish("layer " + layerState.current);
+                }
+                if (remappingPaused != lastPaused) {
+                    controlServer->publish(std::string("paused ") + (remappingPaused ? "1" : "0"));
+                }
+            }
+            lastLayout = layout;
+            lastProfile = profile;
+            lastLayer = layerState.current;
+            lastPaused = remappingPaused;
+        };
+
+        // Shortcut tables: logical (per the layout's base characters) or physical.
+        // Compiled on layout changes; a focus change only swaps the pointer.
+        keydrive::ShortcutTable logicalShortcuts;
+        const keydrive::ShortcutTable identityShortcuts;
+        const keydrive::ShortcutTable* activeShortcuts = &identityShortcuts;
+        std::string windowClass;
+        auto selectProfile = [&]() {
+            activeProfile = layoutManager.matchProfile(windowClass);
+            activeShortcuts = layoutManager.translatesShortcuts(activeProfile) ? &logicalShortcuts : &identityShortcuts;
+        };
+        auto refreshShortcuts = [&]() {
+            logicalShortcuts = keydrive::ShortcutTable::compile(layoutManager.getBaseCharacters());
+            selectProfile();
+        };
+
+        keydrive::WindowContext windowContext(reactor, [&](const std::optional<std::string>& newClass) {
+            windowClass = newClass.value_or("");
+            if (!loadgen) {
+                output.setWindowClass(newClass);
+            }
+            std::string previous = activeProfile;
+            selectProfile();
+            if (activeProfile != previous) {
+                std::cout << "🪟 Profile " << activeProfile << " (" << windowClass << ")" << std::endl;
+                publishStatus();
+            }
+        });
+        windowClass = windowContext.getWindowClass();
+        if (loadgen) {
+            // Generated text goes to a window the backend under test serves
+            output.setWindowClass(loadgen->getRecorder().windowClass());
+        } else if (windowContext.isActive()) {
+            // Characters are then routed by the pushed class, without hyprctl
+            output.setWindowClass(windowClass);
+        }
+        refreshShortcuts();
+
+        // SIGHUP: re-read state and layout; keep the current one if the new file is broken
+        reloadLayout = [&]() {
+            try {
+                layoutManager.reload();
+                tapHold.cancel();
+                output.setAbbreviations(layoutManager.getAbbreviations());
+                output.invalidateRoutes();
+                keyboard.setRepeatKeys(layoutManager.getRemappedKeys());
+                applyDeviceSettings();
+                refreshShortcuts();
+                ++counters.layoutChanges;
+                publishStatus();
+                std::cout << "🔄 Layout reloaded" << std::endl;
+            } catch (const std::exception& e) {
+                std::cerr << "⚠ Layout reload failed, keeping current layout: " << e.what() << std::endl;
+            }
+        };
+
+        // Layouts are preloaded, so a switch swaps the active one and refreshes
+        // what is derived from it; throws if the layout cannot be loaded
+        switchLayout = [&](const std::string& name) {
+            if (name == "next") {
+                layoutManager.cycleLayout();
+            } else {
+                layoutManager.selectLayout(name);
+            }
+            tapHold.cancel();
+            output.setAbbreviations(layoutManager.getAbbreviations());
+            output.invalidateRoutes();
+            keyboard.setRepeatKeys(layoutManager.getRemappedKeys());
+            refreshShortcuts();
+            ++counters.layoutChanges;
+            publishStatus();
+            std::cout << "🔀 Switched to layout " << layoutManager.getLayoutName() << std::endl;
+            return layoutManager.getLayoutName();
+        };
+
+        // A hold turns the key into a hold layer key; a tap types its character
+        resolveTapHold = [&](const std::string& keyName, int keyCode, bool hold) {
+            if (hold) {
+                layoutManager.processKeyEvent(keyName, keyCode, "press");
+                publishStatus();
+                return;
+            }
+            if (auto tapHoldKey = layoutManager.getTapHold(keyName)) {
+                if (output.sendUnicode(tapHoldKey->tapCharacter)) {
+                    ++counters.charactersSent;
+                } else {
+                    std::cerr << "❌ Failed to send tap of " << keyName << std::endl;
+                }
+            }
+        };
+
+        // Keys currently forwarded as-is (pressed while bypassed, paused or unmapped)
+        keydrive::KeySet forwardedKeys;
+        // Code each forwarded key was pressed as, so its release matches even if
+        // the layout or profile changed in between
+        std::array<uint16_t, KEY_CNT> forwardedAs;
+        for (unsigned int code = 0; code < KEY_CNT; ++code) {
+            forwardedAs[code] = static_cast<uint16_t>(code);
+        }
+        if (handover) {
+            // We can't tell which held keys the old instance forwarded; releasing
+            // the others too is harmless, a stuck key is not
+            forwardedKeys = handover->heldKeys;
+            for (const auto& [code, sentAs] : handover->forwardedAs) {
+                if (code < KEY_CNT && sentAs < KEY_CNT) {
+                    forwardedAs[code] = static_cast<uint16_t>(sentAs);
+                }
+            }
+        }
 
-int main() {
-    // Set up signal handling for Ctrl+C
-    std::signal(SIGINT, keydrive::signalHandler);
-    keydrive::KeyboardInput keyboard;
-    keydrive::OutputHandler output;
-    keydrive::LayoutManager layoutManager;
-
-    try {
-
-        std::cout << "\n🎹 Keyboard Remapper Active" << std::endl;
-        std::cout << "================================" << std::endl;
-        std::cout << "💡 TIPS:" << std::endl;
-        std::cout << "  - Press Ctrl+Alt+Esc to force exit if Super key gets stuck" << std::endl;
-        std::cout << "  - Check debug output for 'WARNING: Key appears stuck'" << std::endl;
-        std::cout << "================================" << std::endl;
-
-        std::cout << "Keydrive" << std::to_string(keydrive::running) << std::endl;
-        while (keydrive::running) {
-            //std::cout << "Start loop" << std::endl;
-            // Get next input event
-            if (auto event = keyboard.getEvent(100)) {
-                // --- CORE EVENT PROCESSING LOGIC ---
-
-                // 1. ALWAYS handle Release events first for layer management
-                //    This is crucial for Hold layers.
-                if (event->type == keydrive::EventType::Release) {
-                    layoutManager.handleKeyRelease(event->keyCode);
-                    // Do NOT 'continue' here. The corresponding RawKey release event
-                    // also needs to be forwarded to the system. Let it fall through.
-                    // Or, handle forwarding here if needed, but RawKey should cover it.
-                }
-
-                // 2. ALWAYS forward RawKey events to the system.
-                //    This ensures modifiers and all keys are seen by the system for shortcuts etc.
-                //    InputHandlerImpl generates these for *every* physical key event.
-                if (event->type == keydrive::EventType::RawKey) {
-                    // Debug: std::cout << "Forwarding RawKey: " << event->keyName << " (" << event->keyCode << ") value=" << event->value << std::endl;
-                    output.forwardEvent(event->keyCode, event->value);
-                    // RawKey events are purely for system forwarding.
-                    // Do not process them for layout character output here.
-                    // Their purpose is fulfilled by the forwardEvent call.
-                    continue; // Done with RawKey event processing for main logic.
-                }
-
-                // 3. Get the current modifier state (tracked by InputHandlerImpl)
-                auto modifierState = keyboard.getModifierState();
-                bool shiftActive = modifierState[keydrive::Modifier::Shift];
-                bool ctrlActive = modifierState[keydrive::Modifier::Ctrl];
-                bool altActive = modifierState[keydrive::Modifier::Alt];
-                bool superActive = modifierState[keydrive::Modifier::Super];
-
-                // 4. Determine if we should bypass layout remapping for system shortcuts
-                //    Bypass if Ctrl, Alt, or Super is active.
-                //    Note: Shift alone does NOT trigger bypass.
-                //    Exception: If the key itself is defined as a layer key in the layout,
-                //    it should still be processed by the layout manager.
-                bool bypassRemapping = ctrlActive || altActive || superActive;
-
-                // Debugging output
-                // std::cout << "DEBUG: Key=" << event->keyName << " Type=" << static_cast<int>(event->type)
-                //           << " Modifiers: S=" << shiftActive << " C=" << ctrlActive << " A=" << altActive << " M=" << superActive
-                //           << " Bypass=" << bypassRemapping << std::endl;
-
-                // 5. Process key events that might generate characters or trigger layers
-                //    This includes Press and Repeat events.
-                //    Crucially, this also includes Modifier events IF they are layer keys in the layout.
-                if (event->type == keydrive::EventType::Press || event->type == keydrive::EventType::Repeat) {
-                    // Ask the layout manager to process the key event.
-                    // It will:
-                    // - Check if it's a layer key (defined in layout's base layer) and activate/deactivate layers.
-                    // - Determine the correct character based on the active layer.
-                    // - Return the character or nullopt.
-                    std::optional<char32_t> maybeCharacter = layoutManager.processKeyEvent(
-                        event->keyName,
-                        event->keyCode,
-                        (event->type == keydrive::EventType::Press) ? "press" : "repeat"
-                    );
-
-                    // Check if Ctrl/Alt/Super is active (bypass condition)
-                    if (bypassRemapping) {
-                        // System shortcut is active (e.g., Ctrl+C).
-                        // The RawKey event ensures the system sees the key press.
-                        // We explicitly skip sending the character via our layout *unless*
-                        // the key is a layout-defined layer key (which layoutManager.processKeyEvent handles).
-                        // If maybeCharacter has a value, it means the layout *wants* to send a character
-                        // even with modifiers (e.g., a custom layout mapping Ctrl+D to 'Δ').
-                        // If it's nullopt, it was likely a layer key or unmapped.
-                        //if (maybeCharacter.has_value()) {
-                            // Layout explicitly defined a character for this key+modifier combo.
-                            // This is an intentional remapping that overrides the system shortcut.
-                            // Example: Layout maps Ctrl+Shift+K to 'ಠ' -> maybeCharacter holds 'ಠ'.
-                            // Send the character.
-                            //std::cout << "INFO: Layout override for system shortcut combo. Sending character." << std::endl;
-                            //if (!output.sendUnicode(maybeCharacter.value())) {
-                                //std::cerr << "❌ Failed to send character U+" << std::hex << static_cast<int>(maybeCharacter.value()) << std::dec << std::endl;
-                            //}
-                        //} else {
-                            // It was likely a layer key or unmapped. System handles the shortcut.
-                            // Character sending is intentionally skipped.
-                            //std::cout << "INFO: Bypassing layout for system shortcut. Key: " << event->keyName << std::endl;
+        // Daemon hotkeys detected by the input thread on the held-key bitset
+        auto handleHotkey = [&](keydrive::Hotkey hotkey) {
+            switch (hotkey) {
+                case keydrive::Hotkey::Exit:
+                    // Leave the loop so the normal cleanup path runs
+                    reactor.stop();
+                    break;
+                case keydrive::Hotkey::PauseRemapping:
+                    remappingPaused = !remappingPaused;
+                    tapHold.cancel();
+                    std::cout << (remappingPaused ? "⏸ Remapping paused" : "▶ Remapping resumed") << std::endl;
+                    break;
+                case keydrive::Hotkey::Reload:
+                    reloadLayout();
+                    break;
+                case keydrive::Hotkey::CycleLayout:
+                    try {
+                        switchLayout("next");
+                    } catch (const std::exception& e) {
+                        std::cerr << "⚠ Layout switch failed: " << e.what() << std::endl;
+                    }
+                    break;
+                case keydrive::Hotkey::None:
+                    break;
+            }
+        };
+
+        auto handleEvent = [&](const keydrive::InputEvent& event) {
+            if (event.type == keydrive::EventType::Hotkey) {
+                handleHotkey(event.hotkey);
+                return;
+            }
+
+            // --- CORE EVENT PROCESSING LOGIC ---
+
+            // 1. ALWAYS handle Release events first for layer management
+            //    This is crucial for Hold layers.
+            if (event.type == keydrive::EventType::Release) {
+                layoutManager.handleKeyRelease(event.keyCode);
+                // A dual-role key released while still pending was a tap
+                tapHold.release(event.keyCode);
+                // Do NOT 'continue' here. The corresponding RawKey release event
+                // also needs to be forwarded to the system. Let it fall through.
+                // Or, handle forwarding here if needed, but RawKey should cover it.
+            }
+
+            // 2. ALWAYS forward RawKey events to the system.
+            //    This ensures modifiers and all keys are seen by the system for shortcuts etc.
+            //    InputHandlerImpl generates these for *every* physical key event.
+            if (event.type == keydrive::EventType::RawKey) {
+                // Debug: std::cout << "Forwarding RawKey: " << event.keyName << " (" << event.keyCode << ") value=" << event.value << std::endl;
+                output.forwardEvent(event.keyCode, event.value);
+                // RawKey events are purely for system forwarding.
+                // Do not process them for layout character output here.
+                // Their purpose is fulfilled by the forwardEvent call.
+                return; // Done with RawKey event processing for main logic.
+            }
+
+            // Mouse keys end on release, whatever layer is active by then
+            if (event.type == keydrive::EventType::Release && mouseKeys.release(event.keyCode)) {
+                return;
+            }
+
+            // A key forwarded on press stays forwarded until its release. It stays
+            // held on the virtual keyboard, whose own kernel autorepeat and the
+            // compositor repeat it; the input thread drops the keyboard's repeats.
+            bool forwarded = event.keyCode >= 0 && forwardedKeys.test(static_cast<unsigned int>(event.keyCode));
+            if (forwarded) {
+                if (event.type == keydrive::EventType::Release) {
+                    output.forwardEvent(forwardedAs[event.keyCode], 0);
+                    forwardedKeys.reset(static_cast<unsigned int>(event.keyCode));
+                }
+                return;
+            }
+            auto forwardPress = [&](const keydrive::ShortcutTable& shortcuts) {
+                unsigned int code = static_cast<unsigned int>(event.keyCode);
+                forwardedAs[code] = static_cast<uint16_t>(shortcuts.translate(code));
+                output.forwardEvent(forwardedAs[code], 1);
+                forwardedKeys.set(code);
+            };
+
+            // While paused every key goes straight through
+            if (remappingPaused) {
+                if (event.type == keydrive::EventType::Press) {
+                    forwardPress(identityShortcuts);
+                }
+                return;
+            }
+
+            if (event.type == keydrive::EventType::Press) {
+                ++counters.keyPresses;
+                // Another key decides a pending dual-role key before it is handled itself
+                tapHold.keyPressed(event.keyCode);
+            }
+
+            // 3. Get the current modifier state (tracked by InputHandlerImpl)
+            auto modifierState = keyboard.getModifierState();
+            bool shiftActive = modifierState[keydrive::Modifier::Shift];
+            bool ctrlActive = modifierState[keydrive::Modifier::Ctrl];
+            bool altActive = modifierState[keydrive::Modifier::Alt];
+            bool superActive = modifierState[keydrive::Modifier::Super];
+
+            // Mouse key cells act even with modifiers held (Ctrl+click, Shift+scroll)
+            if (event.type == keydrive::EventType::Press || event.type == keydrive::EventType::Repeat) {
+                if (mouseKeys.isHeld(event.keyCode)) {
+                    return;
+                }
+                if (auto action = keydrive::parseMouseAction(layoutManager.getKeyCell(event.keyName))) {
+                    mouseKeys.press(event.keyCode, *action);
+                    return;
+                }
+            }
+
+            // 4. Determine if we should bypass layout remapping for system shortcuts
+            //    Bypass if Ctrl, Alt, or Super is active.
+            //    Note: Shift alone does NOT trigger bypass.
+            //    Exception: If the key itself is defined as a layer key in the layout,
+            //    it should still be processed by the layout manager.
+            bool bypassRemapping = ctrlActive || altActive || superActive;
+
+            // Debugging output
+            // std::cout << "DEBUG: Key=" << event.keyName << " Type=" << static_cast<int>(event.type)
+            //           << " Modifiers: S=" << shiftActive << " C=" << ctrlActive << " A=" << altActive << " M=" << superActive
+            //           << " Bypass=" << bypassRemapping << std::endl;
+
+            // 4b. Shortcuts and keys the layout leaves empty are forwarded as plain keys;
+            //     layer keys are still handled by the layout manager below
+            if (event.type == keydrive::EventType::Press || event.type == keydrive::EventType::Repeat) {
+                bool passThrough = !layoutManager.isLayerKey(event.keyName) &&
+                    (bypassRemapping || layoutManager.getKeyCell(event.keyName).empty());
+                if (passThrough) {
+                    if (event.type == keydrive::EventType::Press) {
+                        // Shortcuts follow the layout's letters unless the profile says otherwise
+                        forwardPress(bypassRemapping ? *activeShortcuts : identityShortcuts);
+                    }
+                    return;
+                }
+            }
+
+            // 4c. Dual-role keys do nothing until they resolve (see resolveTapHold)
+            if (event.type == keydrive::EventType::Press) {
+                if (auto tapHoldKey = layoutManager.getTapHold(event.keyName)) {
+                    tapHold.press(event.keyName, event.keyCode, tapHoldKey->tappingTermMs);
+                    return;
+                }
+            }
+
+            // 5. Process key events that might generate characters or trigger layers
+            //    This includes Press and Repeat events.
+            //    Crucially, this also includes Modifier events IF they are layer keys in the layout.
+            if (event.type == keydrive::EventType::Press || event.type == keydrive::EventType::Repeat) {
+                // Ask the layout manager to process the key event.
+                // It will:
+                // - Check if it's a layer key (defined in layout's base layer) and activate/deactivate layers.
+                // - Determine the correct character based on the active layer.
+                // - Return the character or nullopt.
+                std::optional<char32_t> maybeCharacter = layoutManager.processKeyEvent(
+                    event.keyName,
+                    event.keyCode,
+                    (event.type == keydrive::EventType::Press) ? "press" : "repeat"
+                );
+                remappedKeys.add();
+
+                // Check if Ctrl/Alt/Super is active (bypass condition)
+                if (bypassRemapping) {
+                    // System shortcut is active (e.g., Ctrl+C).
+                    // The RawKey event ensures the system sees the key press.
+                    // We explicitly skip sending the character via our layout *unless*
+                    // the key is a layout-defined layer key (which layoutManager.processKeyEvent handles).
+                    // If maybeCharacter has a value, it means the layout *wants* to send a character
+                    // even with modifiers (e.g., a custom layout mapping Ctrl+D to 'Δ').
+                    // If it's nullopt, it was likely a layer key or unmapped.
+                    //if (maybeCharacter.has_value()) {
+                        // Layout explicitly defined a character for this key+modifier combo.
+                        // This is an intentional remapping that overrides the system shortcut.
+                        // Example: Layout maps Ctrl+Shift+K to 'ಠ' -> maybeCharacter holds 'ಠ'.
+                        // Send the character.
+                        //std::cout << "INFO: Layout override for system shortcut combo. Sending character." << std::endl;
+                        //if (!output.sendUnicode(maybeCharacter.value())) {
+                            //std::cerr << "❌ Failed to send character U+" << std::hex << static_cast<int>(maybeCharacter.value()) << std::dec << std::endl;
                         //}
-                        // In either sub-case, we've decided how to handle the key press with modifiers.
-                        std::cout << "INFO: Bypassing layout for system shortcut. Key: " << event->keyName << std::endl;
-                        continue; // Move to the next event.
+                    //} else {
+                        // It was likely a layer key or unmapped. System handles the shortcut.
+                        // Character sending is intentionally skipped.
+                        //std::cout << "INFO: Bypassing layout for system shortcut. Key: " << event.keyName << std::endl;
+                    //}
+                    // In either sub-case, we've decided how to handle the key press with modifiers.
+                    std::cout << "INFO: Bypassing layout for system shortcut. Key: " << event.keyName << std::endl;
+                    return; // Move to the next event.
+                }
+
+                // If we reach here, either:
+                // 1. No Ctrl/Alt/Super modifiers are active (bypassRemapping is false).
+                // 2. Ctrl/Alt/Super is active, but we are NOT bypassing (layout override).
+                // In both cases, if the layout produced a character, we should send it.
+
+                // If the layout manager provided a character, send it.
+                if (maybeCharacter.has_value()) {
+                    // This covers:
+                    // - Normal key presses (e.g., 'a' -> 'α')
+                    // - Layer-affected key presses (e.g., Hold 'Sym' + 'k' -> '★')
+                    // - Shift acting as a key (e.g., if layout maps physical Shift to '⇑', and it's pressed alone)
+                    // - Layout override for modifier combos (handled in the if-block above)
+                    // Repeats coalesced while output lagged go out as one text command
+                    int count = (event.type == keydrive::EventType::Repeat) ? std::max(1, event.repeatCount) : 1;
+                    bool sent = (count > 1)
+                        ? output.sendText(std::u32string(static_cast<size_t>(count), maybeCharacter.value()))
+                        : output.sendUnicode(maybeCharacter.value());
+                    if (sent) {
+                        counters.charactersSent += static_cast<uint64_t>(count);
+                    } else {
+                        std::cerr << "❌ Failed to send character U+" << std::hex << static_cast<int>(maybeCharacter.value()) << std::dec << std::endl;
                     }
+                    return; // Character sent, move to next event.
+                }
+
+                // If we reach here:
+                // - maybeCharacter is nullopt.
+                // - This usually means the key press was consumed by the layout manager
+                //   for layer activation/deactivation (e.g., pressing the 'Sym' layer key).
+                // - Or, the key is unmapped in the current layer.
+                // - The system already received the key event via the RawKey event.
+                // No character needs to be sent by us.
+                // std::cout << "INFO: Key press consumed by layout (likely layer key) or unmapped: " << event.keyName << std::endl;
+                return; // Done processing this event.
+            }
+
+            // 5. Handle any other event types if necessary (though Press/Repeat/RawKey/Release should cover most)
+            //    EventType::Modifier events generated by InputHandlerImpl for physical modifiers
+            //    should have been handled by the RawKey forwarding and the Press/Repeat logic above.
+            //    If an EventType::Modifier sneaks through here, it might be unexpected.
+            //    Let's log it to be safe.
+            std::cout << "INFO: Unhandled event type: " << static_cast<int>(event.type) << " for key: " << event.keyName << std::endl;
+
+            // --- END CORE EVENT PROCESSING LOGIC ---
+        };
 
-                    // If we reach here, either:
-                    // 1. No Ctrl/Alt/Super modifiers are active (bypassRemapping is false).
-                    // 2. Ctrl/Alt/Super is active, but we are NOT bypassing (layout override).
-                    // In both cases, if the layout produced a character, we should send it.
-
-                    // If the layout manager provided a character, send it.
-                    if (maybeCharacter.has_value()) {
-                        // This covers:
-                        // - Normal key presses (e.g., 'a' -> 'α')
-                        // - Layer-affected key presses (e.g., Hold 'Sym' + 'k' -> '★')
-                        // - Shift acting as a key (e.g., if layout maps physical Shift to '⇑', and it's pressed alone)
-                        // - Layout override for modifier combos (handled in the if-block above)
-                        if (!output.sendUnicode(maybeCharacter.value())) {
-                            std::cerr << "❌ Failed to send character U+" << std::hex << static_cast<int>(maybeCharacter.value()) << std::dec << std::endl;
+        int exitCode = 0;
+        try {
+
+            std::cout << "\n🎹 Keyboard Remapper Active" << std::endl;
+            std::cout << "================================" << std::endl;
+            std::cout << "💡 TIPS:" << std::endl;
+            std::cout << "  - Press Ctrl+Alt+Esc to force exit if Super key gets stuck" << std::endl;
+            std::cout << "  - Ctrl+Alt+Shift+P pauses remapping, +R reloads, +L cycles layouts" << std::endl;
+            std::cout << "  - Check debug output for 'WARNING: Key appears stuck'" << std::endl;
+            std::cout << "  - Send SIGHUP to reload the layout" << std::endl;
+            std::cout << "  - Start 'keydrive --takeover' to restart without releasing the keyboard" << std::endl;
+            std::cout << "  - Event loop backend: " << reactor.backendName() << " (KEYDRIVE_REACTOR=epoll to compare)" << std::endl;
+            std::cout << "================================" << std::endl;
+
+            // Input events arrive in batches whenever the input thread signals its eventfd
+            reactor.add(keyboard.getNotifyFd(), EPOLLIN, [&](uint32_t) {
+                for (const auto& event : keyboard.takeEvents()) {
+                    handleEvent(event);
+                    eventLatency.observe(static_cast<uint64_t>(std::max<int64_t>(0,
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::system_clock::now() - event.timestamp).count())));
+                }
+                // One status update per batch keeps the page current at no per-key cost
+                publishStatus();
+            });
+            publishStatus();
+
+            // Handover: stop reading, finish the events already read, then pass the
+            // grabbed keyboard and the uinput device to the new instance
+            if (handoverServer) {
+                reactor.add(handoverServer->getFd(), EPOLLIN, [&](uint32_t) {
+                    handedOver = handoverServer->serveClient([&]() -> std::optional<keydrive::HandoverState> {
+                        if (!keyboard.isConnected()) {
+                            std::cerr << "⚠ Keyboard unplugged, refusing handover" << std::endl;
+                            return std::nullopt;
                         }
-                        continue; // Character sent, move to next event.
+                        // Free the control socket path for the new instance
+                        controlServer.reset();
+                        keydrive::HandoverState state;
+                        state.inputFd = keyboard.detachForHandover();
+                        for (const auto& event : keyboard.takeEvents()) {
+                            handleEvent(event);
+                        }
+                        state.outputFd = output.detachForHandover();
+                        state.layout = layoutManager.getLayoutName();
+                        state.layerState = layoutManager.getLayerState();
+                        state.heldKeys = keyboard.getHeldKeys();
+                        // Translated shortcuts must be released under the code they were pressed as
+                        state.heldKeys.forEach([&](unsigned int code) {
+                            if (code < KEY_CNT && forwardedKeys.test(code) && forwardedAs[code] != code) {
+                                state.forwardedAs[code] = forwardedAs[code];
+                            }
+                        });
+                        return state;
+                    }, [&]() {
+                        // The new instance never got the devices; carry on as before
+                        output.resumeAfterHandover();
+                        keyboard.resumeAfterHandover();
+                        startControlServer();
+                    });
+                    if (handedOver) {
+                        reactor.stop();
                     }
+                });
+            }
 
-                    // If we reach here:
-                    // - maybeCharacter is nullopt.
-                    // - This usually means the key press was consumed by the layout manager
-                    //   for layer activation/deactivation (e.g., pressing the 'Sym' layer key).
-                    // - Or, the key is unmapped in the current layer.
-                    // - The system already received the key event via the RawKey event.
-                    // No character needs to be sent by us.
-                    // std::cout << "INFO: Key press consumed by layout (likely layer key) or unmapped: " << event->keyName << std::endl;
-                    continue; // Done processing this event.
-                }
+            // Everything is set up; only now take the keyboard away from the compositor
+            auto grabStart = std::chrono::steady_clock::now();
+            keyboard.grab();
+            auto ready = std::chrono::steady_clock::now();
+            std::cout << "⏱ Startup: keyboard " << formatMs(discoveryMs)
+                      << " then uinput " << formatMs(uinputMs)
+                      << (layoutsMs <= 0 ? std::string(", layouts preloaded")
+                          : (takeover ? ", after layouts " : ", alongside layouts ") + formatMs(layoutsMs))
+                      << " (all done after " << formatMs(msBetween(startedAt, phasesDone)) << ")"
+                      << ", setup " << formatMs(msBetween(phasesDone, grabStart))
+                      << ", grab " << formatMs(msBetween(grabStart, ready))
+                      << "; first key after " << formatMs(msBetween(startedAt, ready)) << std::endl;
 
-                // 5. Handle any other event types if necessary (though Press/Repeat/RawKey/Release should cover most)
-                //    EventType::Modifier events generated by InputHandlerImpl for physical modifiers
-                //    should have been handled by the RawKey forwarding and the Press/Repeat logic above.
-                //    If an EventType::Modifier sneaks through here, it might be unexpected.
-                //    Let's log it to be safe.
-                std::cout << "INFO: Unhandled event type: " << static_cast<int>(event->type) << " for key: " << event->keyName << std::endl;
+            if (loadgen) {
+                loadgen->start(reactor, keyboard, eventLatency);
+            }
+            reactor.run();
+        } catch (const std::exception& e) {
+            std::cerr << "\n❌ CRITICAL ERROR: " << e.what() << std::endl;
+            std::cerr << "Attempting safe shutdown..." << std::endl;
+            exitCode = 1;
+        }
+
+        if (loadgen) {
+            loadgen->stop();
+        }
+
+        // Safety cleanup: Release all modifiers. The uinput device and the keyboard
+        // grab are released by the destructors right after this. After a handover
+        // the held modifiers belong to the new instance.
+        if (!handedOver) {
+            std::cout << "🧹 Releasing all modifiers..." << std::endl;
+            mouseKeys.releaseAll();
+            forwardedKeys.forEach([&](unsigned int code) {
+                output.forwardEvent(forwardedAs[code], 0);
+            });
+            output.releaseAllModifiers();
+            keyboard.setLeds(lastManagedLeds, 0);
+            if (statusPage) {
+                statusPage->markStopped();
+            }
+        }
+
+        std::cout << "✅ Shutdown complete" << std::endl;
+        return exitCode;
+    }
 
-                // --- END CORE EVENT PROCESSING LOGIC ---
+} // namespace keydrive
+
+int main(int argc, char* argv[]) {
+    // --takeover: continue with the devices of the running instance instead of grabbing anew
+    // --guardian: run under a supervisor that restores the keyboard and restarts on crashes
+    // --status: print the running daemon's status page and exit (for status bars)
+    // --loadgen [option=value ...]: ramp generated typing through the pipeline
+    //   into a recording sink and report where each output backend falls behind;
+    //   exits with 1 if a run ends with stuck keys or duplicated edges
+    bool takeover = false;
+    bool guardian = false;
+    std::optional<std::vector<std::string>> loadgenOptions;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (loadgenOptions) {
+            loadgenOptions->push_back(arg);
+        } else if (arg == "--loadgen") {
+            loadgenOptions.emplace();
+        } else if (arg == "--takeover") {
+            takeover = true;
+        } else if (arg == "--guardian") {
+            guardian = true;
+        } else if (arg == "--status") {
+            auto status = keydrive::StatusPage::read();
+            if (!status || !status->running) {
+                std::cerr << "keydrive is not running" << std::endl;
+                return 1;
             }
+            std::cout << "pid=" << status->pid << "\n"
+                      << "paused=" << (status->paused ? 1 : 0) << "\n"
+                      << "layout=" << status->layout << "\n"
+                      << "profile=" << status->profile << "\n"
+                      << "layer=" << status->layer << "\n"
+                      << "hold=" << status->holdLayer << "\n"
+                      << "onetime=" << status->oneTimeLayer << "\n"
+                      << "toggles=" << status->toggledLayers << "\n"
+                      << "key_presses=" << status->counters.keyPresses << "\n"
+                      << "characters_sent=" << status->counters.charactersSent << "\n"
+                      << "layout_changes=" << status->counters.layoutChanges << "\n"
+                      << "suppressed_bounces=" << status->counters.suppressedBounces << std::endl;
+            return 0;
         }
-    } catch (const std::exception& e) {
-        std::cerr << "\n❌ CRITICAL ERROR: " << e.what() << std::endl;
-        std::cerr << "Attempting safe shutdown..." << std::endl;
     }
 
-    // Safety cleanup: Release all modifiers
-    std::cout << "🧹 Releasing all modifiers..." << std::endl;
-    output.releaseAllModifiers();
+    if (loadgenOptions) {
+        keydrive::LoadProfile profile;
+        try {
+            profile = keydrive::parseLoadProfile(*loadgenOptions);
+        } catch (const std::exception& e) {
+            std::cerr << "❌ " << e.what() << "\n"
+                      << "Options: rate= max-rate= ramp= step-ms= rollover= layer-keys= unicode= "
+                      << "max-queue= p99-ms= uinput-us= xtest-us= helper-us= overflow= backends=uinput,wtype,xdotool,xtest" << std::endl;
+            return 2;
+        }
+
+        // One fresh pipeline per backend, all on the same compiled layouts
+        std::optional<keydrive::LayoutManager> layoutManager;
+        layoutManager.emplace();
+        std::vector<keydrive::LoadResult> results;
+        for (keydrive::TextBackend backend : profile.backends) {
+            keydrive::LoadGenerator generator(profile, backend, *layoutManager);
+            keydrive::runDaemon(layoutManager, false, &generator);
+            results.push_back(generator.getResult());
+            if (!results.back().finished) {
+                break;
+            }
+        }
+        return keydrive::printLoadReport(profile, results) ? 0 : 1;
+    }
 
-    std::cout << "✅ Shutdown complete" << std::endl;
-    return 0;
+    // The guardian loads the layouts before forking, so every restart starts
+    // from this copy; otherwise they are compiled during startup
+    std::optional<keydrive::LayoutManager> layoutManager;
+    if (guardian) {
+        layoutManager.emplace();
+        return keydrive::runGuardian([&layoutManager]() {
+            return keydrive::runDaemon(layoutManager, false);
+        });
+    }
+    return keydrive::runDaemon(layoutManager, takeover);
 }
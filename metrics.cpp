@@ -0,0 +1,62 @@
+#include "metrics.hpp"
+#include <cstdio>
+
+namespace keydrive {
+
+	namespace {
+
+		std::string formatSeconds(uint64_t micros) {
+			char buffer[32];
+			// Microsecond resolution without trailing zeros: 0.00005, 0.25, 1
+			std::snprintf(buffer, sizeof(buffer), "%llu.%06llu",
+				static_cast<unsigned long long>(micros / 1000000), static_cast<unsigned long long>(micros % 1000000));
+			std::string seconds = buffer;
+			seconds.erase(seconds.find_last_not_of('0') + 1);
+			if (seconds.back() == '.') {
+				seconds.pop_back();
+			}
+			return seconds;
+		}
+
+	} // anonymous namespace
+
+	void MetricsWriter::family(const std::string& name, const char* type, const char* help) {
+		text += "# HELP " + name + " " + help + "\n";
+		text += "# TYPE " + name + " " + type + "\n";
+	}
+
+	void MetricsWriter::sample(const std::string& name, const std::string& labels, uint64_t value) {
+		text += name;
+		if (!labels.empty()) {
+			text += "{" + labels + "}";
+		}
+		text += " " + std::to_string(value) + "\n";
+	}
+
+	void MetricsWriter::counter(const std::string& name, const char* help, uint64_t value) {
+		family(name, "counter", help);
+		sample(name, "", value);
+	}
+
+	void MetricsWriter::gauge(const std::string& name, const char* help, uint64_t value) {
+		family(name, "gauge", help);
+		sample(name, "", value);
+	}
+
+	void MetricsWriter::histogram(const std::string& name, const char* help, const LatencyHistogram& histogram) {
+		family(name, "histogram", help);
+
+		// Buckets are cumulative in the exposition format
+		uint64_t cumulative = 0;
+		for (size_t bucket = 0; bucket < LatencyHistogram::BOUNDS_US.size(); ++bucket) {
+			cumulative += histogram.bucketCount(bucket);
+			sample(name + "_bucket", "le=\"" + formatSeconds(LatencyHistogram::BOUNDS_US[bucket]) + "\"", cumulative);
+		}
+		cumulative += histogram.bucketCount(LatencyHistogram::BOUNDS_US.size());
+		sample(name + "_bucket", "le=\"+Inf\"", cumulative);
+
+		text += name + "_sum " + formatSeconds(histogram.totalMicros()) + "\n";
+		sample(name + "_count", "", cumulative);
+	}
+
+} // namespace keydrive
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace keydrive {
+
+	/**
+	 * @brief Monotonic counter with a single writer thread
+	 *
+	 * Incrementing is a relaxed load and store, no locked instruction; any
+	 * thread may read it.
+	 */
+	class Counter {
+	public:
+		void add(uint64_t n = 1) {
+			value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		uint64_t get() const {
+			return value.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<uint64_t> value{0};
+	};
+
+	/**
+	 * @brief Highest value seen, with a single writer thread
+	 */
+	class HighWaterMark {
+	public:
+		void observe(uint64_t sample) {
+			if (sample > value.load(std::memory_order_relaxed)) {
+				value.store(sample, std::memory_order_relaxed);
+			}
+		}
+
+		uint64_t get() const {
+			return value.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<uint64_t> value{0};
+	};
+
+	/**
+	 * @brief Latency histogram with fixed buckets, with a single writer thread
+	 *
+	 * Percentiles are left to the scraper (histogram_quantile over the buckets).
+	 */
+	class LatencyHistogram {
+	public:
+		// Upper bounds in microseconds; the last bucket is +Inf
+		static constexpr std::array<uint64_t, 12> BOUNDS_US = {
+			50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+		};
+
+		void observe(uint64_t micros) {
+			size_t bucket = 0;
+			while (bucket < BOUNDS_US.size() && micros > BOUNDS_US[bucket]) {
+				++bucket;
+			}
+			buckets[bucket].add();
+			sumMicros.add(micros);
+		}
+
+		uint64_t bucketCount(size_t bucket) const {
+			return buckets[bucket].get();
+		}
+
+		uint64_t totalMicros() const {
+			return sumMicros.get();
+		}
+
+	private:
+		std::array<Counter, BOUNDS_US.size() + 1> buckets;
+		Counter sumMicros;
+	};
+
+	/**
+	 * @brief Renders metrics in the Prometheus text exposition format
+	 */
+	class MetricsWriter {
+	public:
+		/**
+		 * @brief Start a metric family (# HELP and # TYPE lines)
+		 *
+		 * @param name Metric name, e.g. "keydrive_events_read_total"
+		 * @param type "counter", "gauge" or "histogram"
+		 * @param help One-line description
+		 */
+		void family(const std::string& name, const char* type, const char* help);
+
+		/**
+		 * @brief Add a sample line to the current family
+		 *
+		 * @param name Metric name (with _bucket/_sum/_count suffix for histograms)
+		 * @param labels Label set without braces, e.g. "backend=\"wtype\"" (may be empty)
+		 * @param value Sample value
+		 */
+		void sample(const std::string& name, const std::string& labels, uint64_t value);
+
+		// Family and sample in one call for unlabelled metrics
+		void counter(const std::string& name, const char* help, uint64_t value);
+		void gauge(const std::string& name, const char* help, uint64_t value);
+
+		/**
+		 * @brief Add a histogram in seconds, as Prometheus expects for durations
+		 */
+		void histogram(const std::string& name, const char* help, const LatencyHistogram& histogram);
+
+		const std::string& str() const {
+			return text;
+		}
+
+	private:
+		std::string text;
+	};
+
+} // namespace keydrive
@@ -0,0 +1,233 @@
+#include "mouse_keys.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <linux/input.h>
+
+namespace keydrive {
+
+	namespace {
+
+		constexpr long TICK_NS = 1000000;  // 1 kHz
+
+		// Acceleration curves: speed eases from MIN to MAX over ACCEL_TIME of holding
+		constexpr double POINTER_MIN_SPEED = 150.0;   // px/s
+		constexpr double POINTER_MAX_SPEED = 1800.0;  // px/s
+		constexpr double WHEEL_MIN_SPEED = 6.0;       // notches/s
+		constexpr double WHEEL_MAX_SPEED = 25.0;      // notches/s
+		constexpr double ACCEL_TIME = 0.8;            // s
+
+		double curveSpeed(double minSpeed, double maxSpeed, double heldSeconds) {
+			double x = std::min(1.0, heldSeconds / ACCEL_TIME);
+			double eased = x * x * (3.0 - 2.0 * x);  // smoothstep
+			return minSpeed + (maxSpeed - minSpeed) * eased;
+		}
+
+		bool isMotion(MouseAction action) {
+			return action == MouseAction::MoveUp || action == MouseAction::MoveDown ||
+				action == MouseAction::MoveLeft || action == MouseAction::MoveRight;
+		}
+
+		bool isWheel(MouseAction action) {
+			return action == MouseAction::WheelUp || action == MouseAction::WheelDown ||
+				action == MouseAction::WheelLeft || action == MouseAction::WheelRight;
+		}
+
+		unsigned int buttonCode(MouseAction action) {
+			switch (action) {
+				case MouseAction::ButtonLeft: return BTN_LEFT;
+				case MouseAction::ButtonRight: return BTN_RIGHT;
+				case MouseAction::ButtonMiddle: return BTN_MIDDLE;
+				default: return 0;
+			}
+		}
+
+		// Take the whole units out of an accumulator, keep the fraction
+		int takeWhole(double& remainder) {
+			double whole = std::trunc(remainder);
+			remainder -= whole;
+			return static_cast<int>(whole);
+		}
+
+	} // anonymous namespace
+
+	std::optional<MouseAction> parseMouseAction(const std::string& cell) {
+		static const std::unordered_map<std::string, MouseAction> actions = {
+			{"ms_up", MouseAction::MoveUp},
+			{"ms_down", MouseAction::MoveDown},
+			{"ms_left", MouseAction::MoveLeft},
+			{"ms_right", MouseAction::MoveRight},
+			{"wh_up", MouseAction::WheelUp},
+			{"wh_down", MouseAction::WheelDown},
+			{"wh_left", MouseAction::WheelLeft},
+			{"wh_right", MouseAction::WheelRight},
+			{"btn_left", MouseAction::ButtonLeft},
+			{"btn_right", MouseAction::ButtonRight},
+			{"btn_middle", MouseAction::ButtonMiddle}
+		};
+		auto it = actions.find(cell);
+		if (it == actions.end()) {
+			return std::nullopt;
+		}
+		return it->second;
+	}
+
+	MouseKeys::MouseKeys(Reactor& reactor, OutputHandler& output)
+		: reactor(reactor), output(output) {
+		timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (timerFd < 0) {
+			throw std::runtime_error("Failed to create mouse keys timer: " + std::string(std::strerror(errno)));
+		}
+		reactor.add(timerFd, EPOLLIN, [this](uint32_t) {
+			uint64_t expirations;
+			while (read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+			}
+			tick();
+		});
+	}
+
+	MouseKeys::~MouseKeys() {
+		reactor.remove(timerFd);
+		close(timerFd);
+	}
+
+	void MouseKeys::press(int keyCode, MouseAction action) {
+		if (heldKeys.count(keyCode)) {
+			return;  // Autorepeat; motion is driven by the timer
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		bool motionHeld = false;
+		bool wheelHeld = false;
+		for (const auto& [code, held] : heldKeys) {
+			motionHeld = motionHeld || isMotion(held);
+			wheelHeld = wheelHeld || isWheel(held);
+		}
+		heldKeys[keyCode] = action;
+
+		if (isMotion(action)) {
+			if (!motionHeld) {
+				motionStart = now;
+				remainderX = remainderY = 0.0;
+			}
+		} else if (isWheel(action)) {
+			if (!wheelHeld) {
+				wheelStart = now;
+				// Scroll one notch right away so a tap always scrolls
+				remainderWheel = remainderHWheel = 0.0;
+				output.movePointer(0, 0,
+					action == MouseAction::WheelUp ? 1 : action == MouseAction::WheelDown ? -1 : 0,
+					action == MouseAction::WheelRight ? 1 : action == MouseAction::WheelLeft ? -1 : 0);
+			}
+		} else {
+			output.forwardEvent(buttonCode(action), 1);
+		}
+		updateTimer();
+	}
+
+	bool MouseKeys::release(int keyCode) {
+		auto it = heldKeys.find(keyCode);
+		if (it == heldKeys.end()) {
+			return false;
+		}
+		MouseAction action = it->second;
+		heldKeys.erase(it);
+
+		if (unsigned int button = buttonCode(action)) {
+			output.forwardEvent(button, 0);
+		}
+		updateTimer();
+		return true;
+	}
+
+	bool MouseKeys::isHeld(int keyCode) const {
+		return heldKeys.count(keyCode) != 0;
+	}
+
+	void MouseKeys::releaseAll() {
+		for (const auto& [code, action] : heldKeys) {
+			if (unsigned int button = buttonCode(action)) {
+				output.forwardEvent(button, 0);
+			}
+		}
+		heldKeys.clear();
+		updateTimer();
+	}
+
+	void MouseKeys::updateTimer() {
+		bool needed = std::any_of(heldKeys.begin(), heldKeys.end(), [](const auto& held) {
+			return isMotion(held.second) || isWheel(held.second);
+		});
+		if (needed == timerArmed) {
+			return;
+		}
+
+		itimerspec spec{};
+		if (needed) {
+			spec.it_value.tv_nsec = TICK_NS;
+			spec.it_interval.tv_nsec = TICK_NS;
+			lastTick = std::chrono::steady_clock::now();
+		}
+		timerfd_settime(timerFd, 0, &spec, nullptr);
+		timerArmed = needed;
+	}
+
+	void MouseKeys::tick() {
+		auto now = std::chrono::steady_clock::now();
+		// Integrate over real elapsed time so late or merged ticks don't slow the pointer
+		double dt = std::chrono::duration<double>(now - lastTick).count();
+		lastTick = now;
+
+		int dirX = 0;
+		int dirY = 0;
+		int dirWheel = 0;
+		int dirHWheel = 0;
+		for (const auto& [code, action] : heldKeys) {
+			switch (action) {
+				case MouseAction::MoveUp: --dirY; break;
+				case MouseAction::MoveDown: ++dirY; break;
+				case MouseAction::MoveLeft: --dirX; break;
+				case MouseAction::MoveRight: ++dirX; break;
+				case MouseAction::WheelUp: ++dirWheel; break;
+				case MouseAction::WheelDown: --dirWheel; break;
+				case MouseAction::WheelLeft: --dirHWheel; break;
+				case MouseAction::WheelRight: ++dirHWheel; break;
+				default: break;
+			}
+		}
+		dirX = std::clamp(dirX, -1, 1);
+		dirY = std::clamp(dirY, -1, 1);
+		dirWheel = std::clamp(dirWheel, -1, 1);
+		dirHWheel = std::clamp(dirHWheel, -1, 1);
+
+		if (dirX || dirY) {
+			double speed = curveSpeed(POINTER_MIN_SPEED, POINTER_MAX_SPEED,
+				std::chrono::duration<double>(now - motionStart).count());
+			// Diagonals move at the same speed as straight lines
+			double scale = (dirX && dirY) ? M_SQRT1_2 : 1.0;
+			remainderX += dirX * speed * scale * dt;
+			remainderY += dirY * speed * scale * dt;
+		}
+		if (dirWheel || dirHWheel) {
+			double speed = curveSpeed(WHEEL_MIN_SPEED, WHEEL_MAX_SPEED,
+				std::chrono::duration<double>(now - wheelStart).count());
+			remainderWheel += dirWheel * speed * dt;
+			remainderHWheel += dirHWheel * speed * dt;
+		}
+
+		int dx = takeWhole(remainderX);
+		int dy = takeWhole(remainderY);
+		int wheel = takeWhole(remainderWheel);
+		int hwheel = takeWhole(remainderHWheel);
+		if (dx || dy || wheel || hwheel) {
+			output.movePointer(dx, dy, wheel, hwheel);
+		}
+	}
+
+} // namespace keydrive
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <optional>
+#include <unordered_map>
+#include <chrono>
+#include "reactor.hpp"
+#include "output_handler.hpp"
+
+namespace keydrive {
+
+	/**
+	 * @brief Pointer actions a layer cell can hold instead of a character
+	 */
+	enum class MouseAction {
+		MoveUp,         // ms_up
+		MoveDown,       // ms_down
+		MoveLeft,       // ms_left
+		MoveRight,      // ms_right
+		WheelUp,        // wh_up
+		WheelDown,      // wh_down
+		WheelLeft,      // wh_left
+		WheelRight,     // wh_right
+		ButtonLeft,     // btn_left
+		ButtonRight,    // btn_right
+		ButtonMiddle    // btn_middle
+	};
+
+	/**
+	 * @brief Parse a layer cell into a mouse action
+	 *
+	 * @param cell Cleaned layer cell (e.g. "ms_up")
+	 * @return std::optional<MouseAction> The action, or nullopt for any other cell
+	 */
+	std::optional<MouseAction> parseMouseAction(const std::string& cell);
+
+	/**
+	 * @brief Mouse keys: pointer motion, scrolling and buttons from layer cells
+	 *
+	 * Motion and wheel keys are integrated on a 1 kHz timerfd in the reactor.
+	 * The timer only runs while such a key is held, so idle mouse keys cost
+	 * nothing. Speed follows an ease-in curve from a slow start to full speed,
+	 * which keeps short taps precise and long holds fast.
+	 */
+	class MouseKeys {
+	public:
+		/**
+		 * @brief Create the motion timer and register it with the reactor
+		 *
+		 * @throws std::runtime_error if the timerfd cannot be created
+		 */
+		MouseKeys(Reactor& reactor, OutputHandler& output);
+		~MouseKeys();
+
+		MouseKeys(const MouseKeys&) = delete;
+		MouseKeys& operator=(const MouseKeys&) = delete;
+
+		/**
+		 * @brief Handle the press of a key bound to a mouse action
+		 *
+		 * @param keyCode Physical key code; its release ends the action
+		 * @param action Action of the key's cell
+		 */
+		void press(int keyCode, MouseAction action);
+
+		/**
+		 * @brief Handle a key release
+		 *
+		 * @param keyCode Physical key code
+		 * @return true if the key was a held mouse key
+		 */
+		bool release(int keyCode);
+
+		/**
+		 * @brief Check whether a key is currently held as a mouse key
+		 */
+		bool isHeld(int keyCode) const;
+
+		/**
+		 * @brief Release held buttons and stop all motion
+		 */
+		void releaseAll();
+
+	private:
+		void tick();
+		void updateTimer();
+
+		Reactor& reactor;
+		OutputHandler& output;
+		int timerFd = -1;
+		bool timerArmed = false;
+
+		std::unordered_map<int, MouseAction> heldKeys;
+
+		// Integrator state: hold start per group, last tick and sub-unit remainders
+		std::chrono::steady_clock::time_point motionStart;
+		std::chrono::steady_clock::time_point wheelStart;
+		std::chrono::steady_clock::time_point lastTick;
+		double remainderX = 0.0;
+		double remainderY = 0.0;
+		double remainderWheel = 0.0;
+		double remainderHWheel = 0.0;
+	};
+
+} // namespace keydrive
@@ -3,16 +3,15 @@
 #include <cstring>
 #include <cstdlib>
 #include <unistd.h>
-#include <sys/wait.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <csignal>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
 #include <chrono>
 #include <thread>
 #include <fstream>
 #include <sstream>
 #include <nlohmann/json.hpp>
-#include <iomanip>
 
 namespace keydrive {
 
@@ -38,75 +37,81 @@ namespace keydrive {
 			return result;
 		}
 
-		std::pair<int, std::string> executeCommand(const std::string& command, int timeoutMs = 200) {
-			int pipefd[2];
-			if (pipe(pipefd) == -1) {
-				return {-1, "Failed to create pipe"};
+		std::string utf32ToUtf8(const std::u32string& text) {
+			std::string result;
+			for (char32_t c : text) {
+				result += utf32ToUtf8(c);
 			}
+			return result;
+		}
 
-			pid_t pid = fork();
-			if (pid == -1) {
-				close(pipefd[0]);
-				close(pipefd[1]);
-				return {-1, "Failed to fork"};
+		// Keys keydrive emits whether or not the keyboard has them: modifiers,
+		// control characters and the US keys shortcuts are translated to
+		// (KEY_ESC..KEY_KPDOT covers those), and the mouse key buttons
+		bool isExtraKey(unsigned int code) {
+			switch (code) {
+				case KEY_RIGHTCTRL:
+				case KEY_RIGHTALT:
+				case KEY_LEFTMETA:
+				case KEY_RIGHTMETA:
+				case BTN_LEFT:
+				case BTN_RIGHT:
+				case BTN_MIDDLE:
+					return true;
+				default:
+					return code >= KEY_ESC && code <= KEY_KPDOT;
 			}
+		}
 
-			if (pid == 0) {
-				close(pipefd[0]);
-				dup2(pipefd[1], STDOUT_FILENO);
-				dup2(pipefd[1], STDERR_FILENO);
-				close(pipefd[1]);
-
-				sigset_t mask;
-				sigemptyset(&mask);
-				sigaddset(&mask, SIGTERM);
-				sigprocmask(SIG_UNBLOCK, &mask, nullptr);
-
-				std::vector<char*> args;
-				std::istringstream iss(command);
-				std::string token;
-				while (iss >> token) {
-					args.push_back(strdup(token.c_str()));
-				}
-				args.push_back(nullptr);
+		// Tell X clients (typed into through XTest/xdotool) and terminals by class
+		void classifyWindow(WindowInfo& info) {
+			static const std::vector<std::string> electronApps = {
+				"code", "discord", "slack", "vscodium", "codium", "godot"
+			};
 
-				execvp(args[0], args.data());
-				_exit(EXIT_FAILURE);
-			} else {
-				close(pipefd[1]);
-
-				auto start = std::chrono::steady_clock::now();
-				std::string output;
-				char buffer[128];
-				ssize_t bytesRead;
-
-				while ((bytesRead = read(pipefd[0], buffer, sizeof(buffer) - 1)) > 0) {
-					buffer[bytesRead] = '\0';
-					output += buffer;
-
-					auto now = std::chrono::steady_clock::now();
-					auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
-					if (elapsed.count() > timeoutMs) {
-						kill(pid, SIGTERM);
-						waitpid(pid, nullptr, 0);
-						close(pipefd[0]);
-						return {-1, "Command timed out"};
-					}
+			for (const auto& app : electronApps) {
+				if (info.windowClass.find(app) != std::string::npos) {
+					info.isElectron = 1;
+					break;
 				}
+			}
 
-				close(pipefd[0]);
-
-				int status;
-				waitpid(pid, &status, 0);
+			static const std::vector<std::string> terminalApps = {
+				"terminal", "alacritty", "kitty", "foot", "konsole", "org.kde.konsole"
+			};
 
-				if (WIFEXITED(status)) {
-					return {WEXITSTATUS(status), output};
-				} else {
-					return {-1, "Command terminated abnormally"};
+			for (const auto& term : terminalApps) {
+				if (info.windowClass.find(term) != std::string::npos) {
+					info.isTerminal = true;
+					break;
 				}
 			}
 		}
 
+		bool isModifierKey(unsigned int code) {
+			switch (code) {
+				case KEY_LEFTCTRL: case KEY_RIGHTCTRL:
+				case KEY_LEFTSHIFT: case KEY_RIGHTSHIFT:
+				case KEY_LEFTALT: case KEY_RIGHTALT:
+				case KEY_LEFTMETA: case KEY_RIGHTMETA:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		// Key tapped for a control character, 0 for other characters
+		unsigned int controlKey(char32_t c) {
+			switch (c) {
+				case U'\n': return KEY_ENTER;
+				case U' ': return KEY_SPACE;
+				case U'\b': return KEY_BACKSPACE;
+				case U'\t': return KEY_TAB;
+				case U'\x1b': return KEY_ESC;
+				default: return 0;
+			}
+		}
+
 		bool fileExists(const std::string& path) {
 			struct stat buffer;
 			return stat(path.c_str(), &buffer) == 0;
@@ -117,7 +122,17 @@ namespace keydrive {
 	// Define the symbol map
 	constexpr OutputHandler::SymbolMapping OutputHandler::symbolMap[];
 
-	OutputHandler::OutputHandler() {
+	const char* textBackendName(TextBackend backend) {
+		switch (backend) {
+			case TextBackend::Uinput: return "uinput";
+			case TextBackend::Wtype: return "wtype";
+			case TextBackend::Xdotool: return "xdotool";
+			case TextBackend::XTest: return "xtest";
+			default: return "unknown";
+		}
+	}
+
+	OutputHandler::OutputHandler(const libevdev* keyboard) {
 		// 1. Create the libevdev device (configuration object)
 		dev = libevdev_new();
 		if (!dev) {
@@ -126,13 +141,45 @@ namespace keydrive {
 
 		libevdev_set_name(dev, "Keyforge Virtual Keyboard");
 
-		// 2. Configure the device with the events we want to support
-		for (unsigned int i = 0; i < KEY_MAX; ++i) {
-			libevdev_enable_event_code(dev, EV_KEY, i, nullptr);
+		// 2. Configure the device like the keyboard it stands in for, so the
+		// compositor sets it up as an ordinary keyboard rather than one with
+		// every key code there is
+		int repeatDelay = 500;
+		int repeatPeriod = 60;
+		if (keyboard) {
+			libevdev_set_id_bustype(dev, libevdev_get_id_bustype(keyboard));
+			libevdev_set_id_vendor(dev, libevdev_get_id_vendor(keyboard));
+			libevdev_set_id_product(dev, libevdev_get_id_product(keyboard));
+			libevdev_set_id_version(dev, libevdev_get_id_version(keyboard));
+			libevdev_get_repeat(keyboard, &repeatDelay, &repeatPeriod);
+
+			for (unsigned int code = 0; code <= MSC_MAX; ++code) {
+				if (libevdev_has_event_code(keyboard, EV_MSC, code)) {
+					libevdev_enable_event_code(dev, EV_MSC, code, nullptr);
+				}
+			}
+			for (unsigned int code = 0; code <= LED_MAX; ++code) {
+				if (libevdev_has_event_code(keyboard, EV_LED, code)) {
+					libevdev_enable_event_code(dev, EV_LED, code, nullptr);
+				}
+			}
 		}
+		for (unsigned int code = 0; code < KEY_MAX; ++code) {
+			if (!keyboard || libevdev_has_event_code(keyboard, EV_KEY, code) || isExtraKey(code)) {
+				libevdev_enable_event_code(dev, EV_KEY, code, nullptr);
+			}
+		}
+
+		// With EV_REP the input core autorepeats keys held on this device, as it
+		// does for the keyboard; the keyboard's timings are set once it exists
+		libevdev_enable_event_code(dev, EV_REP, REP_DELAY, &repeatDelay);
+		libevdev_enable_event_code(dev, EV_REP, REP_PERIOD, &repeatPeriod);
 
-		// Enable MSC_SCAN for Unicode input
-		libevdev_enable_event_code(dev, EV_MSC, MSC_SCAN, nullptr);
+		// Relative axes for mouse keys
+		libevdev_enable_event_code(dev, EV_REL, REL_X, nullptr);
+		libevdev_enable_event_code(dev, EV_REL, REL_Y, nullptr);
+		libevdev_enable_event_code(dev, EV_REL, REL_WHEEL, nullptr);
+		libevdev_enable_event_code(dev, EV_REL, REL_HWHEEL, nullptr);
 
 		// 3. Create the uinput device from the configured libevdev device
 		if (libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &virtKb) < 0) {
@@ -140,47 +187,47 @@ namespace keydrive {
 			throw std::runtime_error("Failed to create uinput device");
 		}
 
-		std::cout << "✅ Output handler initialized" << std::endl;
+		desktop = std::make_unique<DesktopSink>(libevdev_uinput_get_fd(virtKb));
+		sink = desktop.get();
 
-		// 4. Verify MSC_SCAN works using the ORIGINAL dev object
-		if (libevdev_has_event_code(dev, EV_MSC, MSC_SCAN)) {
-			try {
-				const char32_t testChar = U'✓';
-				std::string utf8 = utf32ToUtf8(testChar);
+		// uinput can't preset the timings, so the device registers with the
+		// kernel's defaults; written EV_REP events replace them
+		writeEvent(EV_REP, REP_DELAY, repeatDelay);
+		writeEvent(EV_REP, REP_PERIOD, repeatPeriod);
+		syncEvent();
 
-				bool testSucceeded = true;
-				for (char c : utf8) {
-					if (libevdev_uinput_write_event(virtKb, EV_MSC, MSC_SCAN,
-						static_cast<unsigned char>(c)) < 0) {
-						testSucceeded = false;
-					break;
-						}
-				}
+		pendingWrites.reserve(64);
+		std::cout << "✅ Output handler initialized";
+		if (keyboard) {
+			std::cout << " (keys of " << libevdev_get_name(keyboard) << ")";
+		}
+		std::cout << std::endl;
+	}
 
-				if (testSucceeded) {
-					syncEvent();
+	OutputHandler::OutputHandler(OutputSink& sink) : sink(&sink) {
+		pendingWrites.reserve(64);
+		std::cout << "✅ Output handler initialized with a substitute sink" << std::endl;
+	}
 
-					std::cout << "✅ Verified MSC_SCAN support (sent ✓ as";
-					for (unsigned char b : utf8) {
-						std::cout << " " << std::hex << std::setw(2) << std::setfill('0')
-						<< static_cast<int>(b);
-					}
-					std::cout << ")" << std::endl;
-				} else {
-					std::cout << "⚠ MSC_SCAN is present but failed to send test character" << std::endl;
-				}
-			} catch (const std::exception& e) {
-				std::cout << "⚠ MSC_SCAN verification failed: " << e.what() << std::endl;
-			}
-		} else {
-			std::cout << "⚠ MSC_SCAN not supported by this system" << std::endl;
+	OutputHandler::OutputHandler(int adoptedFd) : uinputFd(adoptedFd) {
+		// The device already exists and is configured; we only write events to it
+		if (uinputFd < 0) {
+			throw std::runtime_error("Invalid uinput fd");
 		}
+		desktop = std::make_unique<DesktopSink>(uinputFd);
+		sink = desktop.get();
+		std::cout << "✅ Output handler adopted existing uinput device" << std::endl;
 	}
 
 	OutputHandler::~OutputHandler() {
-		// 5. Clean up in the correct order
-		if (virtKb) {
+		// 4. Clean up in the correct order
+		if (handedOver) {
+			// The new instance writes to this device now; leave it alive
+		} else if (virtKb) {
 			libevdev_uinput_destroy(virtKb);
+		} else if (uinputFd >= 0) {
+			ioctl(uinputFd, UI_DEV_DESTROY);
+			close(uinputFd);
 		}
 		if (dev) {
 			libevdev_free(dev);
@@ -188,27 +235,88 @@ namespace keydrive {
 		std::cout << "🧹 Output handler cleaned up" << std::endl;
 	}
 
+	void OutputHandler::writeThrough(Reactor* reactor) {
+		if (desktop) {
+			desktop->writeThrough(reactor);
+		}
+	}
+
+	int OutputHandler::detachForHandover() {
+		// The new instance's writes must come after ours
+		if (desktop) {
+			desktop->completeWrites();
+		}
+		handedOver = true;
+		return virtKb ? libevdev_uinput_get_fd(virtKb) : uinputFd;
+	}
+
+	void OutputHandler::resumeAfterHandover() {
+		handedOver = false;
+		// The other instance may have changed the keymap meanwhile
+		invalidateRoutes();
+	}
+
+	// Events are collected and written to uinput in one write() per SYN_REPORT;
+	// the kernel stamps the time, so raw input_events are enough
+	void OutputHandler::writeEvent(unsigned int type, unsigned int code, int value) {
+		input_event ev{};
+		ev.type = static_cast<unsigned short>(type);
+		ev.code = static_cast<unsigned short>(code);
+		ev.value = value;
+		pendingWrites.push_back(ev);
+	}
+
+	void OutputHandler::queueSync() {
+		writeEvent(EV_SYN, SYN_REPORT, 0);
+	}
+
+	void OutputHandler::flushWrites() {
+		if (pendingWrites.empty()) {
+			return;
+		}
+		sink->write(pendingWrites.data(), pendingWrites.size());
+		pendingWrites.clear();
+	}
+
 	void OutputHandler::syncEvent() {
-		libevdev_uinput_write_event(virtKb, EV_SYN, SYN_REPORT, 0);
+		queueSync();
+		flushWrites();
 	}
 
 	bool OutputHandler::sendUnicode(char32_t character) {
-		WindowInfo windowInfo = getActiveWindowInfo();
-		//bool isTerminal = windowInfo.isTerminal;
-		int isElectron = windowInfo.isElectron;
-		//std::cout << "electron: "<<isElectron<<"\n";
+		// Routes were decided for a keymap that is gone
+		if (sink->getKeymapChanges() != routesKeymap) {
+			routesKeymap = sink->getKeymapChanges();
+			routes.clear();
+		}
+
 		std::cout << "Hell yeah! Send in the " << utf32ToUtf8(character) << "\n";
-		if (isControlChar(character)) {
-			sendControlChar(character);
-			return true;
+
+		// Routes are only cached while the compositor pushes focus changes;
+		// otherwise nothing tells us that the window a route was decided for
+		// lost focus, so every character asks for the window again
+		bool sent = false;
+		if (trackedClass) {
+			if (const Route* cached = routes.find(character, trackedClassId)) {
+				sent = replayRoute(character, *cached);
+				if (!sent) {
+					routes.erase(character, trackedClassId);
+				}
+			}
+		}
+		if (!sent) {
+			Route route;
+			sent = decideRoute(character, focusedWindowInfo(), route);
+			if (sent && trackedClass) {
+				routes.store(character, trackedClassId, route);
+			}
 		}
 
-		if (isElectron && hasXdotool()) {
-			return sendUnicodeXdotool(character);
-		} else {//printf("wtype\n");
-			//if (hasWtype()) {
-				return sendUnicodeWtype(character);
-			//}
+		if (sent) {
+			if (auto expansion = expander.feed(character)) {
+				sendExpansion(*expansion);
+			}
+			return true;
 		}
 
 		std::cerr << "❌ Failed to send character: '";
@@ -222,14 +330,218 @@ namespace keydrive {
 		return false;
 	}
 
+	bool OutputHandler::decideRoute(char32_t character, const WindowInfo& windowInfo, Route& route) {
+		if (isControlChar(character)) {
+			sendControlChar(character);
+			route.backend = TextBackend::Uinput;
+			route.keyCode = static_cast<unsigned short>(controlKey(character));
+			return true;
+		}
+
+		// Helpers get the character's UTF-8 bytes when the route is replayed
+		std::string utf8 = utf32ToUtf8(character);
+		route.length = static_cast<uint8_t>(utf8.size());
+		std::memcpy(route.bytes, utf8.data(), utf8.size());
+
+		if (windowInfo.isElectron && sendTextXTest(std::u32string(1, character))) {
+			route.backend = TextBackend::XTest;
+		} else if (windowInfo.isElectron && hasXdotool()) {
+			if (!sendUnicodeXdotool(character)) {
+				return false;
+			}
+			route.backend = TextBackend::Xdotool;
+		} else {
+			if (!sendUnicodeWtype(character)) {
+				return false;
+			}
+			route.backend = TextBackend::Wtype;
+		}
+		metrics.charactersEmitted[static_cast<size_t>(route.backend)].add();
+		return true;
+	}
+
+	bool OutputHandler::replayRoute(char32_t character, const Route& route) {
+		bool sent = false;
+		switch (route.backend) {
+			case TextBackend::Uinput:
+				writeEvent(EV_KEY, route.keyCode, 1);
+				writeEvent(EV_KEY, route.keyCode, 0);
+				syncEvent();
+				sent = true;
+				break;
+			case TextBackend::XTest:
+				sent = sendTextXTest(std::u32string(1, character));
+				break;
+			case TextBackend::Xdotool:
+				sent = sendTextXdotool(std::string(route.bytes, route.length));
+				break;
+			case TextBackend::Wtype:
+				sent = sendTextWtype(std::string(route.bytes, route.length));
+				break;
+			default:
+				break;
+		}
+		if (sent) {
+			metrics.charactersEmitted[static_cast<size_t>(route.backend)].add();
+		}
+		return sent;
+	}
+
+	WindowInfo OutputHandler::focusedWindowInfo() {
+		if (!trackedClass) {
+			return getActiveWindowInfo();
+		}
+		WindowInfo info{};
+		info.windowClass = *trackedClass;
+		classifyWindow(info);
+		return info;
+	}
+
+	void OutputHandler::invalidateRoutes() {
+		routes.clear();
+	}
+
+	void OutputHandler::setWindowClass(const std::optional<std::string>& windowClass) {
+		// Typing continues somewhere else
+		expander.reset();
+		// Without a class, routes are decided per character again
+		trackedClass = windowClass;
+		if (windowClass) {
+			trackedClassId = routes.classId(*windowClass);
+		}
+	}
+
+	bool OutputHandler::sendText(const std::u32string& text) {
+		// Feed the matcher in emission order: a trigger completed inside the
+		// string is expanded before the rest of the string is typed
+		size_t start = 0;
+		for (size_t i = 0; i < text.size(); ++i) {
+			if (auto expansion = expander.feed(text[i])) {
+				if (!emitText(text.substr(start, i + 1 - start))) {
+					expander.reset();
+					return false;
+				}
+				sendExpansion(*expansion);
+				start = i + 1;
+			}
+		}
+		if (!emitText(text.substr(start))) {
+			expander.reset();
+			return false;
+		}
+		return true;
+	}
+
+	void OutputHandler::setAbbreviations(const std::vector<Abbreviation>& abbreviations) {
+		expander.compile(abbreviations);
+		if (!expander.empty()) {
+			std::cout << "✅ Text expansion enabled with " << abbreviations.size() << " abbreviations" << std::endl;
+		}
+	}
+
+	bool OutputHandler::emitText(const std::u32string& text) {
+		if (text.empty()) {
+			return true;
+		}
+
+		// Decide the target once for the whole string; X clients get XTest
+		// and fall back to xdotool
+		WindowInfo windowInfo = focusedWindowInfo();
+		bool xClient = windowInfo.isElectron;
+		bool useXdotool = xClient && hasXdotool();
+
+		// Printable runs (including spaces) go out in a single helper call;
+		// other control characters need real key taps in between
+		bool sent = true;
+		std::string pending;
+		std::u32string pendingText;
+		auto flush = [&]() {
+			if (!pending.empty()) {
+				TextBackend backend = useXdotool ? TextBackend::Xdotool : TextBackend::Wtype;
+				bool ok;
+				if (xClient && sendTextXTest(pendingText)) {
+					backend = TextBackend::XTest;
+					ok = true;
+				} else {
+					ok = useXdotool ? sendTextXdotool(pending) : sendTextWtype(pending);
+				}
+				if (ok) {
+					metrics.charactersEmitted[static_cast<size_t>(backend)].add(pendingText.size());
+				} else {
+					sent = false;
+				}
+				pending.clear();
+				pendingText.clear();
+			}
+		};
+
+		for (char32_t c : text) {
+			if (c != U' ' && isControlChar(c)) {
+				flush();
+				sendControlChar(c);
+			} else {
+				pending += utf32ToUtf8(c);
+				pendingText += c;
+			}
+		}
+		flush();
+
+		return sent;
+	}
+
+	void OutputHandler::sendExpansion(const Expansion& expansion) {
+		std::cout << "→ EXPAND: erasing " << expansion.erase << " characters" << std::endl;
+		// All backspaces go out in a single uinput write
+		for (size_t i = 0; i < expansion.erase; ++i) {
+			writeEvent(EV_KEY, KEY_BACKSPACE, 1);
+			queueSync();
+			writeEvent(EV_KEY, KEY_BACKSPACE, 0);
+			queueSync();
+		}
+		flushWrites();
+
+		// The replacement is not fed back into the matcher
+		if (!emitText(*expansion.replacement)) {
+			std::cerr << "❌ Failed to send expansion" << std::endl;
+		}
+	}
+
+	void OutputHandler::tapKey(unsigned int key) {
+		writeEvent(EV_KEY, key, 1);
+		queueSync();
+		writeEvent(EV_KEY, key, 0);
+		syncEvent();
+	}
+
 	void OutputHandler::forwardEvent(unsigned int code, int value) {
-		if (virtKb) {
-			std::cout << "Forwarding " << code << "!!!!\n";
-			libevdev_uinput_write_event(virtKb, EV_KEY, code, value);
-			syncEvent();
+		// Forwarded keys and mouse key clicks type text the matcher never saw
+		// or move the caret, so what was typed before no longer leads up to it
+		if (value == 1 && !isModifierKey(code)) {
+			if (code == KEY_BACKSPACE) {
+				expander.feed(U'\b');
+			} else {
+				expander.reset();
+			}
+		}
+
+		std::cout << "Forwarding " << code << "!!!!\n";
+		writeEvent(EV_KEY, code, value);
+		syncEvent();
+		metrics.forwarded.add();
+
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
 
-			std::this_thread::sleep_for(std::chrono::microseconds(100));
+	void OutputHandler::movePointer(int dx, int dy, int wheel, int hwheel) {
+		// One frame for all axes so motion and scrolling stay in step
+		if (dx) writeEvent(EV_REL, REL_X, dx);
+		if (dy) writeEvent(EV_REL, REL_Y, dy);
+		if (wheel) writeEvent(EV_REL, REL_WHEEL, wheel);
+		if (hwheel) writeEvent(EV_REL, REL_HWHEEL, hwheel);
+		if (pendingWrites.empty()) {
+			return;
 		}
+		syncEvent();
 	}
 
 	void OutputHandler::releaseAllModifiers() {
@@ -241,7 +553,7 @@ namespace keydrive {
 		};
 
 		for (unsigned int mod : modifiers) {
-			libevdev_uinput_write_event(virtKb, EV_KEY, mod, 0);
+			writeEvent(EV_KEY, mod, 0);
 		}
 		syncEvent();
 	}
@@ -250,7 +562,7 @@ namespace keydrive {
 		WindowInfo info;
 		info.isElectron = 0;
 		try {
-			auto [exitCode, output] = executeCommand("hyprctl activewindow -j", 200);
+			auto [exitCode, output] = runCommand("hyprctl activewindow -j", 200);
 
 			if (exitCode == 0 && !output.empty()) {
 				auto json = nlohmann::json::parse(output, nullptr, false);
@@ -259,29 +571,7 @@ namespace keydrive {
 					info.windowClass = json.value("class", "");
 					std::transform(info.windowClass.begin(), info.windowClass.end(),
 								   info.windowClass.begin(), ::tolower);
-
-					static const std::vector<std::string> electronApps = {
-						"code", "discord", "slack", "vscodium", "codium", "godot"
-					};
-
-					for (const auto& app : electronApps) {
-						if (info.windowClass.find(app) != std::string::npos) {
-							info.isElectron = 1;
-							break;
-						}
-					}
-
-					static const std::vector<std::string> terminalApps = {
-						"terminal", "alacritty", "kitty", "foot", "konsole", "org.kde.konsole"
-					};
-
-					for (const auto& term : terminalApps) {
-						if (info.windowClass.find(term) != std::string::npos) {
-							info.isTerminal = true;
-							break;
-						}
-					}
-
+					classifyWindow(info);
 					return info;
 				}
 			}
@@ -295,12 +585,34 @@ namespace keydrive {
 		return info;
 	}
 
+	std::pair<int, std::string> OutputHandler::runHelper(const std::vector<std::string>& argv, int timeoutMs) const {
+		return sink->run(argv, timeoutMs);
+	}
+
+	std::pair<int, std::string> OutputHandler::runCommand(const std::string& command, int timeoutMs) const {
+		std::vector<std::string> argv;
+		std::istringstream iss(command);
+		std::string token;
+		while (iss >> token) {
+			argv.push_back(token);
+		}
+		return runHelper(argv, timeoutMs);
+	}
+
+	const OutputMetrics& OutputHandler::getMetrics() const {
+		return metrics;
+	}
+
+	uint64_t OutputHandler::getHelperSpawnFailures() {
+		return DesktopSink::getSpawnFailures();
+	}
+
 	bool OutputHandler::hasWtype() const {
 		return fileExists("/usr/bin/wtype") || fileExists("/usr/local/bin/wtype");
 	}
 
 	bool OutputHandler::hasXdotool() const {
-		return fileExists("/usr/bin/xdotool") || fileExists("/usr/local/bin/xdotool");
+		return sink->hasXdotool();
 	}
 
 	bool OutputHandler::isControlChar(char32_t c) const {
@@ -308,27 +620,22 @@ namespace keydrive {
 	}
 
 	void OutputHandler::sendControlChar(char32_t c) {
-		unsigned int key = 0;
-
-		switch (c) {
-			case U'\n': key = KEY_ENTER; break;
-			case U' ': key = KEY_SPACE; break;
-			case U'\b': key = KEY_BACKSPACE; break;
-			case U'\t': key = KEY_TAB; break;
-			case U'\x1b': key = KEY_ESC; break;
-			default: return;
+		unsigned int key = controlKey(c);
+		if (key == 0) {
+			return;
 		}
 
-		libevdev_uinput_write_event(virtKb, EV_KEY, key, 1);
-		libevdev_uinput_write_event(virtKb, EV_KEY, key, 0);
+		writeEvent(EV_KEY, key, 1);
+		writeEvent(EV_KEY, key, 0);
 		syncEvent();
+		metrics.charactersEmitted[static_cast<size_t>(TextBackend::Uinput)].add();
 
 		std::cout << "→ CONTROL: " << std::string(1, static_cast<char>(c)) << std::endl;
 	}
 
 	bool OutputHandler::sendUnicodeWtype(char32_t c) {
 		std::string charStr = utf32ToUtf8(c);
-		auto [exitCode2, output] = executeCommand("wtype -- " + charStr);
+		auto [exitCode2, output] = runCommand("wtype -- " + charStr);
 		if (exitCode2 == 0) {
 			std::cout << "→ WTYPE: " << std::hex << charStr << std::endl;
 			return true;
@@ -343,7 +650,7 @@ namespace keydrive {
 			charStr = utf32ToUtf8(c);
 		}
 
-		auto [exitCode, output] = executeCommand("wtype -- '" + charStr + "'", 200);
+		auto [exitCode, output] = runCommand("wtype -- '" + charStr + "'", 200);
 
 		if (exitCode == 0) {
 			std::cout << "→ WTYPE (UNICODE): '";
@@ -367,12 +674,42 @@ namespace keydrive {
 		return false;*/
 	}
 
+	bool OutputHandler::sendTextWtype(const std::string& utf8) {
+		auto [exitCode, output] = runHelper({"wtype", "--", utf8});
+		if (exitCode == 0) {
+			std::cout << "→ WTYPE: " << utf8 << std::endl;
+			return true;
+		}
+		std::cerr << "⚠ wtype failed: " << output << std::endl;
+		return false;
+	}
+
+	bool OutputHandler::sendTextXTest(const std::u32string& text) {
+		if (!sink->typeX11(text)) {
+			return false;
+		}
+		std::cout << "→ XTEST: " << utf32ToUtf8(text) << std::endl;
+		return true;
+	}
+
+	bool OutputHandler::sendTextXdotool(const std::string& utf8) {
+		runCommand("setxkbmap");
+
+		auto [exitCode, output] = runHelper({"xdotool", "type", "--clearmodifiers", "--", utf8});
+		if (exitCode == 0) {
+			std::cout << "→ XDOTOOL: " << utf8 << std::endl;
+			return true;
+		}
+		std::cerr << "⚠ xdotool failed: " << output << std::endl;
+		return false;
+	}
+
 	bool OutputHandler::sendUnicodeXdotool(char32_t c) {
-		executeCommand("setxkbmap");
+		runCommand("setxkbmap");
 
 		std::string charStr = utf32ToUtf8(c);
 		std::cout << "xdotool type --clearmodifiers " << charStr << "\n";
-		auto [exitCode2, output] = executeCommand("xdotool type --clearmodifiers " + charStr);
+		auto [exitCode2, output] = runCommand("xdotool type --clearmodifiers " + charStr);
 		if (exitCode2 == 0) {
 			std::cout << "→ XDOTOOL: " << std::hex << charStr << std::endl;
 			return true;
@@ -386,12 +723,12 @@ namespace keydrive {
 			charStr = utf32ToUtf8(c);
 		}
 
-		auto [exitCode, output] = executeCommand("setxkbmap");
+		auto [exitCode, output] = runCommand("setxkbmap");
 
 		if (c < 128) {
 			char ch = static_cast<char>(c);
 			if (const char* symbolName = getSymbolName(ch)) {
-				auto [exitCode, output] = executeCommand("xdotool key --clearmodifiers " + std::string(symbolName), 200);
+				auto [exitCode, output] = runCommand("xdotool key --clearmodifiers " + std::string(symbolName), 200);
 				if (exitCode == 0) {
 					std::cout << "→ XDOTOOL (SYMBOL): '" << ch << "' (U+" << std::hex << static_cast<int>(c) << ")" << std::endl;
 					return true;
@@ -399,7 +736,7 @@ namespace keydrive {
 			}
 		}
 
-		auto [exitCode, output] = executeCommand("xdotool type --clearmodifiers '" + charStr + "'", 200);
+		auto [exitCode, output] = runCommand("xdotool type --clearmodifiers '" + charStr + "'", 200);
 
 		if (exitCode == 0) {
 			std::cout << "→ XDOTOOL (UNICODE): '";
@@ -2,10 +2,17 @@
 
 #include <string>
 #include <vector>
+#include <array>
 #include <unordered_map>
 #include <optional>
+#include <memory>
+#include <chrono>
 #include <libevdev/libevdev.h>
 #include <libevdev/libevdev-uinput.h>
+#include "text_expander.hpp"
+#include "output_sink.hpp"
+#include "route_cache.hpp"
+#include "metrics.hpp"
 
 namespace keydrive {
 
@@ -16,18 +23,91 @@ namespace keydrive {
 		int isTerminal;
 	};
 
+	/**
+	 * @brief Ways characters reach the focused application
+	 */
+	enum class TextBackend {
+		Uinput,   // Key taps on the virtual keyboard (control characters)
+		Wtype,
+		Xdotool,
+		XTest,    // In-process X11 typing (XWayland clients)
+		Count
+	};
+
+	/**
+	 * @brief Counters maintained by the thread driving the output
+	 */
+	struct OutputMetrics {
+		Counter forwarded;  // Key events forwarded to the virtual keyboard
+		std::array<Counter, static_cast<size_t>(TextBackend::Count)> charactersEmitted;  // By backend
+	};
+
+	const char* textBackendName(TextBackend backend);
+
 	class OutputHandler {
 	public:
-		OutputHandler();
+		// Create the virtual keyboard with the keys, IDs and repeat settings of the
+		// grabbed keyboard plus the few keys keydrive emits on its own; without a
+		// keyboard every key code is announced
+		explicit OutputHandler(const libevdev* keyboard);
+
+		// Write to a uinput device handed over by a previous instance (takes ownership)
+		explicit OutputHandler(int adoptedFd);
+
+		// Send everything to the given sink instead of the desktop (load generator)
+		explicit OutputHandler(OutputSink& sink);
 		~OutputHandler();
 
+		OutputHandler(const OutputHandler&) = delete;
+		OutputHandler& operator=(const OutputHandler&) = delete;
+
 		bool sendUnicode(char32_t character);
+		bool sendText(const std::u32string& text);
+		void setAbbreviations(const std::vector<Abbreviation>& abbreviations);
 		void forwardEvent(unsigned int code, int value);
+		void movePointer(int dx, int dy, int wheel, int hwheel);
 		void releaseAllModifiers();
 		WindowInfo getActiveWindowInfo() const;
+
+		/**
+		 * @brief Follow the focused window's class as pushed by the compositor
+		 *
+		 * From then on characters are routed by this class instead of asking
+		 * hyprctl for the active window each time, and the backend chosen per
+		 * character and class is cached. Without it no route is cached, as
+		 * nothing would tell when the focused window changes.
+		 *
+		 * @param windowClass Lowercase class of the focused window, or nullopt
+		 *                    to go back to asking hyprctl (compositor connection lost)
+		 */
+		void setWindowClass(const std::optional<std::string>& windowClass);
+
+		/**
+		 * @brief Forget how characters were routed (layout switched or reloaded)
+		 */
+		void invalidateRoutes();
+
+		/**
+		 * @brief Queue writes to the virtual keyboard on the reactor
+		 *
+		 * See DesktopSink::writeThrough(); without a desktop sink this does nothing.
+		 *
+		 * @param reactor Loop to write through, or nullptr to write() directly
+		 */
+		void writeThrough(Reactor* reactor);
+
+		// Keep the uinput device alive past our destructor and return its fd
+		int detachForHandover();
+		// Own the device again after a handover failed
+		void resumeAfterHandover();
 		bool hasWtype() const;
 		bool hasXdotool() const;
 
+		const OutputMetrics& getMetrics() const;
+
+		// Helper processes (wtype, xdotool, hyprctl) that could not be started
+		static uint64_t getHelperSpawnFailures();
+
 	private:
 		struct SymbolMapping {
 			char character;
@@ -40,6 +120,31 @@ namespace keydrive {
 		struct libevdev* dev = nullptr;
 		struct libevdev_uinput* virtKb = nullptr;
 
+		// Set instead of virtKb when the device was adopted on handover
+		int uinputFd = -1;
+		bool handedOver = false;
+
+		// Where writes, helpers and X11 text go: the desktop sink over the
+		// device above, or the one passed in
+		std::unique_ptr<DesktopSink> desktop;
+		OutputSink* sink = nullptr;
+
+		// Events waiting for the next flush (one write() per emission)
+		std::vector<input_event> pendingWrites;
+
+		OutputMetrics metrics;
+
+		// Abbreviation matcher fed with every character we emit
+		TextExpander expander;
+
+		// Backend that worked per character and focused window class (only
+		// used while the compositor pushes the class)
+		RouteCache routes;
+		std::optional<std::string> trackedClass;
+		uint32_t trackedClassId = 0;
+		// Sink keymap the routes were decided under
+		uint64_t routesKeymap = 0;
+
 		static constexpr SymbolMapping symbolMap[] = {
 			{',', "comma"},
 			{'.', "period"},
@@ -74,11 +179,28 @@ namespace keydrive {
 			{'"', "quotedbl"}
 		};
 
+		// Start a helper process through the sink
+		std::pair<int, std::string> runHelper(const std::vector<std::string>& argv, int timeoutMs = 200) const;
+		// Split on whitespace; use runHelper when an argument may contain spaces
+		std::pair<int, std::string> runCommand(const std::string& command, int timeoutMs = 200) const;
+
 		bool isControlChar(char32_t c) const;
 		void sendControlChar(char32_t c);
 		bool sendUnicodeWtype(char32_t c);
 		bool sendUnicodeXdotool(char32_t c);
+		bool sendTextXTest(const std::u32string& text);
+		WindowInfo focusedWindowInfo();
+		bool decideRoute(char32_t character, const WindowInfo& windowInfo, Route& route);
+		bool replayRoute(char32_t character, const Route& route);
+		bool emitText(const std::u32string& text);
+		bool sendTextWtype(const std::string& utf8);
+		bool sendTextXdotool(const std::string& utf8);
+		void sendExpansion(const Expansion& expansion);
+		void tapKey(unsigned int key);
 		const char* getSymbolName(char c) const;
+		void writeEvent(unsigned int type, unsigned int code, int value);
+		void queueSync();
+		void flushWrites();
 		void syncEvent();
 	};
 
@@ -0,0 +1,150 @@
+#include "output_sink.hpp"
+#include "metrics.hpp"
+#include "reactor.hpp"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <csignal>
+#include <chrono>
+
+namespace keydrive {
+
+	namespace {
+
+		// Helpers are spawned from the main thread only
+		Counter helperSpawnFailures;
+
+		// Exit status of a child whose exec failed (as in the shell)
+		constexpr int EXEC_FAILED = 127;
+
+		bool fileExists(const std::string& path) {
+			struct stat buffer;
+			return stat(path.c_str(), &buffer) == 0;
+		}
+
+	} // anonymous namespace
+
+	std::pair<int, std::string> runProcess(const std::vector<std::string>& argv, int timeoutMs) {
+		int pipefd[2];
+		if (pipe(pipefd) == -1) {
+			helperSpawnFailures.add();
+			return {-1, "Failed to create pipe"};
+		}
+
+		pid_t pid = fork();
+		if (pid == -1) {
+			close(pipefd[0]);
+			close(pipefd[1]);
+			helperSpawnFailures.add();
+			return {-1, "Failed to fork"};
+		}
+
+		if (pid == 0) {
+			close(pipefd[0]);
+			dup2(pipefd[1], STDOUT_FILENO);
+			dup2(pipefd[1], STDERR_FILENO);
+			close(pipefd[1]);
+
+			// The daemon blocks its signals for the signalfd; don't pass that on
+			sigset_t mask;
+			sigemptyset(&mask);
+			sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+			std::vector<char*> args;
+			for (const auto& arg : argv) {
+				args.push_back(strdup(arg.c_str()));
+			}
+			args.push_back(nullptr);
+
+			execvp(args[0], args.data());
+			_exit(EXEC_FAILED);
+		} else {
+			close(pipefd[1]);
+
+			auto start = std::chrono::steady_clock::now();
+			std::string output;
+			char buffer[128];
+			ssize_t bytesRead;
+
+			while ((bytesRead = read(pipefd[0], buffer, sizeof(buffer) - 1)) > 0) {
+				buffer[bytesRead] = '\0';
+				output += buffer;
+
+				auto now = std::chrono::steady_clock::now();
+				auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
+				if (elapsed.count() > timeoutMs) {
+					kill(pid, SIGTERM);
+					waitpid(pid, nullptr, 0);
+					close(pipefd[0]);
+					return {-1, "Command timed out"};
+				}
+			}
+
+			close(pipefd[0]);
+
+			int status;
+			waitpid(pid, &status, 0);
+
+			if (WIFEXITED(status)) {
+				if (WEXITSTATUS(status) == EXEC_FAILED) {
+					helperSpawnFailures.add();
+				}
+				return {WEXITSTATUS(status), output};
+			} else {
+				return {-1, "Command terminated abnormally"};
+			}
+		}
+	}
+
+	DesktopSink::DesktopSink(int uinputFd) : uinputFd(uinputFd) {
+	}
+
+	void DesktopSink::writeThrough(Reactor* reactor) {
+		completeWrites();
+		this->reactor = reactor;
+	}
+
+	void DesktopSink::completeWrites() {
+		if (reactor) {
+			reactor->completeWrites();
+		}
+	}
+
+	bool DesktopSink::write(const input_event* events, size_t count) {
+		size_t bytes = count * sizeof(input_event);
+		bool written = reactor ? reactor->write(uinputFd, events, bytes)
+		                       : ::write(uinputFd, events, bytes) == static_cast<ssize_t>(bytes);
+		if (!written) {
+			std::cerr << "⚠ uinput write failed: " << std::strerror(errno) << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	std::pair<int, std::string> DesktopSink::run(const std::vector<std::string>& argv, int timeoutMs) {
+		// Keys written before (releasing modifiers) must reach the compositor first
+		completeWrites();
+		return runProcess(argv, timeoutMs);
+	}
+
+	bool DesktopSink::typeX11(const std::u32string& text) {
+		completeWrites();
+		return xtest.type(text);
+	}
+
+	bool DesktopSink::hasXdotool() const {
+		return fileExists("/usr/bin/xdotool") || fileExists("/usr/local/bin/xdotool");
+	}
+
+	uint64_t DesktopSink::getKeymapChanges() const {
+		return xtest.getKeymapChanges();
+	}
+
+	uint64_t DesktopSink::getSpawnFailures() {
+		return helperSpawnFailures.get();
+	}
+
+} // namespace keydrive
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <linux/input.h>
+#include "xtest_output.hpp"
+
+namespace keydrive {
+
+	class Reactor;
+
+	/**
+	 * @brief Where OutputHandler's effects end up: uinput writes, helper
+	 * processes and in-process X11 typing
+	 *
+	 * The daemon uses DesktopSink; the load generator substitutes a sink that
+	 * records and charges a modelled cost instead.
+	 */
+	class OutputSink {
+	public:
+		virtual ~OutputSink() = default;
+
+		/**
+		 * @brief Write events to the virtual keyboard in one write()
+		 *
+		 * @return true if all events were written
+		 */
+		virtual bool write(const input_event* events, size_t count) = 0;
+
+		/**
+		 * @brief Run a helper process (wtype, xdotool, hyprctl, ...) and wait for it
+		 *
+		 * @return Exit status (-1 if it could not run or timed out) and its output
+		 */
+		virtual std::pair<int, std::string> run(const std::vector<std::string>& argv, int timeoutMs) = 0;
+
+		/**
+		 * @brief Type text into the focused X client without a helper
+		 *
+		 * @return true if every character was sent
+		 */
+		virtual bool typeX11(const std::u32string& text) = 0;
+
+		/**
+		 * @brief Check whether the xdotool fallback is available
+		 */
+		virtual bool hasXdotool() const = 0;
+
+		/**
+		 * @brief Count of keymap changes seen by typeX11() so far
+		 *
+		 * Routes decided before a change are dropped.
+		 */
+		virtual uint64_t getKeymapChanges() const = 0;
+	};
+
+	/**
+	 * @brief Start a process and wait for it, collecting stdout and stderr
+	 *
+	 * Counted in DesktopSink::getSpawnFailures() if it cannot be started.
+	 *
+	 * @return Exit status (-1 if it could not run or timed out) and its output
+	 */
+	std::pair<int, std::string> runProcess(const std::vector<std::string>& argv, int timeoutMs);
+
+	/**
+	 * @brief The real desktop: a uinput device, fork/exec'd helpers and XTest
+	 */
+	class DesktopSink : public OutputSink {
+	public:
+		/**
+		 * @param uinputFd Virtual keyboard to write to (not owned)
+		 */
+		explicit DesktopSink(int uinputFd);
+
+		/**
+		 * @brief Queue uinput writes on the reactor instead of writing them here
+		 *
+		 * On io_uring they then go out with the loop's next wait. Queued writes
+		 * are completed before a helper runs or text is typed through XTest.
+		 *
+		 * @param reactor Loop to write through, or nullptr to write() directly
+		 */
+		void writeThrough(Reactor* reactor);
+
+		/**
+		 * @brief Wait until the writes queued on the reactor are done
+		 */
+		void completeWrites();
+
+		bool write(const input_event* events, size_t count) override;
+		std::pair<int, std::string> run(const std::vector<std::string>& argv, int timeoutMs) override;
+		bool typeX11(const std::u32string& text) override;
+		bool hasXdotool() const override;
+		uint64_t getKeymapChanges() const override;
+
+		// Helper processes that could not be started (all desktop sinks)
+		static uint64_t getSpawnFailures();
+
+	private:
+		int uinputFd;
+		Reactor* reactor = nullptr;
+
+		// X11 clients; connects on the first character sent to one
+		XTestOutput xtest;
+	};
+
+} // namespace keydrive
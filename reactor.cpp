@@ -0,0 +1,390 @@
+#include "reactor.hpp"
+#include "io_ring.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <deque>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+namespace keydrive {
+
+	namespace {
+
+		constexpr int MAX_EVENTS = 32;
+		constexpr unsigned int URING_ENTRIES = 64;
+		// Longest chain of linked writes in one submission; always leaves room
+		// in the submission queue for poll (re)arms
+		constexpr size_t MAX_WRITE_CHAIN = 32;
+
+		// user_data of an armed poll: generation in the high half, fd in the low half.
+		// Writes have the top bit set and their index in the chain below it.
+		// 0 marks completions we don't care about (cancellations).
+		constexpr uint64_t WRITE_KEY = uint64_t{1} << 63;
+
+		uint64_t pollKey(int fd, uint32_t generation) {
+			return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+		}
+
+	} // anonymous namespace
+
+	struct Reactor::Uring {
+		IoRing ring{URING_ENTRIES};
+
+		struct Completion {
+			uint64_t key;
+			int32_t result;
+			bool more;
+		};
+		// Poll completions reaped but not dispatched yet; completeWrites()
+		// reaps them too while it waits
+		std::vector<Completion> completions;
+		std::vector<Completion> dispatched;
+
+		struct QueuedWrite {
+			int fd;
+			std::vector<char> data;
+		};
+		// Writes waiting for the chain in flight, and that chain. Links only
+		// order the SQEs of one submission, so the next chain goes out once
+		// the previous one has completed. A chain completes with one CQE: its
+		// last write's, or that of the write that failed (the kernel skips
+		// the others).
+		std::deque<QueuedWrite> queuedWrites;
+		std::vector<QueuedWrite> chain;
+		bool chainInFlight = false;
+	};
+
+	Reactor::Reactor() {
+		if (ioRingAllowed()) {
+			try {
+				auto candidate = std::make_unique<Uring>();
+				// Multishot polls came with Linux 5.13, skipping write completions with 5.17
+				if (!(candidate->ring.features() & IORING_FEAT_CQE_SKIP) || !candidate->ring.supports(IORING_OP_WRITE)) {
+					throw std::runtime_error("needs Linux 5.17");
+				}
+				candidate->completions.reserve(URING_ENTRIES);
+				candidate->dispatched.reserve(URING_ENTRIES);
+				uring = std::move(candidate);
+				return;
+			} catch (const std::runtime_error& e) {
+				std::cerr << "⚠ io_uring unavailable (" << e.what() << "), falling back to epoll" << std::endl;
+			}
+		}
+		epollFd = epoll_create1(EPOLL_CLOEXEC);
+		if (epollFd < 0) {
+			throw std::runtime_error("Failed to create epoll instance: " + std::string(std::strerror(errno)));
+		}
+	}
+
+	Reactor::~Reactor() {
+		completeWrites();
+		if (signalFd >= 0) {
+			close(signalFd);
+		}
+		if (epollFd >= 0) {
+			close(epollFd);
+		}
+	}
+
+	void Reactor::add(int fd, uint32_t events, Handler handler) {
+		Watch watch{std::make_shared<Handler>(std::move(handler)), events, nextGeneration++};
+
+		if (uring) {
+			armUringPoll(fd, watch);
+		} else {
+			epoll_event ev{};
+			ev.events = events;
+			ev.data.fd = fd;
+			if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+				throw std::runtime_error("Failed to watch fd " + std::to_string(fd) + ": " + std::strerror(errno));
+			}
+		}
+		handlers[fd] = std::move(watch);
+	}
+
+	void Reactor::modify(int fd, uint32_t events) {
+		auto it = handlers.find(fd);
+		if (it == handlers.end()) {
+			return;
+		}
+
+		if (uring) {
+			// Polls can't be edited in place: cancel and re-arm under a new generation
+			cancelUringPoll(fd, it->second);
+			it->second.events = events;
+			it->second.generation = nextGeneration++;
+			armUringPoll(fd, it->second);
+			return;
+		}
+
+		it->second.events = events;
+		epoll_event ev{};
+		ev.events = events;
+		ev.data.fd = fd;
+		if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+			std::cerr << "⚠ Failed to modify fd " << fd << ": " << std::strerror(errno) << std::endl;
+		}
+	}
+
+	void Reactor::remove(int fd) {
+		auto it = handlers.find(fd);
+		if (it == handlers.end()) {
+			return;
+		}
+
+		if (uring) {
+			cancelUringPoll(fd, it->second);
+		} else {
+			epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+		}
+		handlers.erase(it);
+	}
+
+	void Reactor::addSignals(const std::vector<int>& signals, SignalHandler handler) {
+		sigset_t mask;
+		sigemptyset(&mask);
+		for (int sig : signals) {
+			sigaddset(&mask, sig);
+		}
+
+		// Signals must be blocked so they queue on the signalfd instead
+		if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+			throw std::runtime_error("Failed to block signals");
+		}
+
+		signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (signalFd < 0) {
+			throw std::runtime_error("Failed to create signalfd: " + std::string(std::strerror(errno)));
+		}
+
+		add(signalFd, EPOLLIN, [this, handler = std::move(handler)](uint32_t) {
+			signalfd_siginfo info;
+			while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+				handler(static_cast<int>(info.ssi_signo));
+			}
+		});
+	}
+
+	bool Reactor::write(int fd, const void* data, size_t size) {
+		if (!uring) {
+			return ::write(fd, data, size) == static_cast<ssize_t>(size);
+		}
+
+		const char* bytes = static_cast<const char*>(data);
+		uring->queuedWrites.push_back({fd, std::vector<char>(bytes, bytes + size)});
+		if (!dispatching) {
+			// Outside the loop (startup, shutdown) nothing would submit it soon
+			completeWrites();
+		}
+		return true;
+	}
+
+	void Reactor::completeWrites() {
+		if (!uring) {
+			return;
+		}
+		while (!uring->queuedWrites.empty() || uring->chainInFlight) {
+			submitWriteChain();
+			int rc = uring->ring.submitAndWait(1);
+			if (rc < 0 && rc != -EINTR) {
+				std::cerr << "⚠ io_uring wait for writes failed: " << std::strerror(-rc) << std::endl;
+				return;
+			}
+			reapUring();
+		}
+	}
+
+	void Reactor::run() {
+		running = true;
+		while (running) {
+			runOnce(-1);
+		}
+		// Writes queued by the handler that stopped us
+		completeWrites();
+	}
+
+	void Reactor::runOnce(int timeout_ms) {
+		if (uring) {
+			runOnceUring(timeout_ms);
+		} else {
+			runOnceEpoll(timeout_ms);
+		}
+	}
+
+	void Reactor::runOnceEpoll(int timeout_ms) {
+		epoll_event events[MAX_EVENTS];
+		int count = epoll_wait(epollFd, events, MAX_EVENTS, timeout_ms);
+		if (count < 0) {
+			if (errno != EINTR) {
+				std::cerr << "⚠ epoll_wait failed: " << std::strerror(errno) << std::endl;
+			}
+			return;
+		}
+
+		for (int i = 0; i < count; ++i) {
+			// Look the handler up each time: an earlier handler may have removed it
+			auto it = handlers.find(events[i].data.fd);
+			if (it == handlers.end()) {
+				continue;
+			}
+			std::shared_ptr<Handler> handler = it->second.handler;
+			(*handler)(events[i].events);
+		}
+	}
+
+	void Reactor::runOnceUring(int timeout_ms) {
+		// Queued writes, poll (re)arms and cancellations go out with the wait:
+		// one syscall. Completions reaped meanwhile are dispatched without waiting.
+		bool chainSubmitted = submitWriteChain();
+		unsigned int waitNr = uring->completions.empty() ? 1 : 0;
+		if (waitNr > 0 && chainSubmitted) {
+			// The chain's completion alone must not end the wait, or every
+			// keystroke would take a second round. Until the chain is done
+			// the loop waits on it, as it would block in a plain write().
+			++waitNr;
+		}
+		int rc = uring->ring.submitAndWait(waitNr, timeout_ms);
+		if (rc < 0 && rc != -ETIME && rc != -EINTR) {
+			std::cerr << "⚠ io_uring wait failed: " << std::strerror(-rc) << std::endl;
+			return;
+		}
+		reapUring();
+
+		// Handlers may reap more (completeWrites()); those wait for the next round
+		auto& completions = uring->dispatched;
+		std::swap(completions, uring->completions);
+
+		dispatching = true;
+		for (const auto& completion : completions) {
+			int fd = static_cast<int>(completion.key & 0xffffffffu);
+			uint32_t generation = static_cast<uint32_t>(completion.key >> 32);
+			auto it = handlers.find(fd);
+			if (it == handlers.end() || it->second.generation != generation) {
+				continue;  // Removed or re-added since this poll fired
+			}
+
+			uint32_t events = static_cast<uint32_t>(completion.result);
+			if (completion.result < 0) {
+				// A failed poll ends without F_MORE. Short of memory it is worth
+				// another try; otherwise the fd can't be polled and its handler
+				// gets EPOLLERR, as epoll reports it.
+				int error = -completion.result;
+				if (error == ENOMEM || error == EAGAIN || error == ECANCELED) {
+					armUringPoll(fd, it->second);
+					continue;
+				}
+				std::cerr << "⚠ io_uring poll on fd " << fd << " failed: " << std::strerror(error) << ", no longer watched" << std::endl;
+				events = EPOLLERR;
+			} else if (!completion.more) {
+				// The kernel may end a multishot poll (e.g. on overflow); re-arm it
+				armUringPoll(fd, it->second);
+			}
+
+			std::shared_ptr<Handler> handler = it->second.handler;
+			(*handler)(events);
+		}
+		dispatching = false;
+		completions.clear();
+	}
+
+	void Reactor::reapUring() {
+		uring->ring.forEachCompletion([this](const io_uring_cqe& cqe) {
+			if (cqe.user_data == 0) {
+				return;
+			}
+			if (!(cqe.user_data & WRITE_KEY)) {
+				uring->completions.push_back({cqe.user_data, cqe.res, (cqe.flags & IORING_CQE_F_MORE) != 0});
+				return;
+			}
+
+			size_t index = cqe.user_data & ~WRITE_KEY;
+			const auto& written = uring->chain[index];
+			size_t dropped = uring->chain.size() - index - 1;
+			if (cqe.res < 0) {
+				std::cerr << "⚠ Write to fd " << written.fd << " failed: " << std::strerror(-cqe.res) << std::endl;
+			} else if (static_cast<size_t>(cqe.res) != written.data.size()) {
+				std::cerr << "⚠ Short write to fd " << written.fd << ": " << cqe.res << " of " << written.data.size() << " bytes" << std::endl;
+			}
+			if (dropped > 0) {
+				std::cerr << "  " << dropped << " later writes dropped" << std::endl;
+			}
+			uring->chain.clear();
+			uring->chainInFlight = false;
+		});
+	}
+
+	bool Reactor::submitWriteChain() {
+		if (uring->chainInFlight || uring->queuedWrites.empty()) {
+			return false;
+		}
+		// The chain must not be split by getSqe() submitting a full queue
+		if (uring->ring.queued() + MAX_WRITE_CHAIN > URING_ENTRIES) {
+			uring->ring.submitAndWait(0);
+		}
+
+		auto& chain = uring->chain;
+		while (!uring->queuedWrites.empty() && chain.size() < MAX_WRITE_CHAIN) {
+			chain.push_back(std::move(uring->queuedWrites.front()));
+			uring->queuedWrites.pop_front();
+		}
+
+		io_uring_sqe* previous = nullptr;
+		for (size_t i = 0; i < chain.size(); ++i) {
+			io_uring_sqe* sqe = uring->ring.getSqe();
+			if (previous) {
+				// Each write starts only once the one before it has completed,
+				// and only the chain's last or failed write posts a completion
+				previous->flags |= IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+			}
+			sqe->opcode = IORING_OP_WRITE;
+			sqe->fd = chain[i].fd;
+			sqe->addr = reinterpret_cast<uint64_t>(chain[i].data.data());
+			sqe->len = static_cast<uint32_t>(chain[i].data.size());
+			sqe->off = static_cast<uint64_t>(-1);  // Current position, as write() does
+			sqe->user_data = WRITE_KEY | i;
+			previous = sqe;
+		}
+		uring->chainInFlight = true;
+		return true;
+	}
+
+	void Reactor::armUringPoll(int fd, const Watch& watch) {
+		io_uring_sqe* sqe = uring->ring.getSqe();
+		if (!sqe) {
+			throw std::runtime_error("io_uring submission queue exhausted");
+		}
+		// epoll and poll event bits share values (EPOLLIN == POLLIN, ...)
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = fd;
+		sqe->len = IORING_POLL_ADD_MULTI;
+		sqe->poll32_events = watch.events;
+		sqe->user_data = pollKey(fd, watch.generation);
+	}
+
+	void Reactor::cancelUringPoll(int fd, const Watch& watch) {
+		io_uring_sqe* sqe = uring->ring.getSqe();
+		if (!sqe) {
+			return;
+		}
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->addr = pollKey(fd, watch.generation);
+		sqe->user_data = 0;
+	}
+
+	void Reactor::stop() {
+		running = false;
+	}
+
+	bool Reactor::isRunning() const {
+		return running;
+	}
+
+	const char* Reactor::backendName() const {
+		return uring ? "io_uring" : "epoll";
+	}
+
+} // namespace keydrive
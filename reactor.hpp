@@ -0,0 +1,141 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+namespace keydrive {
+
+	/**
+	 * @brief Single-threaded event loop driving the daemon
+	 *
+	 * Runs on io_uring when the kernel allows it: watched fds get multishot
+	 * polls, and writes queued with write() are submitted as linked SQEs
+	 * together with the next wait. Falls back to epoll and plain write()s
+	 * otherwise, or when KEYDRIVE_REACTOR=epoll is set.
+	 */
+	class Reactor {
+	public:
+		using Handler = std::function<void(uint32_t events)>;
+		using SignalHandler = std::function<void(int signal)>;
+
+		/**
+		 * @brief Construct a new Reactor object
+		 *
+		 * @throws std::runtime_error if neither io_uring nor epoll can be set up
+		 */
+		Reactor();
+		~Reactor();
+
+		Reactor(const Reactor&) = delete;
+		Reactor& operator=(const Reactor&) = delete;
+
+		/**
+		 * @brief Watch a file descriptor
+		 *
+		 * Handlers should drain their fd (read until EAGAIN): on io_uring a
+		 * multishot poll only fires again on new activity.
+		 *
+		 * @param fd File descriptor to watch (not owned)
+		 * @param events epoll event mask (EPOLLIN, EPOLLOUT, ...)
+		 * @param handler Called with the ready events
+		 */
+		void add(int fd, uint32_t events, Handler handler);
+
+		/**
+		 * @brief Change the event mask of a watched file descriptor
+		 */
+		void modify(int fd, uint32_t events);
+
+		/**
+		 * @brief Stop watching a file descriptor (safe to call from a handler)
+		 */
+		void remove(int fd);
+
+		/**
+		 * @brief Deliver signals through a signalfd instead of async handlers
+		 *
+		 * Blocks the signals for the calling thread. Call this before any other
+		 * thread is started so every thread inherits the mask.
+		 *
+		 * @param signals Signals to route into the loop
+		 * @param handler Called from the loop for each delivered signal
+		 * @throws std::runtime_error if the signalfd cannot be created
+		 */
+		void addSignals(const std::vector<int>& signals, SignalHandler handler);
+
+		/**
+		 * @brief Write to a file descriptor in order with earlier writes to it
+		 *
+		 * On io_uring the data is copied and, from a handler, goes to the
+		 * kernel with the loop's next wait, linked to the writes queued before
+		 * it; elsewhere it is waited for right away. Otherwise this is a plain
+		 * write().
+		 *
+		 * @return false if the write failed or could not be queued (a queued
+		 *         write that fails later is logged)
+		 */
+		bool write(int fd, const void* data, size_t size);
+
+		/**
+		 * @brief Wait until every queued write is done
+		 *
+		 * For whatever has to come after them: helper processes, X11 typing,
+		 * handing the device over.
+		 */
+		void completeWrites();
+
+		/**
+		 * @brief Dispatch events until stop() is called
+		 */
+		void run();
+
+		/**
+		 * @brief Wait for and dispatch one batch of events
+		 *
+		 * @param timeout_ms Timeout in milliseconds (-1 waits forever)
+		 */
+		void runOnce(int timeout_ms);
+
+		/**
+		 * @brief Make run() return after the current batch
+		 */
+		void stop();
+
+		bool isRunning() const;
+
+		/**
+		 * @brief Get the active backend ("io_uring" or "epoll")
+		 */
+		const char* backendName() const;
+
+	private:
+		struct Watch {
+			std::shared_ptr<Handler> handler;
+			uint32_t events;
+			uint32_t generation;  // Distinguishes re-added fds from stale completions
+		};
+
+		struct Uring;
+
+		void runOnceEpoll(int timeout_ms);
+		void runOnceUring(int timeout_ms);
+		void armUringPoll(int fd, const Watch& watch);
+		void cancelUringPoll(int fd, const Watch& watch);
+		void reapUring();
+		// Returns true if a chain went out with the next submission
+		bool submitWriteChain();
+
+		int epollFd = -1;
+		int signalFd = -1;
+		bool running = false;
+		bool dispatching = false;
+		uint32_t nextGeneration = 1;
+		std::unordered_map<int, Watch> handlers;
+		std::unique_ptr<Uring> uring;
+	};
+
+} // namespace keydrive
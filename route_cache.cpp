@@ -0,0 +1,49 @@
+#include "route_cache.hpp"
+
+namespace keydrive {
+
+	uint32_t RouteCache::classId(const std::string& windowClass) {
+		auto found = classIds.find(windowClass);
+		if (found != classIds.end()) {
+			return found->second;
+		}
+		uint32_t id = static_cast<uint32_t>(classIds.size());
+		classIds.emplace(windowClass, id);
+		return id;
+	}
+
+	const Route* RouteCache::find(char32_t character, uint32_t windowClassId) const {
+		const Slot& slot = slots[slotFor(character, windowClassId)];
+		if (slot.used && slot.character == character && slot.windowClassId == windowClassId) {
+			return &slot.route;
+		}
+		return nullptr;
+	}
+
+	void RouteCache::store(char32_t character, uint32_t windowClassId, const Route& route) {
+		Slot& slot = slots[slotFor(character, windowClassId)];
+		slot.character = character;
+		slot.windowClassId = windowClassId;
+		slot.used = true;
+		slot.route = route;
+	}
+
+	void RouteCache::erase(char32_t character, uint32_t windowClassId) {
+		Slot& slot = slots[slotFor(character, windowClassId)];
+		if (slot.character == character && slot.windowClassId == windowClassId) {
+			slot.used = false;
+		}
+	}
+
+	void RouteCache::clear() {
+		for (Slot& slot : slots) {
+			slot.used = false;
+		}
+	}
+
+	size_t RouteCache::slotFor(char32_t character, uint32_t windowClassId) {
+		uint32_t hash = static_cast<uint32_t>(character) * 0x9E3779B1u ^ windowClassId * 0x85EBCA6Bu;
+		return (hash ^ (hash >> 16)) & (SLOTS - 1);
+	}
+
+} // namespace keydrive
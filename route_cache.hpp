@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace keydrive {
+
+	enum class TextBackend;
+
+	/**
+	 * @brief How a character last reached a window class, ready to replay
+	 */
+	struct Route {
+		TextBackend backend{};
+		unsigned short keyCode = 0;  // Uinput: the key to tap
+		uint8_t length = 0;          // Helpers: UTF-8 encoding of the character
+		char bytes[4] = {};
+	};
+
+	/**
+	 * @brief Direct-mapped cache of output routes per (code point, window class)
+	 *
+	 * The backend that worked for a character in a window class doesn't change
+	 * while focus stays on that class, so repeated characters skip the window
+	 * lookup, the control character check and the tool probes. Each key maps
+	 * to one slot; a colliding character simply replaces it. OutputHandler
+	 * only uses it while the compositor pushes the focused window's class,
+	 * and clears it when the layout or the X keymap changes.
+	 */
+	class RouteCache {
+	public:
+		static constexpr size_t SLOTS = 256;
+
+		/**
+		 * @brief Get a small id for a window class (interned on first use, never reused)
+		 */
+		uint32_t classId(const std::string& windowClass);
+
+		const Route* find(char32_t character, uint32_t windowClassId) const;
+		void store(char32_t character, uint32_t windowClassId, const Route& route);
+
+		/**
+		 * @brief Forget one route (its backend failed)
+		 */
+		void erase(char32_t character, uint32_t windowClassId);
+
+		/**
+		 * @brief Forget every route (layout or keymap changed); class ids stay valid
+		 */
+		void clear();
+
+	private:
+		struct Slot {
+			char32_t character = 0;
+			uint32_t windowClassId = 0;
+			bool used = false;
+			Route route;
+		};
+
+		static size_t slotFor(char32_t character, uint32_t windowClassId);
+
+		std::array<Slot, SLOTS> slots{};
+		std::unordered_map<std::string, uint32_t> classIds;
+	};
+
+} // namespace keydrive
@@ -0,0 +1,126 @@
+#!/bin/sh
+# Type non-Latin-1 text through XTestOutput into a private Xvfb server and
+# check that an X client receives the same keysyms, also while Shift is
+# held, and that the keymap is back to what it was once the output is gone.
+#
+# Needs Xvfb, xev, xmodmap, stdbuf, pkg-config, g++ and the libX11/libXtst
+# development files.
+# Usage: scripts/check-xtest.sh [display]   (default :99)
+set -eu
+
+display=${1:-:99}
+repo=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+xvfb=
+xev=
+cleanup() {
+	[ -n "$xev" ] && kill "$xev" 2>/dev/null
+	[ -n "$xvfb" ] && kill "$xvfb" 2>/dev/null
+	rm -rf "$work"
+}
+trap cleanup EXIT INT TERM
+
+# Greek, arrows, CJK and an emoji: none of them is on a default keymap
+text='αβγ→漢字😀'
+expected='0x10003b1 0x10003b2 0x10003b3 0x1002192 0x1006f22 0x1005b57 0x101f600'
+# With Shift held: a key of the keymap and a spare-bound letter, which
+# arrive as '!' and 'É' if Shift stays down
+shiftText='1é'
+shiftExpected='0x31 0xe9'
+
+cat > "$work/type.cpp" <<'EOF'
+#include "xtest_output.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+// type <display> [shift]: with "shift", Shift is held on another connection
+// while typing, as a Shift forwarded to the virtual keyboard would be
+int main(int argc, char* argv[]) {
+	std::string displayName = argc > 1 ? argv[1] : "";
+	bool holdShift = argc > 2 && std::string(argv[2]) == "shift";
+
+	Display* user = XOpenDisplay(displayName.empty() ? nullptr : displayName.c_str());
+	if (!user) {
+		std::cout << "cannot open display" << std::endl;
+		return 1;
+	}
+	KeyCode shift = XKeysymToKeycode(user, XK_Shift_L);
+	if (holdShift) {
+		XTestFakeKeyEvent(user, shift, True, CurrentTime);
+		XSync(user, False);
+	}
+
+	keydrive::XTestOutput output(displayName);
+	bool sent = output.type(holdShift ? U"1é" : U"αβγ→漢字😀");
+	std::cout << (sent ? "typed" : "not typed") << std::endl;
+	// xev looks keysyms up lazily; keep the bindings until it has
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+
+	if (holdShift) {
+		XTestFakeKeyEvent(user, shift, False, CurrentTime);
+		XSync(user, False);
+	}
+	XCloseDisplay(user);
+	return sent ? 0 : 1;
+}
+EOF
+g++ -std=c++17 -DKEYDRIVE_HAVE_XTEST -I"$repo" "$repo/xtest_output.cpp" "$work/type.cpp" \
+	$(pkg-config --cflags --libs x11 xtst) -o "$work/type"
+
+Xvfb "$display" -nolisten tcp >"$work/xvfb.log" 2>&1 &
+xvfb=$!
+socket=/tmp/.X11-unix/X${display#:}
+for _ in $(seq 50); do
+	[ -S "$socket" ] && break
+	sleep 0.1
+done
+[ -S "$socket" ] || { echo "Xvfb did not start"; cat "$work/xvfb.log"; exit 1; }
+
+DISPLAY=$display xmodmap -pke >"$work/keymap.before"
+
+# Without a window manager focus follows the pointer; cover the screen so
+# the pointer is over xev's window
+DISPLAY=$display stdbuf -oL xev -geometry 4000x4000+0+0 -event keyboard >"$work/xev.log" &
+xev=$!
+sleep 1
+
+# Keysyms pressed after the first $1 lines of xev's log, Shift left out
+received() {
+	tail -n +"$(($1 + 1))" "$work/xev.log" | grep -A2 '^KeyPress' | grep -o 'keysym 0x[0-9a-f]*' \
+		| cut -d' ' -f2 | grep -v -x -e 0xffe1 -e 0xffe2 | tr '\n' ' ' | sed 's/ $//'
+}
+
+status=0
+check() {
+	if [ "$3" = "$2" ]; then
+		echo "✅ received $1"
+	else
+		echo "❌ expected keysyms: $2"
+		echo "   received keysyms: $3"
+		status=1
+	fi
+}
+
+"$work/type" "$display"
+sleep 0.5
+check "$text" "$expected" "$(received 0)"
+
+start=$(wc -l <"$work/xev.log")
+"$work/type" "$display" shift
+sleep 0.5
+check "$shiftText with Shift held" "$shiftExpected" "$(received "$start")"
+
+DISPLAY=$display xmodmap -pke >"$work/keymap.after"
+if cmp -s "$work/keymap.before" "$work/keymap.after"; then
+	echo "✅ spare keycodes restored"
+else
+	echo "❌ keymap changed:"
+	diff "$work/keymap.before" "$work/keymap.after" || true
+	status=1
+fi
+exit $status
@@ -0,0 +1,82 @@
+#include "shortcut_table.hpp"
+#include <algorithm>
+#include <cctype>
+#include <libevdev/libevdev.h>
+
+namespace keydrive {
+
+	namespace {
+
+		// Key that types an ASCII character on a US layout (0 if none without Shift)
+		unsigned int usKeyFor(char32_t c) {
+			if (c >= U'a' && c <= U'z') {
+				static const unsigned int letters[] = {
+					KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I,
+					KEY_J, KEY_K, KEY_L, KEY_M, KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R,
+					KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z
+				};
+				return letters[c - U'a'];
+			}
+			if (c >= U'A' && c <= U'Z') {
+				return usKeyFor(c - U'A' + U'a');
+			}
+			if (c >= U'1' && c <= U'9') {
+				return KEY_1 + static_cast<unsigned int>(c - U'1');
+			}
+
+			switch (c) {
+				case U'0': return KEY_0;
+				case U'-': return KEY_MINUS;
+				case U'=': return KEY_EQUAL;
+				case U'[': return KEY_LEFTBRACE;
+				case U']': return KEY_RIGHTBRACE;
+				case U';': return KEY_SEMICOLON;
+				case U'\'': return KEY_APOSTROPHE;
+				case U'`': return KEY_GRAVE;
+				case U'\\': return KEY_BACKSLASH;
+				case U',': return KEY_COMMA;
+				case U'.': return KEY_DOT;
+				case U'/': return KEY_SLASH;
+				case U' ': return KEY_SPACE;
+				case U'\n': return KEY_ENTER;
+				case U'\t': return KEY_TAB;
+				case U'\b': return KEY_BACKSPACE;
+				case U'\x1b': return KEY_ESC;
+				default: return 0;
+			}
+		}
+
+	} // anonymous namespace
+
+	ShortcutTable::ShortcutTable() {
+		for (unsigned int code = 0; code < KEY_CNT; ++code) {
+			codes[code] = static_cast<uint16_t>(code);
+		}
+	}
+
+	ShortcutTable ShortcutTable::compile(const std::vector<std::pair<std::string, char32_t>>& baseCharacters) {
+		ShortcutTable table;
+		for (const auto& [keyName, character] : baseCharacters) {
+			std::string upper = keyName;
+			std::transform(upper.begin(), upper.end(), upper.begin(),
+						   [](unsigned char c) { return std::toupper(c); });
+			int physical = libevdev_event_code_from_name(EV_KEY, upper.c_str());
+			unsigned int logical = usKeyFor(character);
+			if (physical >= 0 && physical < KEY_CNT && logical != 0) {
+				table.codes[physical] = static_cast<uint16_t>(logical);
+			}
+		}
+		return table;
+	}
+
+	size_t ShortcutTable::translatedCount() const {
+		size_t count = 0;
+		for (unsigned int code = 0; code < KEY_CNT; ++code) {
+			if (codes[code] != code) {
+				++count;
+			}
+		}
+		return count;
+	}
+
+} // namespace keydrive
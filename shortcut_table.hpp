@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <linux/input-event-codes.h>
+
+namespace keydrive {
+
+	/**
+	 * @brief Physical key → key code emitted for shortcuts (Ctrl/Alt/Super combos)
+	 *
+	 * Compiled once per layout so the forward path costs a single array lookup.
+	 * Each key is translated to the key that types its base-layer character on a
+	 * US layout, so Ctrl+(the key labelled "f" by the layout) sends Ctrl+F.
+	 * Modifiers are passed through unchanged.
+	 *
+	 * Entries are key codes only; no modifier is added around the translated
+	 * key. Characters that need Shift on a US layout ("+", "(", ":", ...)
+	 * therefore keep the physical key: Ctrl+(the key typing "+") sends Ctrl
+	 * with that key's own code, not Ctrl+Shift+=.
+	 */
+	class ShortcutTable {
+	public:
+		/**
+		 * @brief Create the identity table (shortcuts stay on the physical key)
+		 */
+		ShortcutTable();
+
+		/**
+		 * @brief Compile a table from the layout's base-layer characters
+		 *
+		 * Characters without an unshifted US key (e.g. "(" or "ç") keep the
+		 * physical key.
+		 *
+		 * @param baseCharacters Key name (e.g. "key_c") and its base character
+		 * @return ShortcutTable The compiled table
+		 */
+		static ShortcutTable compile(const std::vector<std::pair<std::string, char32_t>>& baseCharacters);
+
+		/**
+		 * @brief Get the key code to emit for a physical key
+		 */
+		unsigned int translate(unsigned int code) const {
+			return code < KEY_CNT ? codes[code] : code;
+		}
+
+		/**
+		 * @brief Get the number of keys that emit a different code
+		 */
+		size_t translatedCount() const;
+
+	private:
+		std::array<uint16_t, KEY_CNT> codes;
+	};
+
+} // namespace keydrive
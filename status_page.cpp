@@ -0,0 +1,203 @@
+#include "status_page.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace keydrive {
+
+	namespace {
+
+		constexpr uint32_t PAGE_VERSION = 2;
+		constexpr int READ_ATTEMPTS = 1000;
+
+		// Plain data part of the page. This layout is what external readers parse:
+		// bump PAGE_VERSION whenever it changes.
+		struct PageFields {
+			uint32_t pid;
+			uint8_t running;
+			uint8_t paused;
+			uint8_t reserved[2];
+			char layout[64];
+			char profile[64];
+			char layer[64];
+			char holdLayer[64];
+			char oneTimeLayer[64];
+			char toggledLayers[256];
+			uint64_t keyPresses;
+			uint64_t charactersSent;
+			uint64_t layoutChanges;
+			uint64_t suppressedBounces;
+		};
+
+		// Copy as much of the string as fits, always NUL-terminated
+		template <size_t N>
+		void copyText(char (&dst)[N], const std::string& src) {
+			size_t len = std::min(src.size(), N - 1);
+			std::memcpy(dst, src.data(), len);
+			dst[len] = '\0';
+		}
+
+		template <size_t N>
+		std::string readText(const char (&src)[N]) {
+			return std::string(src, strnlen(src, N));
+		}
+
+	} // anonymous namespace
+
+	// Seqlock: the sequence is odd while the writer is inside an update.
+	// A reader retries until it saw the same even sequence before and after copying.
+	struct StatusPage::Page {
+		std::atomic<uint32_t> sequence;
+		uint32_t version;
+		PageFields fields;
+	};
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock needs a lock-free counter in shared memory");
+
+	std::string defaultStatusPageName() {
+		return "/keydrive-status";
+	}
+
+	StatusPage::StatusPage(const std::string& name) {
+		int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0) {
+			throw std::runtime_error("Failed to open status page " + name + ": " + std::strerror(errno));
+		}
+		if (ftruncate(fd, sizeof(Page)) < 0) {
+			int err = errno;
+			close(fd);
+			throw std::runtime_error("Failed to size status page: " + std::string(std::strerror(err)));
+		}
+
+		void* mapping = mmap(nullptr, sizeof(Page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED) {
+			throw std::runtime_error("Failed to map status page: " + std::string(std::strerror(errno)));
+		}
+
+		page = static_cast<Page*>(mapping);
+		// Keep counting from the previous instance's sequence so readers never see it go back
+		if (page->sequence.load(std::memory_order_relaxed) & 1u) {
+			page->sequence.fetch_add(1, std::memory_order_relaxed);
+		}
+		page->version = PAGE_VERSION;
+	}
+
+	StatusPage::~StatusPage() {
+		if (page) {
+			munmap(page, sizeof(Page));
+		}
+	}
+
+	void StatusPage::publish(
+		const std::string& layout,
+		const std::string& profile,
+		const LayerState& layerState,
+		const StatusCounters& counters,
+		bool paused
+	) {
+		// Fill a local copy first so the odd (busy) window is a single memcpy
+		PageFields fields{};
+		fields.pid = static_cast<uint32_t>(getpid());
+		fields.running = 1;
+		fields.paused = paused ? 1 : 0;
+		copyText(fields.layout, layout);
+		copyText(fields.profile, profile);
+		copyText(fields.layer, layerState.current);
+		copyText(fields.holdLayer, layerState.hold);
+		copyText(fields.oneTimeLayer, layerState.oneTime);
+
+		std::string toggled;
+		for (const auto& [layer, active] : layerState.toggles) {
+			if (active) {
+				if (!toggled.empty()) {
+					toggled += ',';
+				}
+				toggled += layer;
+			}
+		}
+		copyText(fields.toggledLayers, toggled);
+
+		fields.keyPresses = counters.keyPresses;
+		fields.charactersSent = counters.charactersSent;
+		fields.layoutChanges = counters.layoutChanges;
+		fields.suppressedBounces = counters.suppressedBounces;
+
+		uint32_t seq = page->sequence.load(std::memory_order_relaxed);
+		page->sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(&page->fields, &fields, sizeof(fields));
+		page->sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	void StatusPage::markStopped() {
+		uint32_t seq = page->sequence.load(std::memory_order_relaxed);
+		page->sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		page->fields.running = 0;
+		page->sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	std::optional<StatusSnapshot> StatusPage::read(const std::string& name) {
+		int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+		if (fd < 0) {
+			return std::nullopt;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(Page)) {
+			close(fd);
+			return std::nullopt;
+		}
+		void* mapping = mmap(nullptr, sizeof(Page), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED) {
+			return std::nullopt;
+		}
+		const Page* shared = static_cast<const Page*>(mapping);
+
+		std::optional<StatusSnapshot> result;
+		if (shared->version == PAGE_VERSION) {
+			PageFields fields;
+			for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+				uint32_t before = shared->sequence.load(std::memory_order_acquire);
+				if (before & 1u) {
+					continue;  // Writer is mid-update
+				}
+				std::memcpy(&fields, &shared->fields, sizeof(fields));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (shared->sequence.load(std::memory_order_relaxed) != before) {
+					continue;
+				}
+
+				StatusSnapshot snapshot;
+				snapshot.pid = fields.pid;
+				snapshot.running = fields.running != 0;
+				snapshot.paused = fields.paused != 0;
+				snapshot.layout = readText(fields.layout);
+				snapshot.profile = readText(fields.profile);
+				snapshot.layer = readText(fields.layer);
+				snapshot.holdLayer = readText(fields.holdLayer);
+				snapshot.oneTimeLayer = readText(fields.oneTimeLayer);
+				snapshot.toggledLayers = readText(fields.toggledLayers);
+				snapshot.counters.keyPresses = fields.keyPresses;
+				snapshot.counters.charactersSent = fields.charactersSent;
+				snapshot.counters.layoutChanges = fields.layoutChanges;
+				snapshot.counters.suppressedBounces = fields.suppressedBounces;
+				result = snapshot;
+				break;
+			}
+		}
+
+		munmap(mapping, sizeof(Page));
+		return result;
+	}
+
+} // namespace keydrive
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <optional>
+#include <cstdint>
+#include "layout_manager.hpp"
+
+namespace keydrive {
+
+	/**
+	 * @brief Counters published on the status page
+	 */
+	struct StatusCounters {
+		uint64_t keyPresses = 0;        // Physical key presses seen
+		uint64_t charactersSent = 0;    // Characters emitted by the layout
+		uint64_t layoutChanges = 0;     // Reloads and layout switches
+		uint64_t suppressedBounces = 0; // Key edges dropped by the debounce filter
+	};
+
+	/**
+	 * @brief Decoded copy of the status page, as seen by a reader
+	 */
+	struct StatusSnapshot {
+		uint32_t pid = 0;
+		bool running = false;
+		bool paused = false;
+		std::string layout;
+		std::string profile;
+		std::string layer;             // Effective layer
+		std::string holdLayer;
+		std::string oneTimeLayer;
+		std::string toggledLayers;     // Comma-separated
+		StatusCounters counters;
+	};
+
+	/**
+	 * @brief Get the shared memory name of the status page (/dev/shm/keydrive-status)
+	 */
+	std::string defaultStatusPageName();
+
+	/**
+	 * @brief Daemon state in a shared memory page for status bars
+	 *
+	 * The daemon is the only writer. Updates are guarded by a seqlock, so any
+	 * number of readers can map the page read-only and poll it without
+	 * syscalls and without ever blocking the daemon.
+	 */
+	class StatusPage {
+	public:
+		/**
+		 * @brief Create (or reuse) and map the status page
+		 *
+		 * @param name shm_open name, e.g. "/keydrive-status"
+		 * @throws std::runtime_error if the page cannot be created or mapped
+		 */
+		explicit StatusPage(const std::string& name = defaultStatusPageName());
+		~StatusPage();
+
+		StatusPage(const StatusPage&) = delete;
+		StatusPage& operator=(const StatusPage&) = delete;
+
+		/**
+		 * @brief Publish the current state
+		 *
+		 * @param layout Active layout name
+		 * @param profile Active profile name
+		 * @param layerState Active layers
+		 * @param counters Counters to publish
+		 * @param paused Whether remapping is paused
+		 */
+		void publish(
+			const std::string& layout,
+			const std::string& profile,
+			const LayerState& layerState,
+			const StatusCounters& counters,
+			bool paused
+		);
+
+		/**
+		 * @brief Mark the daemon as stopped (skip after a handover, the page then
+		 * belongs to the new instance)
+		 */
+		void markStopped();
+
+		/**
+		 * @brief Read a consistent snapshot of the page
+		 *
+		 * @param name shm_open name of the page
+		 * @return std::optional<StatusSnapshot> Snapshot, or nullopt if no page exists
+		 */
+		static std::optional<StatusSnapshot> read(const std::string& name = defaultStatusPageName());
+
+	private:
+		struct Page;
+
+		Page* page = nullptr;
+	};
+
+} // namespace keydrive
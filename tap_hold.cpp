@@ -0,0 +1,263 @@
+#include "tap_hold.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+namespace keydrive {
+
+	namespace {
+
+		// Bounds of the learned terms
+		constexpr int MIN_TERM_MS = 100;
+		constexpr int MAX_TERM_MS = 400;
+		constexpr int MIN_ROLL_TERM_MS = 20;
+
+		// Head room above the user's slow taps and rolls
+		constexpr int MARGIN_MS = 16;
+		// A term only moves when the new value differs by at least this much
+		constexpr int HYSTERESIS_MS = 12;
+		// Samples a histogram needs before it is trusted
+		constexpr uint32_t MIN_SAMPLES = 20;
+		// Histograms are halved once they hold this many samples
+		constexpr uint32_t DECAY_AT = 1024;
+
+		constexpr auto RECOMPUTE_INTERVAL = std::chrono::seconds(10);
+
+		int elapsedMs(std::chrono::steady_clock::time_point since) {
+			return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - since).count());
+		}
+
+		// Keep the typical value above the lower edge of the competing
+		// distribution; where the two overlap, split the difference
+		int separate(const TimingHistogram& below, const TimingHistogram& above, int fallback) {
+			if (below.count() < MIN_SAMPLES) {
+				return fallback;
+			}
+			int term = below.percentile(0.95) + MARGIN_MS;
+			if (above.count() >= MIN_SAMPLES) {
+				int lowest = above.percentile(0.10);
+				if (term > lowest) {
+					term = (below.percentile(0.95) + lowest) / 2;
+				}
+			}
+			return term;
+		}
+
+	} // anonymous namespace
+
+	void TimingHistogram::add(int ms) {
+		size_t bucket = std::min(static_cast<size_t>(std::max(ms, 0) / BUCKET_MS), BUCKETS - 1);
+		if (total >= DECAY_AT || buckets[bucket] == UINT16_MAX) {
+			total = 0;
+			for (auto& count : buckets) {
+				count /= 2;
+				total += count;
+			}
+		}
+		++buckets[bucket];
+		++total;
+	}
+
+	int TimingHistogram::percentile(double quantile) const {
+		if (total == 0) {
+			return 0;
+		}
+		uint32_t target = std::max<uint32_t>(1, static_cast<uint32_t>(quantile * total + 0.5));
+		uint32_t seen = 0;
+		for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+			seen += buckets[bucket];
+			if (seen >= target) {
+				return static_cast<int>(bucket + 1) * BUCKET_MS;
+			}
+		}
+		return static_cast<int>(BUCKETS) * BUCKET_MS;
+	}
+
+	TapHold::TapHold(Reactor& reactor, ResolveHandler onResolve)
+		: reactor(reactor), onResolve(std::move(onResolve)) {
+		expiryFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		recomputeFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (expiryFd < 0 || recomputeFd < 0) {
+			std::string error = std::strerror(errno);
+			if (expiryFd >= 0) close(expiryFd);
+			if (recomputeFd >= 0) close(recomputeFd);
+			throw std::runtime_error("Failed to create tap-hold timers: " + error);
+		}
+
+		reactor.add(expiryFd, EPOLLIN, [this](uint32_t) {
+			uint64_t expirations;
+			while (read(expiryFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+			}
+			expire();
+		});
+		reactor.add(recomputeFd, EPOLLIN, [this](uint32_t) {
+			uint64_t expirations;
+			while (read(recomputeFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+			}
+			recompute();
+		});
+		armTimer(recomputeFd, RECOMPUTE_INTERVAL, true);
+	}
+
+	TapHold::~TapHold() {
+		reactor.remove(expiryFd);
+		reactor.remove(recomputeFd);
+		close(expiryFd);
+		close(recomputeFd);
+	}
+
+	void TapHold::press(const std::string& keyName, int keyCode, int initialTermMs) {
+		KeyTiming& timing = timings[keyCode];
+		if (timing.termMs == 0) {
+			timing.keyName = keyName;
+			timing.termMs = std::clamp(initialTermMs, MIN_TERM_MS, MAX_TERM_MS);
+			timing.rollTermMs = std::max(MIN_ROLL_TERM_MS, timing.termMs / 2);
+		}
+
+		pendingKey = keyCode;
+		downKey = keyCode;
+		resolvedByTimer = false;
+		pressedAt = Clock::now();
+		overlapKey = -1;
+		armTimer(expiryFd, std::chrono::milliseconds(timing.termMs), false);
+	}
+
+	void TapHold::keyPressed(int keyCode) {
+		if (downKey < 0 || keyCode == downKey) {
+			return;
+		}
+
+		int elapsed = elapsedMs(pressedAt);
+		if (isPending()) {
+			// Remember the overlap; its release order tells a roll from a nested press
+			overlapKey = keyCode;
+			overlapMs = elapsed;
+			resolve(elapsed >= timings[downKey].rollTermMs);
+		} else if (resolvedByTimer && overlapKey < 0) {
+			// First use of a hold: how soon the layer is actually needed
+			KeyTiming& timing = timings[downKey];
+			timing.onsets.add(elapsed);
+			timing.dirty = true;
+			overlapKey = keyCode;
+			overlapMs = -1;
+		}
+	}
+
+	bool TapHold::release(int keyCode) {
+		if (keyCode == overlapKey && downKey >= 0) {
+			// The other key went up first, inside the dual-role key: nested
+			if (overlapMs >= 0) {
+				KeyTiming& timing = timings[downKey];
+				timing.nested.add(overlapMs);
+				timing.dirty = true;
+			}
+			overlapKey = -1;
+			return false;
+		}
+		if (keyCode != downKey) {
+			return false;
+		}
+
+		KeyTiming& timing = timings[downKey];
+		int elapsed = elapsedMs(pressedAt);
+		if (isPending()) {
+			timing.taps.add(elapsed);
+			timing.dirty = true;
+			resolve(false);
+		} else if (resolvedByTimer && overlapKey < 0 && elapsed < 2 * timing.termMs) {
+			// Let go soon after the term without using the layer: a slow tap
+			timing.taps.add(elapsed);
+			timing.dirty = true;
+		} else if (overlapKey >= 0 && overlapMs >= 0) {
+			// Released while the overlapping key is still down: a roll
+			timing.rolls.add(overlapMs);
+			timing.dirty = true;
+		}
+
+		downKey = -1;
+		overlapKey = -1;
+		return true;
+	}
+
+	void TapHold::cancel() {
+		if (isPending()) {
+			pendingKey = -1;
+			armTimer(expiryFd, Clock::duration::zero(), false);
+		}
+		downKey = -1;
+		overlapKey = -1;
+	}
+
+	void TapHold::writeMetrics(MetricsWriter& writer) const {
+		writer.family("keydrive_tapping_term_milliseconds", "gauge", "Hold threshold learned per dual-role key");
+		for (const auto& [code, timing] : timings) {
+			writer.sample("keydrive_tapping_term_milliseconds", "key=\"" + timing.keyName + "\"",
+				static_cast<uint64_t>(timing.termMs));
+		}
+		writer.family("keydrive_roll_term_milliseconds", "gauge", "Overlap below which a dual-role key still taps");
+		for (const auto& [code, timing] : timings) {
+			writer.sample("keydrive_roll_term_milliseconds", "key=\"" + timing.keyName + "\"",
+				static_cast<uint64_t>(timing.rollTermMs));
+		}
+	}
+
+	void TapHold::resolve(bool hold) {
+		int keyCode = pendingKey;
+		pendingKey = -1;
+		armTimer(expiryFd, Clock::duration::zero(), false);
+		onResolve(timings[keyCode].keyName, keyCode, hold);
+	}
+
+	void TapHold::expire() {
+		if (!isPending()) {
+			return;
+		}
+		auto term = std::chrono::milliseconds(timings[pendingKey].termMs);
+		auto held = Clock::now() - pressedAt;
+		if (held < term) {
+			armTimer(expiryFd, term - held, false);
+			return;
+		}
+		resolvedByTimer = true;
+		resolve(true);
+	}
+
+	void TapHold::recompute() {
+		for (auto& [code, timing] : timings) {
+			if (!timing.dirty) {
+				continue;
+			}
+			timing.dirty = false;
+
+			int term = std::clamp(separate(timing.taps, timing.onsets, timing.termMs), MIN_TERM_MS, MAX_TERM_MS);
+			int rollTerm = std::clamp(separate(timing.rolls, timing.nested, timing.rollTermMs), MIN_ROLL_TERM_MS, term);
+			if (std::abs(term - timing.termMs) < HYSTERESIS_MS && std::abs(rollTerm - timing.rollTermMs) < HYSTERESIS_MS) {
+				continue;
+			}
+
+			std::cout << "⏱ Tapping term for " << timing.keyName << ": " << timing.termMs << " → " << term
+			<< " ms, roll " << timing.rollTermMs << " → " << rollTerm << " ms" << std::endl;
+			timing.termMs = term;
+			timing.rollTermMs = rollTerm;
+		}
+	}
+
+	void TapHold::armTimer(int fd, Clock::duration delay, bool periodic) {
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count();
+		itimerspec spec{};
+		spec.it_value.tv_sec = ns / 1000000000;
+		spec.it_value.tv_nsec = ns % 1000000000;
+		if (periodic) {
+			spec.it_interval = spec.it_value;
+		}
+		timerfd_settime(fd, 0, &spec, nullptr);
+	}
+
+} // namespace keydrive
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include "reactor.hpp"
+#include "metrics.hpp"
+
+namespace keydrive {
+
+	/**
+	 * @brief Compact histogram of key timings in milliseconds
+	 *
+	 * 64 buckets of 8 ms (the last one open-ended) in 16-bit counts. When the
+	 * histogram fills up all counts are halved, so old habits fade and the
+	 * statistics follow the user's current typing.
+	 */
+	class TimingHistogram {
+	public:
+		static constexpr int BUCKET_MS = 8;
+		static constexpr size_t BUCKETS = 64;
+
+		void add(int ms);
+
+		/**
+		 * @brief Get the upper edge of the bucket holding a quantile
+		 *
+		 * @param quantile Between 0 and 1
+		 * @return int Milliseconds; 0 if the histogram is empty
+		 */
+		int percentile(double quantile) const;
+
+		uint32_t count() const {
+			return total;
+		}
+
+	private:
+		std::array<uint16_t, BUCKETS> buckets{};
+		uint32_t total = 0;
+	};
+
+	/**
+	 * @brief Resolves dual-role (tap-hold) keys with tapping terms learned per key
+	 *
+	 * A dual-role key is pending from its press until it resolves:
+	 *  - released before its tapping term: a tap
+	 *  - held past the term (timerfd in the reactor): a hold
+	 *  - another key pressed meanwhile: a tap if that came within the key's
+	 *    roll term (fast typing rolls over the key), a hold otherwise
+	 *
+	 * Every press feeds per-key histograms: how long taps last, how soon a
+	 * held key is used, and whether overlapping presses were rolls (the
+	 * dual-role key let go first) or nested (the other key let go first).
+	 * The terms are recomputed from them on a slow timer, not on the key path,
+	 * within fixed bounds and only when they move by more than a few
+	 * milliseconds, so they don't jitter from press to press.
+	 */
+	class TapHold {
+	public:
+		/**
+		 * @brief Called when a pending key resolves
+		 *
+		 * @param keyName The dual-role key (e.g., "key_capslock")
+		 * @param keyCode Its key code
+		 * @param hold true for a hold, false for a tap
+		 */
+		using ResolveHandler = std::function<void(const std::string& keyName, int keyCode, bool hold)>;
+
+		/**
+		 * @brief Create the timers and register them with the reactor
+		 *
+		 * @throws std::runtime_error if a timerfd cannot be created
+		 */
+		TapHold(Reactor& reactor, ResolveHandler onResolve);
+		~TapHold();
+
+		TapHold(const TapHold&) = delete;
+		TapHold& operator=(const TapHold&) = delete;
+
+		/**
+		 * @brief Handle the press of a dual-role key; it stays pending until it resolves
+		 *
+		 * @param keyName The key name
+		 * @param keyCode The key code
+		 * @param initialTermMs Tapping term from the layout, used until one is learned
+		 */
+		void press(const std::string& keyName, int keyCode, int initialTermMs);
+
+		/**
+		 * @brief Handle the press of any other key
+		 *
+		 * Resolves a pending key, so call it before handling the other key;
+		 * a hold then applies to it.
+		 *
+		 * @param keyCode The pressed key
+		 */
+		void keyPressed(int keyCode);
+
+		/**
+		 * @brief Handle any key release
+		 *
+		 * A pending dual-role key resolves as a tap here.
+		 *
+		 * @param keyCode The released key
+		 * @return true if it was a dual-role key
+		 */
+		bool release(int keyCode);
+
+		bool isPending() const {
+			return pendingKey >= 0;
+		}
+
+		/**
+		 * @brief Forget the pending key without resolving it (layout switch or reload, pause)
+		 */
+		void cancel();
+
+		/**
+		 * @brief Recompute the terms of keys with new samples
+		 *
+		 * Runs on the slow timer by itself.
+		 */
+		void recompute();
+
+		/**
+		 * @brief Add the current terms per key as gauges
+		 */
+		void writeMetrics(MetricsWriter& writer) const;
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		struct KeyTiming {
+			std::string keyName;
+			int termMs = 0;          // Held longer than this: hold
+			int rollTermMs = 0;      // Other key pressed sooner than this: tap
+			TimingHistogram taps;    // Press to release of taps
+			TimingHistogram onsets;  // Press to the next key of holds resolved by the timer
+			TimingHistogram rolls;   // Press to the overlapping key, dual-role key released first
+			TimingHistogram nested;  // Same, the other key released first
+			bool dirty = false;
+		};
+
+		void resolve(bool hold);
+		void expire();
+		void armTimer(int fd, Clock::duration delay, bool periodic);
+
+		Reactor& reactor;
+		ResolveHandler onResolve;
+		int expiryFd = -1;
+		int recomputeFd = -1;
+
+		std::unordered_map<int, KeyTiming> timings;
+
+		// The dual-role key that is down (pending or resolved) and what overlapped it
+		int pendingKey = -1;
+		int downKey = -1;
+		bool resolvedByTimer = false;
+		Clock::time_point pressedAt;
+		int overlapKey = -1;
+		int overlapMs = 0;
+	};
+
+} // namespace keydrive
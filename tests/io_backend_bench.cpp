@@ -0,0 +1,326 @@
+// Keystrokes through the daemon's I/O path on both backends: a socket stands
+// in for the keyboard and a pipe for uinput. Each press and release is written
+// to the socket, read by KeyboardInput's thread, handed to a reactor handler
+// and written to the pipe through DesktopSink. Reports the latency of each
+// event and, where the raw_syscalls tracepoint can be opened (root, tracefs
+// mounted), the syscalls per keystroke of the input thread and the loop.
+//
+// Usage: io_backend_bench [keys] [interval_us] [io_uring|epoll]
+// Exits with 1 if an event got lost, reordered or changed on the way.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/perf_event.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "input_handler.hpp"
+#include "output_sink.hpp"
+#include "reactor.hpp"
+
+using namespace keydrive;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+	struct RunResult {
+		std::string backend;
+		bool ok = true;
+		std::vector<double> latencyUs;  // Per event, sorted
+		// Syscalls counted per thread, -1 if they could not be counted
+		long long inputSyscalls = -1;
+		long long loopSyscalls = -1;
+	};
+
+	pid_t currentTid() {
+		return static_cast<pid_t>(syscall(SYS_gettid));
+	}
+
+	// Threads of this process other than io_uring's own workers
+	std::vector<pid_t> ownThreads() {
+		std::vector<pid_t> tids;
+		DIR* dir = opendir("/proc/self/task");
+		if (!dir) {
+			return tids;
+		}
+		while (dirent* entry = readdir(dir)) {
+			if (entry->d_name[0] == '.') {
+				continue;
+			}
+			std::ifstream commFile(std::string("/proc/self/task/") + entry->d_name + "/comm");
+			std::string comm;
+			std::getline(commFile, comm);
+			if (comm.compare(0, 4, "iou-") != 0) {
+				tids.push_back(static_cast<pid_t>(std::atoi(entry->d_name)));
+			}
+		}
+		closedir(dir);
+		return tids;
+	}
+
+	int syscallTracepoint() {
+		for (const char* root : {"/sys/kernel/tracing", "/sys/kernel/debug/tracing"}) {
+			std::ifstream idFile(std::string(root) + "/events/raw_syscalls/sys_enter/id");
+			int id;
+			if (idFile >> id) {
+				return id;
+			}
+		}
+		return -1;
+	}
+
+	// Counter of the syscalls one thread enters, or -1
+	int openSyscallCounter(pid_t tid) {
+		int id = syscallTracepoint();
+		if (id < 0 || tid <= 0) {
+			return -1;
+		}
+		perf_event_attr attr{};
+		attr.type = PERF_TYPE_TRACEPOINT;
+		attr.size = sizeof(attr);
+		attr.config = static_cast<uint64_t>(id);
+		attr.disabled = 1;
+		return static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+	}
+
+	long long readCounter(int fd) {
+		long long count;
+		if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count)) {
+			return -1;
+		}
+		return count;
+	}
+
+	// The top letter row, KEY_Q..KEY_P: no modifiers in between, which the
+	// input thread hands on as modifier events instead of presses
+	unsigned short letterKey(size_t keystroke) {
+		return static_cast<unsigned short>(KEY_Q + keystroke % 10);
+	}
+
+	input_event keyEvent(unsigned short type, unsigned short code, int value) {
+		input_event ev{};
+		ev.type = type;
+		ev.code = code;
+		ev.value = value;
+		return ev;
+	}
+
+	RunResult runBackend(const std::string& backend, int keys, std::chrono::microseconds interval) {
+		setenv("KEYDRIVE_REACTOR", backend.c_str(), 1);
+		RunResult result;
+		const size_t events = static_cast<size_t>(keys) * 2;
+
+		int source[2];
+		int sinkPipe[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, source) < 0 || pipe2(sinkPipe, O_CLOEXEC) < 0) {
+			std::perror("socketpair/pipe");
+			result.ok = false;
+			return result;
+		}
+
+		Reactor reactor;
+		result.backend = reactor.backendName();
+		DesktopSink sink(sinkPipe[1]);
+		sink.writeThrough(&reactor);
+
+		std::vector<pid_t> before = ownThreads();
+		KeyboardInput input(source[0], "bench source");
+		pid_t inputTid = 0;
+		for (pid_t tid : ownThreads()) {
+			if (std::find(before.begin(), before.end(), tid) == before.end()) {
+				inputTid = tid;
+			}
+		}
+
+		// What the loop does with each key event: one frame to the virtual keyboard
+		reactor.add(input.getNotifyFd(), EPOLLIN, [&](uint32_t) {
+			for (const auto& event : input.takeEvents()) {
+				if (event.type != EventType::Press && event.type != EventType::Release) {
+					continue;
+				}
+				input_event frame[2] = {
+					keyEvent(EV_KEY, static_cast<unsigned short>(event.keyCode), event.type == EventType::Press ? 1 : 0),
+					keyEvent(EV_SYN, SYN_REPORT, 0)
+				};
+				sink.write(frame, 2);
+			}
+		});
+
+		std::vector<Clock::time_point> sent(events);
+		std::vector<Clock::time_point> arrived(events);
+		std::atomic<size_t> received{0};
+		std::atomic<bool> intact{true};
+
+		// The compositor: timestamps every key event leaving the sink
+		std::thread reader([&] {
+			input_event buffer[64];
+			size_t pending = 0;
+			char* bytes = reinterpret_cast<char*>(buffer);
+			while (received < events) {
+				ssize_t n = read(sinkPipe[0], bytes + pending, sizeof(buffer) - pending);
+				if (n <= 0) {
+					break;
+				}
+				auto now = Clock::now();
+				pending += static_cast<size_t>(n);
+				size_t whole = pending / sizeof(input_event);
+				for (size_t i = 0; i < whole; ++i) {
+					if (buffer[i].type != EV_KEY) {
+						continue;
+					}
+					size_t index = received;
+					// Keystroke i is letterKey(i), pressed then released
+					bool expected = buffer[i].code == letterKey(index / 2) && buffer[i].value == (index % 2 == 0 ? 1 : 0);
+					if (!expected) {
+						intact = false;
+					}
+					arrived[index] = now;
+					received = index + 1;
+				}
+				pending -= whole * sizeof(input_event);
+				std::memmove(bytes, bytes + whole * sizeof(input_event), pending);
+			}
+		});
+
+		int loopCounter = openSyscallCounter(currentTid());
+		int inputCounter = openSyscallCounter(inputTid);
+		for (int fd : {loopCounter, inputCounter}) {
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+
+		// The keyboard: one frame per event, spaced so each is handled on its own
+		std::thread writer([&] {
+			auto next = Clock::now();
+			for (size_t i = 0; i < events; ++i) {
+				std::this_thread::sleep_until(next);
+				input_event frame[2] = {
+					keyEvent(EV_KEY, letterKey(i / 2), i % 2 == 0 ? 1 : 0),
+					keyEvent(EV_SYN, SYN_REPORT, 0)
+				};
+				sent[i] = Clock::now();
+				if (write(source[1], frame, sizeof(frame)) != sizeof(frame)) {
+					break;
+				}
+				next += interval;
+			}
+		});
+
+		auto deadline = Clock::now() + interval * static_cast<int>(events) + std::chrono::seconds(5);
+		while (received < events && Clock::now() < deadline) {
+			reactor.runOnce(100);
+		}
+
+		for (int fd : {loopCounter, inputCounter}) {
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			}
+		}
+		result.loopSyscalls = readCounter(loopCounter);
+		result.inputSyscalls = readCounter(inputCounter);
+		for (int fd : {loopCounter, inputCounter}) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+
+		writer.join();
+		if (received < events) {
+			std::fprintf(stderr, "%s: only %zu of %zu events arrived\n", result.backend.c_str(), received.load(), events);
+			result.ok = false;
+			close(sinkPipe[1]);  // Ends the reader
+		}
+		reader.join();
+		result.ok = result.ok && intact;
+		reactor.remove(input.getNotifyFd());
+		close(source[1]);
+		close(sinkPipe[0]);
+		if (received == events) {
+			close(sinkPipe[1]);
+		}
+
+		for (size_t i = 0; i < received; ++i) {
+			result.latencyUs.push_back(std::chrono::duration<double, std::micro>(arrived[i] - sent[i]).count());
+		}
+		std::sort(result.latencyUs.begin(), result.latencyUs.end());
+		return result;
+	}
+
+	double percentile(const std::vector<double>& sorted, double p) {
+		if (sorted.empty()) {
+			return 0.0;
+		}
+		size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+		return sorted[index];
+	}
+
+	std::string perKeystroke(long long count, int keys) {
+		if (count < 0) {
+			return "n/a";
+		}
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.2f", static_cast<double>(count) / keys);
+		return buffer;
+	}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	int keys = argc > 1 ? std::atoi(argv[1]) : 2000;
+	auto interval = std::chrono::microseconds(argc > 2 ? std::atoi(argv[2]) : 1000);
+	std::vector<std::string> backends = {"io_uring", "epoll"};
+	if (argc > 3) {
+		backends = {argv[3]};
+	}
+	if (keys <= 0 || interval.count() <= 0) {
+		std::fprintf(stderr, "Usage: %s [keys] [interval_us] [io_uring|epoll]\n", argv[0]);
+		return 2;
+	}
+
+	// KeyboardInput logs every key event
+	std::ostringstream discarded;
+	std::streambuf* console = std::cout.rdbuf(discarded.rdbuf());
+	std::vector<RunResult> results;
+	for (const auto& backend : backends) {
+		results.push_back(runBackend(backend, keys, interval));
+		discarded.str("");
+	}
+	std::cout.rdbuf(console);
+
+	std::printf("%d keystrokes (press + release), one event every %lld us\n\n", keys, static_cast<long long>(interval.count()));
+	std::printf("%-9s %9s %9s %9s %9s   %s\n", "backend", "p50 us", "p99 us", "max us", "syscalls", "(input thread + loop, per keystroke)");
+	bool ok = true;
+	for (const auto& result : results) {
+		long long total = result.inputSyscalls < 0 || result.loopSyscalls < 0 ? -1 : result.inputSyscalls + result.loopSyscalls;
+		std::printf("%-9s %9.1f %9.1f %9.1f %9s   %s + %s\n", result.backend.c_str(),
+		            percentile(result.latencyUs, 0.5), percentile(result.latencyUs, 0.99),
+		            result.latencyUs.empty() ? 0.0 : result.latencyUs.back(),
+		            perKeystroke(total, keys).c_str(),
+		            perKeystroke(result.inputSyscalls, keys).c_str(), perKeystroke(result.loopSyscalls, keys).c_str());
+		ok = ok && result.ok;
+	}
+	if (results.front().inputSyscalls < 0) {
+		std::printf("\nSyscalls not counted: needs root and tracefs (mount -t tracefs nodev /sys/kernel/tracing)\n");
+	}
+	if (!ok) {
+		std::fprintf(stderr, "❌ events were lost, reordered or changed\n");
+		return 1;
+	}
+	return 0;
+}
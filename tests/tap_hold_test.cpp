@@ -0,0 +1,220 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "reactor.hpp"
+#include "metrics.hpp"
+#include "tap_hold.hpp"
+
+using namespace keydrive;
+
+namespace {
+
+	int failures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++failures; \
+		} \
+	} while (0)
+
+	constexpr int DUAL = 58;   // key_capslock
+	constexpr int OTHER = 30;  // key_a
+
+	struct Resolution {
+		int keyCode;
+		bool hold;
+	};
+
+	// TapHold on its own reactor, recording what it resolves
+	struct Fixture {
+		Reactor reactor;
+		std::vector<Resolution> resolved;
+		TapHold tapHold{reactor, [this](const std::string&, int keyCode, bool hold) {
+			resolved.push_back({keyCode, hold});
+		}};
+
+		// Let the reactor run timers until something resolves
+		void runUntilResolved(std::chrono::milliseconds limit) {
+			auto deadline = std::chrono::steady_clock::now() + limit;
+			while (resolved.empty() && std::chrono::steady_clock::now() < deadline) {
+				reactor.runOnce(10);
+			}
+		}
+
+		// Current term from the exported gauge, -1 if the key has none
+		int gauge(const std::string& name) const {
+			MetricsWriter writer;
+			tapHold.writeMetrics(writer);
+			std::string prefix = name + "{key=\"key_capslock\"} ";
+			size_t at = writer.str().find(prefix);
+			if (at == std::string::npos) {
+				return -1;
+			}
+			return std::stoi(writer.str().substr(at + prefix.size()));
+		}
+	};
+
+	void sleepMs(int ms) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	}
+
+	void testHistogram() {
+		TimingHistogram histogram;
+		CHECK(histogram.percentile(0.5) == 0);
+
+		histogram.add(3);
+		histogram.add(10);
+		histogram.add(10);
+		histogram.add(100);
+		CHECK(histogram.count() == 4);
+		CHECK(histogram.percentile(0.5) == 16);    // Upper edge of the 8-15 ms bucket
+		CHECK(histogram.percentile(1.0) == 104);
+
+		// Past the last bucket everything lands in the open-ended one
+		TimingHistogram slow;
+		slow.add(10000);
+		CHECK(slow.percentile(0.5) == static_cast<int>(TimingHistogram::BUCKETS) * TimingHistogram::BUCKET_MS);
+	}
+
+	void testHistogramDecay() {
+		TimingHistogram histogram;
+		for (int i = 0; i < 1024; ++i) {
+			histogram.add(10);
+		}
+		CHECK(histogram.count() == 1024);
+		// A full histogram halves its counts before adding
+		histogram.add(10);
+		CHECK(histogram.count() == 513);
+		CHECK(histogram.percentile(0.5) == 16);
+	}
+
+	void testTap() {
+		Fixture f;
+		f.tapHold.press("key_capslock", DUAL, 200);
+		CHECK(f.tapHold.isPending());
+		CHECK(f.tapHold.release(DUAL));
+		CHECK(f.resolved.size() == 1 && f.resolved[0].keyCode == DUAL && !f.resolved[0].hold);
+		CHECK(!f.tapHold.isPending());
+	}
+
+	void testHoldByTimer() {
+		Fixture f;
+		auto start = std::chrono::steady_clock::now();
+		f.tapHold.press("key_capslock", DUAL, 100);
+		f.runUntilResolved(std::chrono::milliseconds(1000));
+		auto held = std::chrono::steady_clock::now() - start;
+		CHECK(f.resolved.size() == 1 && f.resolved[0].hold);
+		CHECK(held >= std::chrono::milliseconds(100));
+
+		// The release ends the hold without resolving again
+		CHECK(f.tapHold.release(DUAL));
+		CHECK(f.resolved.size() == 1);
+	}
+
+	void testRollIsTap() {
+		// Another key right after the press: typing rolled over the key
+		Fixture f;
+		f.tapHold.press("key_capslock", DUAL, 200);
+		f.tapHold.keyPressed(OTHER);
+		CHECK(f.resolved.size() == 1 && !f.resolved[0].hold);
+	}
+
+	void testInterruptIsHold() {
+		// Another key after the roll term (half the tapping term at first)
+		Fixture f;
+		f.tapHold.press("key_capslock", DUAL, 100);
+		sleepMs(70);
+		f.tapHold.keyPressed(OTHER);
+		CHECK(f.resolved.size() == 1 && f.resolved[0].hold);
+	}
+
+	void testCancel() {
+		Fixture f;
+		f.tapHold.press("key_capslock", DUAL, 100);
+		f.tapHold.cancel();
+		f.runUntilResolved(std::chrono::milliseconds(200));
+		CHECK(f.resolved.empty());
+		CHECK(!f.tapHold.release(DUAL));
+	}
+
+	void testRecomputeFromTaps() {
+		Fixture f;
+		f.tapHold.press("key_capslock", DUAL, 200);
+		f.tapHold.release(DUAL);
+		CHECK(f.gauge("keydrive_tapping_term_milliseconds") == 200);
+		CHECK(f.gauge("keydrive_roll_term_milliseconds") == 100);
+
+		// Quick taps pull the term down to its lower bound
+		for (int i = 0; i < 20; ++i) {
+			f.tapHold.press("key_capslock", DUAL, 200);
+			f.tapHold.release(DUAL);
+		}
+		f.tapHold.recompute();
+		CHECK(f.gauge("keydrive_tapping_term_milliseconds") == 100);
+		// The roll term has no samples and is capped by the term
+		CHECK(f.gauge("keydrive_roll_term_milliseconds") == 100);
+	}
+
+	void testHysteresis() {
+		// Moving from 105 to the 100 ms bound is within the hysteresis
+		Fixture f;
+		for (int i = 0; i < 21; ++i) {
+			f.tapHold.press("key_capslock", DUAL, 105);
+			f.tapHold.release(DUAL);
+		}
+		f.tapHold.recompute();
+		CHECK(f.gauge("keydrive_tapping_term_milliseconds") == 105);
+	}
+
+	void testRecomputeRollTerm() {
+		Fixture f;
+		// Rolls: the other key comes about 35 ms in, the dual-role key goes up first
+		for (int i = 0; i < 20; ++i) {
+			f.tapHold.press("key_capslock", DUAL, 200);
+			sleepMs(35);
+			f.tapHold.keyPressed(OTHER);
+			f.tapHold.release(DUAL);
+			f.tapHold.release(OTHER);
+		}
+		// Nested: the other key comes at once and goes up first
+		for (int i = 0; i < 20; ++i) {
+			f.tapHold.press("key_capslock", DUAL, 200);
+			f.tapHold.keyPressed(OTHER);
+			f.tapHold.release(OTHER);
+			f.tapHold.release(DUAL);
+		}
+		f.tapHold.recompute();
+
+		// No taps were seen, so the term stays
+		CHECK(f.gauge("keydrive_tapping_term_milliseconds") == 200);
+		// Rolls alone would give 40 + 16 ms; the nested presses below that
+		// split the difference instead (24 ms, 28 if a sleep ran long)
+		int rollTerm = f.gauge("keydrive_roll_term_milliseconds");
+		CHECK(rollTerm >= 20 && rollTerm < 40);
+	}
+
+} // namespace
+
+int main() {
+	testHistogram();
+	testHistogramDecay();
+	testTap();
+	testHoldByTimer();
+	testRollIsTap();
+	testInterruptIsHold();
+	testCancel();
+	testRecomputeFromTaps();
+	testHysteresis();
+	testRecomputeRollTerm();
+
+	if (failures) {
+		std::fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	std::printf("All tap-hold checks passed\n");
+	return 0;
+}
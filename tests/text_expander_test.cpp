@@ -0,0 +1,174 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "output_handler.hpp"
+#include "text_expander.hpp"
+
+using namespace keydrive;
+
+namespace {
+
+	int failures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++failures; \
+		} \
+	} while (0)
+
+	/**
+	 * @brief Sink that applies OutputHandler's effects to a text buffer
+	 *
+	 * wtype appends its argument; uinput presses of Space/Enter append the
+	 * character and Backspace removes the last one. Other keys leave the
+	 * buffer alone.
+	 */
+	class DocumentSink : public OutputSink {
+	public:
+		std::string document;
+
+		bool write(const input_event* events, size_t count) override {
+			for (size_t i = 0; i < count; ++i) {
+				const input_event& ev = events[i];
+				if (ev.type != EV_KEY || ev.value != 1) {
+					continue;
+				}
+				if (ev.code == KEY_BACKSPACE) {
+					if (!document.empty()) {
+						document.pop_back();
+					}
+				} else if (ev.code == KEY_SPACE) {
+					document += ' ';
+				} else if (ev.code == KEY_ENTER) {
+					document += '\n';
+				}
+			}
+			return true;
+		}
+
+		std::pair<int, std::string> run(const std::vector<std::string>& argv, int) override {
+			if (!argv.empty() && argv.front() == "wtype") {
+				document += argv.back();
+				return {0, ""};
+			}
+			return {-1, ""};
+		}
+
+		bool typeX11(const std::u32string&) override { return false; }
+		bool hasXdotool() const override { return false; }
+		uint64_t getKeymapChanges() const override { return 0; }
+	};
+
+	const std::vector<Abbreviation> ABBREVIATIONS = {
+		{U"tw", U"X"},
+		{U"btw", U"by the way"},
+		{U"omw", U"on my way"},
+	};
+
+	// Handler typing into a Wayland terminal, so text goes through wtype
+	struct Fixture {
+		DocumentSink sink;
+		OutputHandler output{sink};
+
+		Fixture() {
+			output.setWindowClass(std::string("foot"));
+			output.setAbbreviations(ABBREVIATIONS);
+		}
+
+		void type(const std::u32string& text) {
+			for (char32_t c : text) {
+				output.sendUnicode(c);
+			}
+		}
+
+		void tap(unsigned int code) {
+			output.forwardEvent(code, 1);
+			output.forwardEvent(code, 0);
+		}
+	};
+
+	void testLongestSuffix() {
+		// "tw" also ends at the 'w' of "btw"; the longer trigger wins
+		Fixture f;
+		f.type(U"btw");
+		CHECK(f.sink.document == "by the way");
+
+		Fixture g;
+		g.type(U"xtw");
+		CHECK(g.sink.document == "xX");
+	}
+
+	void testBackspaceRewind() {
+		// "bx<BS>tw" leaves "btw" on screen, so it expands
+		Fixture f;
+		f.type(U"bx");
+		f.tap(KEY_BACKSPACE);
+		f.type(U"tw");
+		CHECK(f.sink.document == "by the way");
+	}
+
+	void testResetOnForwardedKeys() {
+		// The caret moved between 'b' and "tw"
+		Fixture f;
+		f.type(U"b");
+		f.tap(KEY_LEFT);
+		f.type(U"tw");
+		CHECK(f.sink.document == "bX");
+
+		// Modifiers don't move the caret
+		Fixture g;
+		g.type(U"om");
+		g.tap(KEY_LEFTSHIFT);
+		g.type(U"w");
+		CHECK(g.sink.document == "on my way");
+
+		// Neither does a new window class keep the old context
+		Fixture h;
+		h.type(U"om");
+		h.output.setWindowClass(std::string("kitty"));
+		h.type(U"w");
+		CHECK(h.sink.document == "omw");
+	}
+
+	void testSendTextMidString() {
+		Fixture f;
+		CHECK(f.output.sendText(U"xbtwy"));
+		CHECK(f.sink.document == "xby the wayy");
+
+		Fixture g;
+		CHECK(g.output.sendText(U"omw, btw"));
+		CHECK(g.sink.document == "on my way, by the way");
+	}
+
+	void testFindShadowing() {
+		std::vector<Abbreviation> set = {
+			{U"ab", U"1"},
+			{U"abc", U"2"},
+			{U"c", U"3"},
+		};
+		const Abbreviation* shadow = TextExpander::findShadowing(set, U"abc");
+		CHECK(shadow != nullptr && shadow->trigger == U"ab");
+		CHECK(TextExpander::findShadowing(set, U"ab") == nullptr);
+
+		// Only sharing the ending is not a conflict
+		CHECK(TextExpander::findShadowing(ABBREVIATIONS, U"btw") == nullptr);
+	}
+
+} // namespace
+
+int main() {
+	testLongestSuffix();
+	testBackspaceRewind();
+	testResetOnForwardedKeys();
+	testSendTextMidString();
+	testFindShadowing();
+
+	if (failures) {
+		std::fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	std::printf("All text expansion checks passed\n");
+	return 0;
+}
@@ -0,0 +1,152 @@
+#include "text_expander.hpp"
+#include <queue>
+
+namespace keydrive {
+
+	void TextExpander::compile(const std::vector<Abbreviation>& input) {
+		abbreviations.clear();
+		alphabet.clear();
+		transitions.clear();
+		matches.clear();
+		reset();
+
+		for (const auto& abbreviation : input) {
+			if (!abbreviation.trigger.empty()) {
+				abbreviations.push_back(abbreviation);
+			}
+		}
+		if (abbreviations.empty()) {
+			return;
+		}
+
+		// 1. Give every character used by a trigger its own column
+		for (const auto& abbreviation : abbreviations) {
+			for (char32_t c : abbreviation.trigger) {
+				if (alphabet.find(c) == alphabet.end()) {
+					uint32_t column = static_cast<uint32_t>(alphabet.size());
+					alphabet[c] = column;
+				}
+			}
+		}
+		const size_t width = alphabet.size();
+
+		// 2. Build the trie (state 0 is the root, -1 marks a missing edge)
+		transitions.assign(width, -1);
+		matches.assign(1, -1);
+		for (size_t i = 0; i < abbreviations.size(); ++i) {
+			int32_t current = 0;
+			for (char32_t c : abbreviations[i].trigger) {
+				size_t slot = static_cast<size_t>(current) * width + alphabet.at(c);
+				if (transitions[slot] < 0) {
+					transitions[slot] = static_cast<int32_t>(matches.size());
+					transitions.resize(transitions.size() + width, -1);
+					matches.push_back(-1);
+				}
+				current = transitions[slot];
+			}
+			// Keep the first definition of a duplicated trigger
+			if (matches[current] < 0) {
+				matches[current] = static_cast<int32_t>(i);
+			}
+		}
+
+		// 3. Breadth-first pass: compute failure links and turn the trie into a
+		//    complete DFA, so feeding never has to walk failure chains
+		std::vector<int32_t> failure(matches.size(), 0);
+		std::queue<int32_t> pending;
+
+		for (size_t column = 0; column < width; ++column) {
+			int32_t child = transitions[column];
+			if (child < 0) {
+				transitions[column] = 0;
+			} else {
+				failure[child] = 0;
+				pending.push(child);
+			}
+		}
+
+		while (!pending.empty()) {
+			int32_t current = pending.front();
+			pending.pop();
+
+			// Inherit the longest abbreviation that is a suffix of this state
+			if (matches[current] < 0) {
+				matches[current] = matches[failure[current]];
+			}
+
+			size_t row = static_cast<size_t>(current) * width;
+			size_t failRow = static_cast<size_t>(failure[current]) * width;
+			for (size_t column = 0; column < width; ++column) {
+				int32_t child = transitions[row + column];
+				if (child < 0) {
+					transitions[row + column] = transitions[failRow + column];
+				} else {
+					failure[child] = transitions[failRow + column];
+					pending.push(child);
+				}
+			}
+		}
+	}
+
+	const Abbreviation* TextExpander::findShadowing(const std::vector<Abbreviation>& abbreviations,
+		const std::u32string& trigger) {
+		for (const auto& other : abbreviations) {
+			if (other.trigger.empty() || other.trigger.size() >= trigger.size()) {
+				continue;
+			}
+			// The first occurrence ends earliest
+			size_t position = trigger.find(other.trigger);
+			if (position != std::u32string::npos && position + other.trigger.size() < trigger.size()) {
+				return &other;
+			}
+		}
+		return nullptr;
+	}
+
+	std::optional<Expansion> TextExpander::feed(char32_t c) {
+		if (abbreviations.empty()) {
+			return std::nullopt;
+		}
+
+		// Backspace rewinds to the state before the erased character
+		if (c == U'\b') {
+			if (historyCount > 0) {
+				historyHead = (historyHead + HISTORY_SIZE - 1) % HISTORY_SIZE;
+				--historyCount;
+			}
+			state = historyCount > 0 ? history[(historyHead + HISTORY_SIZE - 1) % HISTORY_SIZE] : 0;
+			return std::nullopt;
+		}
+
+		auto it = alphabet.find(c);
+		state = (it == alphabet.end()) ? 0
+			: transitions[static_cast<size_t>(state) * alphabet.size() + it->second];
+
+		history[historyHead] = state;
+		historyHead = (historyHead + 1) % HISTORY_SIZE;
+		if (historyCount < HISTORY_SIZE) {
+			++historyCount;
+		}
+
+		int32_t match = matches[state];
+		if (match < 0) {
+			return std::nullopt;
+		}
+
+		// The replacement must not be able to complete another trigger
+		reset();
+		const Abbreviation& abbreviation = abbreviations[match];
+		return Expansion{abbreviation.trigger.size(), &abbreviation.replacement};
+	}
+
+	void TextExpander::reset() {
+		historyHead = 0;
+		historyCount = 0;
+		state = 0;
+	}
+
+	bool TextExpander::empty() const {
+		return abbreviations.empty();
+	}
+
+} // namespace keydrive
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+namespace keydrive {
+
+	/**
+	 * @brief An abbreviation and the text it expands to
+	 */
+	struct Abbreviation {
+		std::u32string trigger;
+		std::u32string replacement;
+	};
+
+	/**
+	 * @brief Edit to apply after a trigger was typed
+	 */
+	struct Expansion {
+		size_t erase;                      // Characters to delete (length of the trigger)
+		const std::u32string* replacement; // Text to type in place of the trigger
+	};
+
+	/**
+	 * @brief Expands abbreviations as they are typed
+	 *
+	 * Triggers are compiled into an Aho-Corasick automaton with a dense
+	 * transition table, so feeding a character costs one alphabet lookup and
+	 * one table read regardless of how many abbreviations are configured.
+	 *
+	 * A trigger fires as soon as its last character is typed. A trigger that
+	 * contains another one before its end (e.g., "abc" with "ab") can
+	 * therefore never fire; findShadowing() detects such sets.
+	 */
+	class TextExpander {
+	public:
+		/**
+		 * @brief Compile a set of abbreviations, replacing any previous set
+		 *
+		 * @param abbreviations Trigger/replacement pairs (empty triggers are ignored)
+		 */
+		void compile(const std::vector<Abbreviation>& abbreviations);
+
+		/**
+		 * @brief Find the trigger that fires before another one can complete
+		 *
+		 * Triggers that only share their ending (e.g., "b" and "ab") don't
+		 * conflict: the longest one ending at a character wins.
+		 *
+		 * @param abbreviations The configured set
+		 * @param trigger The trigger to check
+		 * @return const Abbreviation* The shadowing abbreviation, or nullptr
+		 */
+		static const Abbreviation* findShadowing(const std::vector<Abbreviation>& abbreviations,
+			const std::u32string& trigger);
+
+		/**
+		 * @brief Feed one emitted character into the matcher
+		 *
+		 * A backspace rewinds the matcher by one character.
+		 *
+		 * @param c The character that was just emitted
+		 * @return std::optional<Expansion> Expansion to perform, or nullopt if no trigger completed
+		 */
+		std::optional<Expansion> feed(char32_t c);
+
+		/**
+		 * @brief Forget recently typed characters
+		 */
+		void reset();
+
+		/**
+		 * @brief Check if any abbreviations are configured
+		 */
+		bool empty() const;
+
+	private:
+		static constexpr size_t HISTORY_SIZE = 64;
+
+		// Compiled automaton
+		std::vector<Abbreviation> abbreviations;
+		std::unordered_map<char32_t, uint32_t> alphabet;  // Character -> column in transitions
+		std::vector<int32_t> transitions;                 // states x alphabet, dense
+		std::vector<int32_t> matches;                     // Longest abbreviation ending in each state, or -1
+
+		// Ring of automaton states after each recently emitted character
+		std::array<int32_t, HISTORY_SIZE> history{};
+		size_t historyHead = 0;
+		size_t historyCount = 0;
+		int32_t state = 0;
+	};
+
+} // namespace keydrive
@@ -0,0 +1,73 @@
+#include "unix_socket.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace keydrive {
+
+	sockaddr_un makeUnixAddress(const std::string& path) {
+		sockaddr_un addr{};
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) {
+			throw std::runtime_error("Socket path too long: " + path);
+		}
+		std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+		return addr;
+	}
+
+	int listenUnixSocket(const std::string& path, int backlog, const std::string& purpose) {
+		sockaddr_un addr = makeUnixAddress(path);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0) {
+			throw std::runtime_error("Failed to create " + purpose + " socket: " + std::strerror(errno));
+		}
+
+		auto fail = [&](const std::string& what, int error) {
+			close(fd);
+			throw std::runtime_error("Failed to " + what + " " + purpose + " socket: " + std::strerror(error));
+		};
+
+		if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+			if (errno != EADDRINUSE) {
+				fail("bind", errno);
+			}
+
+			// Replace the socket only if nobody is listening on it
+			int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			bool alive = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+			if (probe >= 0) {
+				close(probe);
+			}
+			if (alive) {
+				close(fd);
+				throw std::runtime_error("Another keydrive instance is listening on " + path);
+			}
+			unlink(path.c_str());
+			if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+				fail("bind", errno);
+			}
+		}
+
+		chmod(path.c_str(), 0600);
+		if (listen(fd, backlog) < 0) {
+			int error = errno;
+			unlink(path.c_str());
+			fail("listen on", error);
+		}
+		return fd;
+	}
+
+	bool peerAllowed(int fd) {
+		ucred cred{};
+		socklen_t len = sizeof(cred);
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+			return false;
+		}
+		return cred.uid == getuid() || cred.uid == 0;
+	}
+
+} // namespace keydrive
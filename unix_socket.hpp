@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <sys/un.h>
+
+namespace keydrive {
+
+	/**
+	 * @brief Build the address of a Unix socket path
+	 *
+	 * @throws std::runtime_error if the path does not fit sun_path
+	 */
+	sockaddr_un makeUnixAddress(const std::string& path);
+
+	/**
+	 * @brief Bind a non-blocking Unix stream socket and listen on it
+	 *
+	 * A stale socket left by a crashed instance is replaced; one another
+	 * process still listens on is not. The socket is made accessible to its
+	 * owner only.
+	 *
+	 * @param path Socket path
+	 * @param backlog listen() backlog
+	 * @param purpose Used in error messages (e.g., "control")
+	 * @return int Listening file descriptor
+	 * @throws std::runtime_error if the socket cannot be set up or another instance is listening
+	 */
+	int listenUnixSocket(const std::string& path, int backlog, const std::string& purpose);
+
+	/**
+	 * @brief Check that the peer of a connected socket is the same user (or root)
+	 */
+	bool peerAllowed(int fd);
+
+} // namespace keydrive
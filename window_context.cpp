@@ -0,0 +1,170 @@
+#include "window_context.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace keydrive {
+
+	namespace {
+
+		// $XDG_RUNTIME_DIR/hypr/<signature>/<name>, or empty outside Hyprland
+		std::string hyprlandSocketPath(const char* name) {
+			const char* signature = std::getenv("HYPRLAND_INSTANCE_SIGNATURE");
+			const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+			if (!signature || !*signature || !runtimeDir || !*runtimeDir) {
+				return "";
+			}
+			return std::string(runtimeDir) + "/hypr/" + signature + "/" + name;
+		}
+
+		int connectSocket(const std::string& path, int flags) {
+			sockaddr_un addr{};
+			addr.sun_family = AF_UNIX;
+			if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+				return -1;
+			}
+			std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+			int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+			if (fd < 0) {
+				return -1;
+			}
+			if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+				close(fd);
+				return -1;
+			}
+			return fd;
+		}
+
+		std::string toLower(std::string text) {
+			std::transform(text.begin(), text.end(), text.begin(),
+						   [](unsigned char c) { return std::tolower(c); });
+			return text;
+		}
+
+		// One request on the command socket for the initial state; afterwards
+		// every change arrives as an event
+		std::string queryActiveClass() {
+			int fd = connectSocket(hyprlandSocketPath(".socket.sock"), 0);
+			if (fd < 0) {
+				return "";
+			}
+			timeval timeout{0, 200000};
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+			std::string reply;
+			const char request[] = "activewindow";
+			if (write(fd, request, sizeof(request) - 1) == static_cast<ssize_t>(sizeof(request) - 1)) {
+				char chunk[1024];
+				ssize_t received;
+				while ((received = read(fd, chunk, sizeof(chunk))) > 0) {
+					reply.append(chunk, static_cast<size_t>(received));
+				}
+			}
+			close(fd);
+
+			size_t start = reply.find("\tclass: ");
+			if (start == std::string::npos) {
+				return "";
+			}
+			start += std::strlen("\tclass: ");
+			return reply.substr(start, reply.find('\n', start) - start);
+		}
+
+	} // anonymous namespace
+
+	WindowContext::WindowContext(Reactor& reactor, ChangeHandler onChange)
+		: reactor(reactor), onChange(std::move(onChange)) {
+		eventFd = connectSocket(hyprlandSocketPath(".socket2.sock"), SOCK_NONBLOCK);
+		if (eventFd < 0) {
+			std::cout << "ℹ No Hyprland event socket, application profiles inactive" << std::endl;
+			return;
+		}
+
+		windowClass = toLower(queryActiveClass());
+		reactor.add(eventFd, EPOLLIN, [this](uint32_t) {
+			handleEvents();
+		});
+	}
+
+	WindowContext::~WindowContext() {
+		if (eventFd >= 0) {
+			reactor.remove(eventFd);
+			close(eventFd);
+		}
+	}
+
+	const std::string& WindowContext::getWindowClass() const {
+		return windowClass;
+	}
+
+	bool WindowContext::isActive() const {
+		return eventFd >= 0;
+	}
+
+	void WindowContext::handleEvents() {
+		char chunk[4096];
+		bool lost = false;
+		while (true) {
+			ssize_t received = read(eventFd, chunk, sizeof(chunk));
+			if (received > 0) {
+				buffer.append(chunk, static_cast<size_t>(received));
+				continue;
+			}
+			if (received < 0 && errno == EINTR) {
+				continue;
+			}
+			lost = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+			break;
+		}
+
+		// Events are "name>>data" lines; only the last focus change in a burst matters
+		std::string latest;
+		bool changed = false;
+		size_t newline;
+		while ((newline = buffer.find('\n')) != std::string::npos) {
+			std::string line = buffer.substr(0, newline);
+			buffer.erase(0, newline + 1);
+
+			const std::string prefix = "activewindow>>";
+			if (line.compare(0, prefix.size(), prefix) == 0) {
+				std::string data = line.substr(prefix.size());
+				latest = data.substr(0, data.find(','));
+				changed = true;
+			}
+		}
+		if (changed) {
+			setWindowClass(toLower(latest));
+		}
+
+		if (lost) {
+			std::cerr << "⚠ Hyprland event socket closed, application profiles inactive" << std::endl;
+			reactor.remove(eventFd);
+			close(eventFd);
+			eventFd = -1;
+			buffer.clear();
+			// The class would only go stale from here on
+			windowClass.clear();
+			if (onChange) {
+				onChange(std::nullopt);
+			}
+		}
+	}
+
+	void WindowContext::setWindowClass(std::string newClass) {
+		if (newClass == windowClass) {
+			return;
+		}
+		windowClass = std::move(newClass);
+		if (onChange) {
+			onChange(windowClass);
+		}
+	}
+
+} // namespace keydrive
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <optional>
+#include <functional>
+#include "reactor.hpp"
+
+namespace keydrive {
+
+	/**
+	 * @brief Tracks the focused window's class through Hyprland's event socket
+	 *
+	 * Focus changes are pushed by the compositor (socket2, "activewindow>>"
+	 * events) and handled in the reactor, so lookups on the key path never
+	 * spawn processes or block. Outside Hyprland the class stays empty.
+	 */
+	class WindowContext {
+	public:
+		using ChangeHandler = std::function<void(const std::optional<std::string>& windowClass)>;
+
+		/**
+		 * @brief Connect to the compositor and register with the reactor
+		 *
+		 * Never throws; without a compositor connection the context is inactive.
+		 *
+		 * @param reactor Reactor serving the event socket
+		 * @param onChange Called with the lowercase class whenever focus moves to another
+		 *                 class, and with nullopt once the event socket is lost
+		 */
+		WindowContext(Reactor& reactor, ChangeHandler onChange);
+		~WindowContext();
+
+		WindowContext(const WindowContext&) = delete;
+		WindowContext& operator=(const WindowContext&) = delete;
+
+		/**
+		 * @brief Get the lowercase class of the focused window (empty if unknown)
+		 */
+		const std::string& getWindowClass() const;
+
+		/**
+		 * @brief Check whether focus changes are being tracked
+		 */
+		bool isActive() const;
+
+	private:
+		void handleEvents();
+		void setWindowClass(std::string windowClass);
+
+		Reactor& reactor;
+		ChangeHandler onChange;
+		int eventFd = -1;
+		std::string buffer;
+		std::string windowClass;
+	};
+
+} // namespace keydrive
@@ -0,0 +1,373 @@
+#include "xtest_output.hpp"
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#ifdef KEYDRIVE_HAVE_XTEST
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XTest.h>
+#endif
+
+namespace keydrive {
+
+	namespace {
+
+		// Don't try to connect on every key while X is not there
+		constexpr auto RETRY_INTERVAL = std::chrono::seconds(5);
+
+	} // anonymous namespace
+
+#ifdef KEYDRIVE_HAVE_XTEST
+	namespace {
+
+		// Latin-1 keysyms equal their code points; everything else uses the
+		// Unicode keysym range
+		KeySym keysymFor(char32_t c) {
+			if ((c >= 0x20 && c <= 0x7e) || (c >= 0xa0 && c <= 0xff)) {
+				return static_cast<KeySym>(c);
+			}
+			return static_cast<KeySym>(0x01000000 | c);
+		}
+
+		// Requests the server rejects (e.g., a keymap change racing another
+		// client) must not end the daemon
+		int ignoreError(Display*, XErrorEvent* error) {
+			std::cerr << "⚠ X error " << static_cast<int>(error->error_code)
+			<< " (request " << static_cast<int>(error->request_code) << ")" << std::endl;
+			return 0;
+		}
+
+		// Called when the connection breaks (X server gone); Xlib would exit otherwise
+		void markLost(Display*, void* lost) {
+			*static_cast<bool*>(lost) = true;
+		}
+
+	} // anonymous namespace
+
+	struct XTestOutput::Connection {
+		struct Key {
+			KeyCode code;
+			bool shift;
+			int spare;  // Index into spares, -1 for keys of the keymap itself
+		};
+
+		struct Spare {
+			KeyCode code;
+			KeySym bound = NoSymbol;
+			uint64_t lastUse = 0;
+		};
+
+		Display* display = nullptr;
+		bool lost = false;
+
+		int minKeycode = 0;
+		int maxKeycode = 0;
+		int keysymsPerKeycode = 0;
+		std::vector<KeySym> keymap;
+		KeyCode shiftKeycode = 0;
+		std::vector<KeyCode> modifierKeycodes;  // Keys bound to Shift, Control and Mod1-5
+
+		std::vector<Spare> spares;
+		std::array<int, 256> spareOf;          // Keycode → index into spares, -1 if none
+		std::unordered_map<KeySym, Key> keys;  // Lookups so far, keymap hits and bindings
+		uint64_t uses = 0;
+		uint64_t pinnedAfter = 0;              // Spares used after this are not rebound
+
+		Connection() {
+			spareOf.fill(-1);
+		}
+
+		~Connection() {
+			if (!display) {
+				return;
+			}
+			// Give the keycodes we bound back to the keymap; a lost server has
+			// nothing left to restore
+			if (!lost) {
+				bool restored = false;
+				for (const Spare& spare : spares) {
+					if (spare.bound != NoSymbol) {
+						KeySym none[] = {NoSymbol};
+						XChangeKeyboardMapping(display, spare.code, 1, none, 1);
+						restored = true;
+					}
+				}
+				if (restored) {
+					XSync(display, False);
+				}
+			}
+			XCloseDisplay(display);
+		}
+
+		KeySym keysymAt(int keycode, int column) const {
+			return keymap[static_cast<size_t>((keycode - minKeycode) * keysymsPerKeycode + column)];
+		}
+
+		bool isOurs(int keycode) const {
+			return spareOf[static_cast<size_t>(keycode)] >= 0;
+		}
+
+		// Read the keymap and collect the keycodes without symbols. Our own
+		// bindings stay spares and keep their keysym so it can be unbound
+		// later; the lookup cache is forgotten like the rest.
+		void loadKeymap() {
+			std::array<int, 256> ours = spareOf;
+
+			int count = maxKeycode - minKeycode + 1;
+			KeySym* mapping = XGetKeyboardMapping(display, static_cast<KeyCode>(minKeycode), count, &keysymsPerKeycode);
+			keymap.assign(mapping, mapping + count * keysymsPerKeycode);
+			XFree(mapping);
+
+			spares.clear();
+			spareOf.fill(-1);
+			keys.clear();
+			for (int keycode = minKeycode; keycode <= maxKeycode; ++keycode) {
+				bool empty = true;
+				for (int column = 0; column < keysymsPerKeycode; ++column) {
+					empty = empty && keysymAt(keycode, column) == NoSymbol;
+				}
+				if (empty || ours[static_cast<size_t>(keycode)] >= 0) {
+					spareOf[static_cast<size_t>(keycode)] = static_cast<int>(spares.size());
+					spares.push_back({static_cast<KeyCode>(keycode), empty ? NoSymbol : keysymAt(keycode, 0)});
+				}
+			}
+			shiftKeycode = XKeysymToKeycode(display, XK_Shift_L);
+		}
+
+		// Collect the keys that act as modifiers. Lock keys are left out:
+		// pressing one again to restore it would toggle its lock.
+		void loadModifiers() {
+			modifierKeycodes.clear();
+			XModifierKeymap* map = XGetModifierMapping(display);
+			if (!map) {
+				return;
+			}
+			for (int modifier = 0; modifier < 8; ++modifier) {
+				if (modifier == LockMapIndex) {
+					continue;
+				}
+				for (int slot = 0; slot < map->max_keypermod; ++slot) {
+					KeyCode code = map->modifiermap[modifier * map->max_keypermod + slot];
+					if (code == 0 || XkbKeycodeToKeysym(display, code, 0, 0) == XK_Num_Lock
+						|| std::find(modifierKeycodes.begin(), modifierKeycodes.end(), code) != modifierKeycodes.end()) {
+						continue;
+					}
+					modifierKeycodes.push_back(code);
+				}
+			}
+			XFreeModifiermap(map);
+		}
+
+		// Modifier keys the server sees as down, e.g. a Shift held for a layer
+		// and forwarded to the virtual keyboard
+		std::vector<KeyCode> heldModifiers() {
+			char down[32];
+			XQueryKeymap(display, down);
+			std::vector<KeyCode> held;
+			for (KeyCode code : modifierKeycodes) {
+				if ((down[code / 8] >> (code % 8)) & 1) {
+					held.push_back(code);
+				}
+			}
+			return held;
+		}
+
+		// Handle keymap changes; our own (one spare keycode) are already known.
+		// Returns true if the keymap was reloaded.
+		bool processEvents() {
+			bool changed = false;
+			bool modifiersChanged = false;
+			while (XPending(display) > 0) {
+				XEvent event;
+				XNextEvent(display, &event);
+				if (event.type != MappingNotify) {
+					continue;
+				}
+				XRefreshKeyboardMapping(&event.xmapping);
+				if (event.xmapping.request == MappingKeyboard
+					&& !(event.xmapping.count == 1 && isOurs(event.xmapping.first_keycode))) {
+					changed = true;
+				} else if (event.xmapping.request == MappingModifier) {
+					modifiersChanged = true;
+				}
+			}
+			if (changed) {
+				loadKeymap();
+			}
+			if (changed || modifiersChanged) {
+				loadModifiers();
+			}
+			return changed;
+		}
+
+		const Key* lookup(KeySym keysym) {
+			auto found = keys.find(keysym);
+			if (found != keys.end()) {
+				if (found->second.spare >= 0) {
+					spares[static_cast<size_t>(found->second.spare)].lastUse = ++uses;
+				}
+				return &found->second;
+			}
+
+			// On the keymap already (first group, with or without Shift)
+			for (int keycode = minKeycode; keycode <= maxKeycode; ++keycode) {
+				if (isOurs(keycode)) {
+					continue;
+				}
+				if (keysymAt(keycode, 0) == keysym) {
+					return &keys.emplace(keysym, Key{static_cast<KeyCode>(keycode), false, -1}).first->second;
+				}
+				if (keysymsPerKeycode > 1 && shiftKeycode != 0 && keysymAt(keycode, 1) == keysym) {
+					return &keys.emplace(keysym, Key{static_cast<KeyCode>(keycode), true, -1}).first->second;
+				}
+			}
+
+			// Bind the least recently used spare keycode. One still pinned
+			// carries text the client may not have looked up yet; rebinding
+			// it would turn that text into this character.
+			if (spares.empty()) {
+				return nullptr;
+			}
+			size_t index = 0;
+			for (size_t candidate = 1; candidate < spares.size(); ++candidate) {
+				if (spares[candidate].lastUse < spares[index].lastUse) {
+					index = candidate;
+				}
+			}
+			Spare& spare = spares[index];
+			if (spare.lastUse > pinnedAfter) {
+				return nullptr;
+			}
+			if (spare.bound != NoSymbol) {
+				keys.erase(spare.bound);
+			}
+
+			KeySym symbols[] = {keysym};
+			XChangeKeyboardMapping(display, spare.code, 1, symbols, 1);
+			XSync(display, False);
+
+			for (int column = 0; column < keysymsPerKeycode; ++column) {
+				keymap[static_cast<size_t>((spare.code - minKeycode) * keysymsPerKeycode + column)] = column == 0 ? keysym : NoSymbol;
+			}
+			spare.bound = keysym;
+			spare.lastUse = ++uses;
+			return &keys.emplace(keysym, Key{spare.code, false, static_cast<int>(index)}).first->second;
+		}
+	};
+#else
+	struct XTestOutput::Connection {
+	};
+#endif
+
+	XTestOutput::XTestOutput(std::string displayName) : displayName(std::move(displayName)) {
+	}
+
+	XTestOutput::~XTestOutput() = default;
+
+	bool XTestOutput::isConnected() const {
+		return connection != nullptr;
+	}
+
+	uint64_t XTestOutput::getKeymapChanges() const {
+		return keymapChanges;
+	}
+
+	bool XTestOutput::connect() {
+		auto now = std::chrono::steady_clock::now();
+		if (now < nextAttempt) {
+			return false;
+		}
+		nextAttempt = now + RETRY_INTERVAL;
+
+#ifdef KEYDRIVE_HAVE_XTEST
+		auto candidate = std::make_unique<Connection>();
+		candidate->display = XOpenDisplay(displayName.empty() ? nullptr : displayName.c_str());
+		if (!candidate->display) {
+			std::cerr << "⚠ XTest output: cannot open X display, using xdotool" << std::endl;
+			return false;
+		}
+		int eventBase, errorBase, major, minor;
+		if (!XTestQueryExtension(candidate->display, &eventBase, &errorBase, &major, &minor)) {
+			std::cerr << "⚠ XTest output: X server has no XTest extension, using xdotool" << std::endl;
+			return false;
+		}
+		XSetErrorHandler(ignoreError);
+		XSetIOErrorExitHandler(candidate->display, markLost, &candidate->lost);
+
+		XDisplayKeycodes(candidate->display, &candidate->minKeycode, &candidate->maxKeycode);
+		candidate->loadKeymap();
+		candidate->loadModifiers();
+		std::cout << "✅ XTest output connected to " << DisplayString(candidate->display)
+		<< " (" << candidate->spares.size() << " spare keycodes)" << std::endl;
+		connection = std::move(candidate);
+		++keymapChanges;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	bool XTestOutput::type(const std::u32string& text) {
+#ifdef KEYDRIVE_HAVE_XTEST
+		if (connection && connection->lost) {
+			std::cerr << "⚠ XTest output: connection lost" << std::endl;
+			connection.reset();
+		}
+		if (!connection && !connect()) {
+			return false;
+		}
+
+		Connection& x = *connection;
+		if (x.processEvents()) {
+			++keymapChanges;
+		}
+
+		// Bind every character before the first key event goes out: the
+		// spares used by this text stay pinned, and text needing more of them
+		// than there are fails without typing anything, so the caller can send
+		// all of it another way
+		x.pinnedAfter = x.uses;
+		std::vector<Connection::Key> resolved;
+		resolved.reserve(text.size());
+		for (char32_t c : text) {
+			const Connection::Key* key = x.lookup(keysymFor(c));
+			if (!key) {
+				std::cerr << "⚠ XTest output: not enough spare keycodes for " << text.size() << " characters" << std::endl;
+				return false;
+			}
+			resolved.push_back(*key);
+		}
+
+		// Held modifiers would change what the keys type (Shift turns '1'
+		// into '!' and a spare-bound 'é' into 'É'); let go of them for the
+		// text and press them again afterwards, like xdotool's --clearmodifiers
+		std::vector<KeyCode> held = x.heldModifiers();
+		for (KeyCode code : held) {
+			XTestFakeKeyEvent(x.display, code, False, CurrentTime);
+		}
+		for (const Connection::Key& key : resolved) {
+			if (key.shift) {
+				XTestFakeKeyEvent(x.display, x.shiftKeycode, True, CurrentTime);
+			}
+			XTestFakeKeyEvent(x.display, key.code, True, CurrentTime);
+			XTestFakeKeyEvent(x.display, key.code, False, CurrentTime);
+			if (key.shift) {
+				XTestFakeKeyEvent(x.display, x.shiftKeycode, False, CurrentTime);
+			}
+		}
+		for (KeyCode code : held) {
+			XTestFakeKeyEvent(x.display, code, True, CurrentTime);
+		}
+		XFlush(x.display);
+		return !x.lost;
+#else
+		(void)text;
+		return false;
+#endif
+	}
+
+} // namespace keydrive
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace keydrive {
+
+	/**
+	 * @brief Types text into X11 clients (XWayland) through the XTest extension
+	 *
+	 * Replaces the setxkbmap and xdotool processes started for every
+	 * character with one connection kept for the daemon's lifetime. The
+	 * connection is only opened for the first character sent to an X client,
+	 * so sessions without one never touch X.
+	 *
+	 * Characters without a key in the server's keymap are bound to spare
+	 * keycodes. Bindings are cached: a character typed again reuses its
+	 * keycode without changing the keymap, and the least recently used spare
+	 * is rebound when all are taken, though never one the same type() call
+	 * typed with, as the client may look its keysym up after the rebinding.
+	 * Text needing more spares than there are fails before any key is sent.
+	 *
+	 * Modifiers held while typing (a Shift held for a layer reaches X through
+	 * the virtual keyboard) are released for the text and pressed again
+	 * afterwards, so they don't change the characters.
+	 *
+	 * Keymap changes by others (MappingNotify) drop the cache. The spare
+	 * keycodes are unbound again when the connection closes (shutdown or
+	 * handover).
+	 *
+	 * Built without XTest (KEYDRIVE_HAVE_XTEST unset), type() always fails
+	 * and callers keep using xdotool.
+	 */
+	class XTestOutput {
+	public:
+		/**
+		 * @brief Prepare the backend; nothing is connected yet
+		 *
+		 * @param displayName X display to use (e.g., ":99" for Xvfb); empty for $DISPLAY
+		 */
+		explicit XTestOutput(std::string displayName = "");
+		~XTestOutput();
+
+		XTestOutput(const XTestOutput&) = delete;
+		XTestOutput& operator=(const XTestOutput&) = delete;
+
+		/**
+		 * @brief Type text into the focused X client, connecting on first use
+		 *
+		 * A failed connection is retried at most every few seconds.
+		 *
+		 * @param text Characters to type (no control characters)
+		 * @return true if every character was sent
+		 */
+		bool type(const std::u32string& text);
+
+		/**
+		 * @brief Check whether a connection is open
+		 */
+		bool isConnected() const;
+
+		/**
+		 * @brief Count of X keymaps seen so far: one per connection plus one per
+		 * change by another client
+		 */
+		uint64_t getKeymapChanges() const;
+
+	private:
+		struct Connection;
+
+		bool connect();
+
+		std::string displayName;
+		std::unique_ptr<Connection> connection;
+		std::chrono::steady_clock::time_point nextAttempt;
+		uint64_t keymapChanges = 0;
+	};
+
+} // namespace keydrive